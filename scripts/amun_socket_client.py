@@ -0,0 +1,52 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# Sends the lines of a file (or stdin) to `amun --server` and prints the
+# translations in order. With --json every line is sent as a JSON request
+# and the raw JSON responses are printed as they arrive.
+
+import sys
+import json
+import socket
+import argparse
+import threading
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-i", dest="input", default="-")
+    parser.add_argument("-p", dest="port", default=8080, type=int)
+    parser.add_argument("-s", dest="socket", help="Unix-domain socket instead of a port")
+    parser.add_argument("--json", action="store_true")
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+    if args.socket:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(args.socket)
+    else:
+        sock = socket.create_connection(("127.0.0.1", args.port))
+
+    lines = (sys.stdin if args.input == "-" else open(args.input)).read().splitlines()
+
+    def send():
+        for i, line in enumerate(lines):
+            if args.json:
+                line = json.dumps({"id": str(i), "text": line})
+            sock.sendall((line + "\n").encode("utf-8"))
+
+    # send while reading, so neither side blocks on a full socket buffer
+    sender = threading.Thread(target=send)
+    sender.start()
+
+    responses = sock.makefile("r")
+    for _ in lines:
+        sys.stdout.write(responses.readline())
+    sender.join()
+    sock.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,388 @@
+// Microbenchmarks for the CPU building blocks of the decoder, run on models
+// with random weights. Every benchmark is run for each combination of its
+// parameters, in the style of Google Benchmark:
+//
+//   amun_bench [--filter <substring>] [--min-time <seconds>] [--list]
+
+#include <map>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <functional>
+#include <unistd.h>
+
+#include <yaml-cpp/yaml.h>
+
+#include "bench/synthetic_model.h"
+#include "common/god.h"
+#include "common/sentence.h"
+#include "common/hypothesis.h"
+#include "cpu/mblas/matrix.h"
+#include "cpu/decoder/best_hyps.h"
+#include "cpu/dl4mt/model.h"
+#include "cpu/dl4mt/gru.h"
+#include "cpu/dl4mt/decoder.h"
+#include "cpu/nematus/model.h"
+#include "cpu/nematus/transition.h"
+
+using namespace amunmt;
+using namespace amunmt::CPU;
+using namespace std;
+
+namespace {
+
+struct Param {
+  std::string name;
+  std::vector<unsigned> values;
+};
+
+typedef std::map<std::string, unsigned> Args;
+typedef std::function<void()> Kernel;
+typedef std::function<Kernel(const Args&)> Setup;
+
+struct Benchmark {
+  std::string name;
+  std::vector<Param> params;
+  Setup setup;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// synthetic weights, generated once per shape and shared between benchmarks
+
+std::string TempDir() {
+  static std::string dir;
+  if (dir.empty()) {
+    char pattern[] = "/tmp/amun_bench.XXXXXX";
+    amunmt_UTIL_THROW_IF2(mkdtemp(pattern) == nullptr, "Could not create a temporary directory");
+    dir = pattern;
+  }
+  return dir;
+}
+
+template <class Weights>
+const Weights& GetWeights(const SyntheticModel& model) {
+  static std::map<std::string, std::unique_ptr<Weights>> cache;
+
+  std::string key = model.type + "." + std::to_string(model.dimState) + "."
+                  + std::to_string(model.trgVocab) + "." + std::to_string(model.layerNorm) + "."
+                  + std::to_string(model.decTransitionDepth);
+  auto it = cache.find(key);
+  if (it == cache.end()) {
+    std::string path = TempDir() + "/" + key + ".npz";
+    WriteSyntheticWeights(model, path);
+    it = cache.emplace(key, std::unique_ptr<Weights>(new Weights(path))).first;
+    std::remove(path.c_str());
+  }
+  return *it->second;
+}
+
+const dl4mt::Weights& GetDl4mtWeights(unsigned dim, unsigned vocab, bool layerNorm) {
+  SyntheticModel model;
+  model.dimState = dim;
+  model.dimEmb = dim / 2;
+  model.srcVocab = 100;
+  model.trgVocab = vocab;
+  model.layerNorm = layerNorm;
+  return GetWeights<dl4mt::Weights>(model);
+}
+
+const Nematus::Weights& GetNematusWeights(unsigned dim, bool layerNorm, unsigned depth) {
+  SyntheticModel model;
+  model.type = "nematus2";
+  model.dimState = dim;
+  model.dimEmb = dim / 2;
+  model.srcVocab = 100;
+  model.trgVocab = 100;
+  model.layerNorm = layerNorm;
+  model.decTransitionDepth = depth;
+  return GetWeights<Nematus::Weights>(model);
+}
+
+void Resize(mblas::Matrix& m, unsigned rows, unsigned cols) {
+  m.resize(rows, cols);
+}
+
+void Resize(mblas::ArrayMatrix& m, unsigned rows, unsigned cols) {
+  m.Resize(rows, cols);
+}
+
+template <class MT>
+void Randomize(MT& m, unsigned rows, unsigned cols, float min = -1.0f, float max = 1.0f) {
+  static std::mt19937 gen(1234);
+  std::uniform_real_distribution<float> dist(min, max);
+  Resize(m, rows, cols);
+  for (unsigned i = 0; i < rows; ++i) {
+    for (unsigned j = 0; j < cols; ++j) {
+      m(i, j) = dist(gen);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// a scorer that only holds a probability matrix, for BestHyps::CalcBeam
+
+class ProbsScorer : public Scorer {
+  public:
+    ProbsScorer(const God &god, const std::string& name, const YAML::Node& config)
+      : Scorer(god, name, config, 0)
+    {}
+
+    void Decode(const State&, State&, const std::vector<unsigned>&) {}
+    void BeginSentenceState(State&, unsigned) {}
+    void AssembleBeamState(const State&, const Beam&, State&) {}
+    void Encode(const Sentences&) {}
+    void Filter(const std::vector<unsigned>&) {}
+    State* NewState() const { return nullptr; }
+    unsigned GetVocabSize() const { return Probs.columns(); }
+
+    BaseMatrix& GetProbs() { return Probs; }
+    void *GetNBest() { return nullptr; }
+    const BaseMatrix *GetBias() const { return nullptr; }
+
+    mblas::ArrayMatrix Probs;
+};
+
+const God& GetGod() {
+  static God god;
+  static bool initialized = false;
+  if (!initialized) {
+    SyntheticModel model;
+    model.dimState = 32;
+    model.dimEmb = 16;
+    std::string config = WriteSyntheticModel(model, TempDir());
+    god.Init("-c " + config + " --cpu-threads 1 --log-info off --log-progress off");
+    initialized = true;
+  }
+  return god;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::vector<Benchmark> Benchmarks() {
+  const Param beam{"beam", {1, 5, 12}};
+  const Param batch{"batch", {1, 4}};
+  const Param dim{"dim", {256, 512, 1024}};
+  const Param layerNorm{"ln", {0, 1}};
+  const Param srcLen{"src", {10, 50}};
+  const Param vocab{"vocab", {8000, 32000}};
+
+  std::vector<Benchmark> benchmarks;
+
+  benchmarks.push_back({"GRU::GetNextState", {layerNorm, beam, batch, dim}, [](const Args& args) {
+    const dl4mt::Weights& w = GetDl4mtWeights(args.at("dim"), 100, args.at("ln"));
+    auto gru = std::make_shared<dl4mt::GRU<dl4mt::Weights::GRU>>(w.decGru1_);
+    auto state = std::make_shared<mblas::Matrix>();
+    auto embeddings = std::make_shared<mblas::Matrix>();
+    auto next = std::make_shared<mblas::Matrix>();
+    unsigned rows = args.at("beam") * args.at("batch");
+    Randomize(*state, rows, args.at("dim"));
+    Randomize(*embeddings, rows, args.at("dim") / 2);
+    return [=] { gru->GetNextState(*next, *state, *embeddings); };
+  }});
+
+  benchmarks.push_back({"Transition::GetNextState", {layerNorm, beam, batch, dim}, [](const Args& args) {
+    // layer normalization is only enabled for a depth above 1
+    const Nematus::Weights& w = GetNematusWeights(args.at("dim"), args.at("ln"), 2);
+    auto transition = std::make_shared<Nematus::Transition>(w.decTransition_);
+    auto state = std::make_shared<mblas::Matrix>();
+    Randomize(*state, args.at("beam") * args.at("batch"), args.at("dim"));
+    return [=] { transition->GetNextState(*state); };
+  }});
+
+  benchmarks.push_back({"Attention::GetAlignedSourceContext", {beam, srcLen, dim}, [](const Args& args) {
+    const dl4mt::Weights& w = GetDl4mtWeights(args.at("dim"), 100, false);
+    auto decoder = std::make_shared<dl4mt::Decoder>(w);
+    auto sourceContext = std::make_shared<mblas::Matrix>();
+    auto hidden = std::make_shared<mblas::Matrix>();
+    auto aligned = std::make_shared<mblas::Matrix>();
+    Randomize(*sourceContext, args.at("src"), 2 * args.at("dim"));
+    Randomize(*hidden, args.at("beam"), args.at("dim"));
+    mblas::Matrix state;
+    decoder->EmptyState(state, *sourceContext);
+    return [=] { decoder->GetAlignedSourceContext(*aligned, *hidden, *sourceContext); };
+  }});
+
+  benchmarks.push_back({"Softmax::GetProbs", {beam, Param{"dim", {256, 512}}, vocab}, [](const Args& args) {
+    const dl4mt::Weights& w = GetDl4mtWeights(args.at("dim"), args.at("vocab"), false);
+    auto decoder = std::make_shared<dl4mt::Decoder>(w);
+    auto state = std::make_shared<mblas::Matrix>();
+    auto embeddings = std::make_shared<mblas::Matrix>();
+    auto aligned = std::make_shared<mblas::Matrix>();
+    Randomize(*state, args.at("beam"), args.at("dim"));
+    Randomize(*embeddings, args.at("beam"), args.at("dim") / 2);
+    Randomize(*aligned, args.at("beam"), 2 * args.at("dim"));
+    return [=] { decoder->GetProbs(*state, *embeddings, *aligned); };
+  }});
+
+  benchmarks.push_back({"LogSoftmax", {beam, Param{"vocab", {8000, 32000, 64000}}}, [](const Args& args) {
+    // applying log-softmax to its own output leaves it unchanged, so the
+    // matrix can be reused across iterations
+    auto probs = std::make_shared<mblas::ArrayMatrix>();
+    Randomize(*probs, args.at("beam"), args.at("vocab"), -10.0f, 0.0f);
+    return [=] { mblas::LogSoftmax(*probs); };
+  }});
+
+  benchmarks.push_back({"SafeSoftmax", {beam, Param{"src", {10, 50, 100}}}, [](const Args& args) {
+    auto alignment = std::make_shared<mblas::Matrix>();
+    Randomize(*alignment, args.at("beam"), args.at("src"));
+    return [=] { mblas::SafeSoftmax(*alignment); };
+  }});
+
+  benchmarks.push_back({"Assemble", {beam, Param{"dim", {256, 512}}, vocab}, [](const Args& args) {
+    auto embeddings = std::make_shared<mblas::Matrix>();
+    auto out = std::make_shared<mblas::Matrix>();
+    Randomize(*embeddings, args.at("vocab"), args.at("dim"));
+    std::vector<unsigned> ids;
+    for (unsigned i = 0; i < args.at("beam"); ++i) {
+      ids.push_back((i * 7919) % args.at("vocab"));
+    }
+    return [=] { *out = mblas::Assemble<mblas::byRow, mblas::Matrix>(*embeddings, ids); };
+  }});
+
+  benchmarks.push_back({"Broadcast", {beam, srcLen, dim}, [](const Args& args) {
+    auto scu = std::make_shared<mblas::Matrix>();
+    auto state = std::make_shared<mblas::Matrix>();
+    auto out = std::make_shared<mblas::Matrix>();
+    Randomize(*scu, args.at("src"), 2 * args.at("dim"));
+    Randomize(*state, args.at("beam"), 2 * args.at("dim"));
+    return [=] { *out = mblas::Broadcast<mblas::Matrix>(mblas::Tanh(), *scu, *state); };
+  }});
+
+  benchmarks.push_back({"BestHyps::CalcBeam", {beam, Param{"vocab", {8000, 32000, 64000}}}, [](const Args& args) {
+    static const std::string name = "F0";
+    static const YAML::Node config;
+    const God& god = GetGod();
+
+    unsigned beamSize = args.at("beam");
+    auto scorer = std::make_shared<ProbsScorer>(god, name, config);
+    auto probs = std::make_shared<mblas::ArrayMatrix>();
+    Randomize(*probs, beamSize, args.at("vocab"), -10.0f, 0.0f);
+    scorer->Probs.Resize(probs->rows(), probs->columns());
+
+    auto sentence = std::make_shared<Sentence>(god, 0, "w2 w3");
+    HypothesisPtr root(new Hypothesis(*sentence));
+    Beam prevHyps;
+    for (unsigned i = 0; i < beamSize; ++i) {
+      prevHyps.emplace_back(new Hypothesis(root, 2 + i, 0, -0.1f * i));
+    }
+
+    auto bestHyps = std::make_shared<CPU::BestHyps>(god);
+    std::vector<ScorerPtr> scorers(1, scorer);
+    auto beams = std::make_shared<std::vector<Beam>>(1);
+    auto beamSizes = std::make_shared<std::vector<unsigned>>(1, beamSize);
+
+    // CalcBeam works in place, so the time includes restoring the scores
+    return [=] {
+      std::copy(probs->data(), probs->data() + probs->rows() * probs->columns(), scorer->Probs.data());
+      (*beams)[0].clear();
+      bestHyps->CalcBeam(prevHyps, scorers, Words(), *beams, *beamSizes);
+      (void)sentence;
+    };
+  }});
+
+  return benchmarks;
+}
+
+void ForEachArgs(const std::vector<Param>& params, size_t i, Args& args,
+                 const std::function<void(const Args&)>& f) {
+  if (i == params.size()) {
+    f(args);
+    return;
+  }
+  for (unsigned value : params[i].values) {
+    args[params[i].name] = value;
+    ForEachArgs(params, i + 1, args, f);
+  }
+}
+
+std::string Name(const Benchmark& benchmark, const Args& args) {
+  std::string name = benchmark.name;
+  for (const Param& param : benchmark.params) {
+    name += "/" + param.name + ":" + std::to_string(args.at(param.name));
+  }
+  return name;
+}
+
+// runs the kernel until it took at least minTime seconds, returns seconds per iteration
+double Measure(const Kernel& kernel, double minTime, size_t& iterations) {
+  typedef std::chrono::steady_clock Clock;
+  kernel();
+
+  iterations = 1;
+  while (true) {
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+      kernel();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (elapsed >= minTime || iterations >= 1000000000) {
+      return elapsed / iterations;
+    }
+
+    double perIteration = std::max(elapsed / iterations, 1e-9);
+    size_t next = size_t(1.4 * minTime / perIteration);
+    iterations = std::min(std::max(next, iterations + 1), 10 * iterations);
+  }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  std::string filter;
+  double minTime = 0.2;
+  bool list = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (arg == "--min-time" && i + 1 < argc) {
+      minTime = std::atof(argv[++i]);
+    } else if (arg == "--list") {
+      list = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--filter <substring>] [--min-time <seconds>] [--list]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  std::printf("%-64s %14s %12s\n", "Benchmark", "Time", "Iterations");
+  std::printf("%s\n", std::string(92, '-').c_str());
+
+  for (const Benchmark& benchmark : Benchmarks()) {
+    Args args;
+    ForEachArgs(benchmark.params, 0, args, [&](const Args& args) {
+      std::string name = Name(benchmark, args);
+      if (name.find(filter) == std::string::npos) {
+        return;
+      }
+      if (list) {
+        std::printf("%s\n", name.c_str());
+        return;
+      }
+
+      Kernel kernel = benchmark.setup(args);
+      size_t iterations;
+      double seconds = Measure(kernel, minTime, iterations);
+      std::printf("%-64s %11.0f ns %12zu\n", name.c_str(), seconds * 1e9, iterations);
+      std::fflush(stdout);
+    });
+  }
+
+  std::string dir = TempDir();
+  std::remove((dir + "/model.npz").c_str());
+  std::remove((dir + "/vocab.src.yml").c_str());
+  std::remove((dir + "/vocab.trg.yml").c_str());
+  std::remove((dir + "/config.yml").c_str());
+  rmdir(dir.c_str());
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+// Writes a model with random weights, its vocabularies, a config and
+// optionally a corpus of random sentences, so the decoder can be benchmarked
+// without downloading a trained model:
+//
+//   amun_synth -o <dir> [--type nematus2 --layer-norm --dec-depth 2 ...]
+//              [--corpus 1000 --length-distribution lognormal ...]
+
+#include <iostream>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "bench/synthetic_model.h"
+#include "common/exception.h"
+
+using namespace amunmt;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  std::string outputDir;
+  SyntheticModel model;
+  SyntheticCorpus corpus;
+  corpus.sentences = 0;
+
+  po::options_description options("Synthetic model options");
+  options.add_options()
+    ("output-dir,o", po::value(&outputDir)->required(),
+     "Directory for model.npz, vocab.src.yml, vocab.trg.yml, config.yml and corpus.txt")
+    ("type", po::value(&model.type)->default_value(model.type),
+     "Model type: nematus (dl4mt) or nematus2 (Nematus with deep transition)")
+    ("src-vocab", po::value(&model.srcVocab)->default_value(model.srcVocab),
+     "Size of the source vocabulary")
+    ("trg-vocab", po::value(&model.trgVocab)->default_value(model.trgVocab),
+     "Size of the target vocabulary")
+    ("dim-emb", po::value(&model.dimEmb)->default_value(model.dimEmb),
+     "Size of the embeddings")
+    ("dim-rnn", po::value(&model.dimState)->default_value(model.dimState),
+     "Size of the hidden state")
+    ("layer-norm", po::bool_switch(&model.layerNorm),
+     "Add layer normalization weights")
+    ("enc-depth", po::value(&model.encTransitionDepth)->default_value(0),
+     "Transition depth of the encoder (nematus2 only)")
+    ("dec-depth", po::value(&model.decTransitionDepth)->default_value(0),
+     "Transition depth of the decoder (nematus2 only)")
+    ("tied-embeddings", po::bool_switch(&model.tiedEmbeddings),
+     "Use the target embeddings as output layer")
+    ("seed", po::value(&model.seed)->default_value(model.seed),
+     "Seed of the random weights and sentences")
+    ("corpus", po::value(&corpus.sentences)->default_value(0),
+     "Number of sentences to write to corpus.txt, none if 0")
+    ("length-distribution", po::value(&corpus.distribution)->default_value(corpus.distribution),
+     "Distribution of sentence lengths: uniform, normal or lognormal")
+    ("length-mean", po::value(&corpus.meanLength)->default_value(corpus.meanLength),
+     "Mean sentence length")
+    ("length-stddev", po::value(&corpus.stddevLength)->default_value(corpus.stddevLength),
+     "Standard deviation of the sentence length")
+    ("min-length", po::value(&corpus.minLength)->default_value(corpus.minLength),
+     "Minimum sentence length")
+    ("max-length", po::value(&corpus.maxLength)->default_value(corpus.maxLength),
+     "Maximum sentence length")
+    ("help,h", po::value<bool>()->zero_tokens()->default_value(false),
+     "Print this help message and exit")
+  ;
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(options).run(), vm);
+    if (vm["help"].as<bool>()) {
+      std::cerr << "Usage: " << argv[0] << " -o <dir> [options]" << std::endl << std::endl;
+      std::cerr << options << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl << std::endl;
+    std::cerr << options << std::endl;
+    return 1;
+  }
+
+  try {
+    boost::filesystem::create_directories(outputDir);
+    std::string config = WriteSyntheticModel(model, outputDir);
+    std::cerr << "Wrote " << config << std::endl;
+
+    if (corpus.sentences) {
+      corpus.vocab = model.srcVocab;
+      corpus.seed = model.seed;
+      std::string path = outputDir + "/corpus.txt";
+      size_t tokens = WriteSyntheticCorpus(corpus, path);
+      std::cerr << "Wrote " << path << ": " << corpus.sentences << " sentences, "
+                << tokens << " tokens" << std::endl;
+    }
+  } catch (util::Exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,300 @@
+#include "bench/synthetic_model.h"
+
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <fstream>
+
+#include "cnpy/cnpy.h"
+#include "common/exception.h"
+
+namespace amunmt {
+
+namespace {
+
+class NpzWriter {
+  public:
+    NpzWriter(const std::string& path, unsigned seed)
+      : path_(path), gen_(seed), first_(true)
+    {}
+
+    // matrix with entries uniform in +-1/sqrt(rows), which keeps activations
+    // in a realistic range whatever the size of the model
+    void Random(const std::string& key, unsigned rows, unsigned cols) {
+      std::uniform_real_distribution<float> dist(-1.0f / std::sqrt(float(rows)),
+                                                  1.0f / std::sqrt(float(rows)));
+      std::vector<float> data(size_t(rows) * cols);
+      for (auto& value : data) {
+        value = dist(gen_);
+      }
+      Save(key, data, {rows, cols});
+    }
+
+    void RandomVector(const std::string& key, unsigned size) {
+      std::uniform_real_distribution<float> dist(-0.1f, 0.1f);
+      std::vector<float> data(size);
+      for (auto& value : data) {
+        value = dist(gen_);
+      }
+      Save(key, data, {size});
+    }
+
+    void Constant(const std::string& key, unsigned size, float value) {
+      Save(key, std::vector<float>(size, value), {size});
+    }
+
+  private:
+    void Save(const std::string& key, const std::vector<float>& data,
+              const std::vector<unsigned>& shape) {
+      cnpy::npz_save(path_, key, data.data(), shape.data(), shape.size(), first_ ? "w" : "a");
+      first_ = false;
+    }
+
+    std::string path_;
+    std::mt19937 gen_;
+    bool first_;
+};
+
+// layer normalization scale and bias for a layer of the given size
+void LayerNorm(NpzWriter& npz, const std::string& scale, const std::string& bias, unsigned size) {
+  npz.Constant(scale, size, 1.0f);
+  if (!bias.empty()) {
+    npz.Constant(bias, size, 0.0f);
+  }
+}
+
+void WriteDl4mt(NpzWriter& npz, const SyntheticModel& m) {
+  unsigned E = m.dimEmb, H = m.dimState, C = 2 * m.dimState;
+
+  for (std::string prefix : {"encoder_", "encoder_r_"}) {
+    npz.Random(prefix + "W", E, 2 * H);
+    npz.RandomVector(prefix + "b", 2 * H);
+    npz.Random(prefix + "U", H, 2 * H);
+    npz.Random(prefix + "Wx", E, H);
+    npz.RandomVector(prefix + "bx", H);
+    npz.Random(prefix + "Ux", H, H);
+    if (m.layerNorm) {
+      LayerNorm(npz, prefix + "gamma1", "", 3 * H);
+      LayerNorm(npz, prefix + "gamma2", "", 3 * H);
+    }
+  }
+
+  npz.Random("ff_state_W", C, H);
+  npz.RandomVector("ff_state_b", H);
+
+  npz.Random("decoder_W", E, 2 * H);
+  npz.RandomVector("decoder_b", 2 * H);
+  npz.Random("decoder_U", H, 2 * H);
+  npz.Random("decoder_Wx", E, H);
+  npz.RandomVector("decoder_bx", H);
+  npz.Random("decoder_Ux", H, H);
+
+  npz.Random("decoder_Wc", C, 2 * H);
+  npz.RandomVector("decoder_b_nl", 2 * H);
+  npz.Random("decoder_U_nl", H, 2 * H);
+  npz.Random("decoder_Wcx", C, H);
+  npz.RandomVector("decoder_bx_nl", H);
+  npz.Random("decoder_Ux_nl", H, H);
+
+  npz.Random("decoder_U_att", C, 1);
+  npz.Random("decoder_W_comb_att", H, C);
+  npz.RandomVector("decoder_b_att", C);
+  npz.Random("decoder_Wc_att", C, C);
+  npz.RandomVector("decoder_c_tt", 1);
+
+  npz.Random("ff_logit_lstm_W", H, E);
+  npz.RandomVector("ff_logit_lstm_b", E);
+  npz.Random("ff_logit_prev_W", E, E);
+  npz.RandomVector("ff_logit_prev_b", E);
+  npz.Random("ff_logit_ctx_W", C, E);
+  npz.RandomVector("ff_logit_ctx_b", E);
+
+  if (m.layerNorm) {
+    LayerNorm(npz, "ff_state_gamma", "", H);
+    LayerNorm(npz, "decoder_cell1_gamma1", "", 3 * H);
+    LayerNorm(npz, "decoder_cell1_gamma2", "", 3 * H);
+    LayerNorm(npz, "decoder_cell2_gamma1", "", 3 * H);
+    LayerNorm(npz, "decoder_cell2_gamma2", "", 3 * H);
+    LayerNorm(npz, "decoder_att_gamma1", "", C);
+    LayerNorm(npz, "decoder_att_gamma2", "", C);
+    LayerNorm(npz, "ff_logit_l1_gamma0", "", E);
+    LayerNorm(npz, "ff_logit_l1_gamma1", "", E);
+    LayerNorm(npz, "ff_logit_l1_gamma2", "", E);
+  }
+}
+
+void WriteNematusGRU(NpzWriter& npz, const std::string& prefix, unsigned in, unsigned H,
+                     bool layerNorm) {
+  npz.Random(prefix + "W", in, 2 * H);
+  npz.RandomVector(prefix + "b", 2 * H);
+  npz.Random(prefix + "U", H, 2 * H);
+  npz.Random(prefix + "Wx", in, H);
+  npz.RandomVector(prefix + "bx", H);
+  npz.Random(prefix + "Ux", H, H);
+  if (layerNorm) {
+    LayerNorm(npz, prefix + "W_lns", prefix + "W_lnb", 2 * H);
+    LayerNorm(npz, prefix + "Wx_lns", prefix + "Wx_lnb", H);
+    LayerNorm(npz, prefix + "U_lns", prefix + "U_lnb", 2 * H);
+    LayerNorm(npz, prefix + "Ux_lns", prefix + "Ux_lnb", H);
+  }
+}
+
+void WriteNematusTransition(NpzWriter& npz, const std::string& prefix, const std::string& infix,
+                            unsigned depth, unsigned H, bool layerNorm) {
+  for (unsigned i = 1; i <= depth; ++i) {
+    std::string suffix = infix + "_drt_" + std::to_string(i);
+    npz.Random(prefix + "U" + suffix, H, 2 * H);
+    npz.Random(prefix + "Ux" + suffix, H, H);
+    npz.RandomVector(prefix + "b" + suffix, 2 * H);
+    npz.RandomVector(prefix + "bx" + suffix, H);
+    if (layerNorm) {
+      LayerNorm(npz, prefix + "U" + suffix + "_lns", prefix + "U" + suffix + "_lnb", 2 * H);
+      LayerNorm(npz, prefix + "Ux" + suffix + "_lns", prefix + "Ux" + suffix + "_lnb", H);
+    }
+  }
+}
+
+void WriteNematus2(NpzWriter& npz, const SyntheticModel& m) {
+  unsigned E = m.dimEmb, H = m.dimState, C = 2 * m.dimState;
+
+  WriteNematusGRU(npz, "encoder_", E, H, m.layerNorm);
+  WriteNematusGRU(npz, "encoder_r_", E, H, m.layerNorm);
+  WriteNematusTransition(npz, "encoder_", "", m.encTransitionDepth, H, m.layerNorm);
+  WriteNematusTransition(npz, "encoder_r_", "", m.encTransitionDepth, H, m.layerNorm);
+
+  npz.Random("ff_state_W", C, H);
+  npz.RandomVector("ff_state_b", H);
+
+  WriteNematusGRU(npz, "decoder_", E, H, m.layerNorm);
+
+  npz.Random("decoder_Wc", C, 2 * H);
+  npz.Random("decoder_U_nl", H, 2 * H);
+  npz.RandomVector("decoder_b_nl", 2 * H);
+  npz.Random("decoder_Wcx", C, H);
+  npz.Random("decoder_Ux_nl", H, H);
+  npz.RandomVector("decoder_bx_nl", H);
+  WriteNematusTransition(npz, "decoder_", "_nl", m.decTransitionDepth, H, m.layerNorm);
+
+  npz.Random("decoder_U_att", C, 1);
+  npz.Random("decoder_W_comb_att", H, C);
+  npz.RandomVector("decoder_b_att", C);
+  npz.Random("decoder_Wc_att", C, C);
+  npz.RandomVector("decoder_c_tt", 1);
+
+  npz.Random("ff_logit_lstm_W", H, E);
+  npz.RandomVector("ff_logit_lstm_b", E);
+  npz.Random("ff_logit_prev_W", E, E);
+  npz.RandomVector("ff_logit_prev_b", E);
+  npz.Random("ff_logit_ctx_W", C, E);
+  npz.RandomVector("ff_logit_ctx_b", E);
+
+  if (m.layerNorm) {
+    LayerNorm(npz, "ff_state_ln_s", "ff_state_ln_b", H);
+    LayerNorm(npz, "decoder_Wc_lns", "decoder_Wc_lnb", 2 * H);
+    LayerNorm(npz, "decoder_Wcx_lns", "decoder_Wcx_lnb", H);
+    LayerNorm(npz, "decoder_U_nl_lns", "decoder_U_nl_lnb", 2 * H);
+    LayerNorm(npz, "decoder_Ux_nl_lns", "decoder_Ux_nl_lnb", H);
+    LayerNorm(npz, "decoder_Wc_att_lns", "decoder_Wc_att_lnb", C);
+    LayerNorm(npz, "decoder_W_comb_att_lns", "decoder_W_comb_att_lnb", C);
+    LayerNorm(npz, "ff_logit_lstm_ln_s", "ff_logit_lstm_ln_b", E);
+    LayerNorm(npz, "ff_logit_prev_ln_s", "ff_logit_prev_ln_b", E);
+    LayerNorm(npz, "ff_logit_ctx_ln_s", "ff_logit_ctx_ln_b", E);
+  }
+}
+
+}
+
+void WriteSyntheticWeights(const SyntheticModel& m, const std::string& path) {
+  amunmt_UTIL_THROW_IF2(m.type != "nematus" && m.type != "nematus2",
+                        "Unknown synthetic model type: " << m.type);
+  amunmt_UTIL_THROW_IF2(m.type == "nematus" && (m.encTransitionDepth || m.decTransitionDepth),
+                        "Deep transition needs a nematus2 model");
+
+  NpzWriter npz(path, m.seed);
+  npz.Random("Wemb", m.srcVocab, m.dimEmb);
+  npz.Random("Wemb_dec", m.trgVocab, m.dimEmb);
+
+  if (m.type == "nematus2") {
+    WriteNematus2(npz, m);
+  } else {
+    WriteDl4mt(npz, m);
+  }
+
+  if (!m.tiedEmbeddings) {
+    npz.Random("ff_logit_W", m.dimEmb, m.trgVocab);
+  }
+  npz.RandomVector("ff_logit_b", m.trgVocab);
+}
+
+void WriteSyntheticVocab(unsigned size, const std::string& path) {
+  std::ofstream out(path);
+  out << "\"</s>\": 0\n\"<unk>\": 1\n";
+  for (unsigned i = 2; i < size; ++i) {
+    out << "\"w" << i << "\": " << i << "\n";
+  }
+  amunmt_UTIL_THROW_IF2(!out, "Could not write vocabulary to " << path);
+}
+
+size_t WriteSyntheticCorpus(const SyntheticCorpus& c, const std::string& path) {
+  amunmt_UTIL_THROW_IF2(c.vocab < 3, "Vocabulary of a synthetic corpus needs at least 3 words");
+  amunmt_UTIL_THROW_IF2(c.minLength < 1 || c.minLength > c.maxLength,
+                        "Invalid sentence length range " << c.minLength << "-" << c.maxLength);
+
+  std::mt19937 gen(c.seed);
+  std::uniform_int_distribution<unsigned> words(2, c.vocab - 1);
+  std::uniform_int_distribution<unsigned> uniform(c.minLength, c.maxLength);
+  std::normal_distribution<float> normal(c.meanLength, c.stddevLength);
+
+  // parameters of the underlying normal distribution for the requested mean and deviation
+  float variance = std::log(1.0f + (c.stddevLength * c.stddevLength) / (c.meanLength * c.meanLength));
+  std::lognormal_distribution<float> lognormal(std::log(c.meanLength) - variance / 2, std::sqrt(variance));
+
+  auto length = [&]() -> unsigned {
+    float len;
+    if (c.distribution == "uniform") {
+      return uniform(gen);
+    } else if (c.distribution == "normal") {
+      len = normal(gen);
+    } else if (c.distribution == "lognormal") {
+      len = lognormal(gen);
+    } else {
+      amunmt_UTIL_THROW2("Unknown length distribution: " << c.distribution);
+    }
+    return std::min<float>(std::max<float>(std::round(len), c.minLength), c.maxLength);
+  };
+
+  std::ofstream out(path);
+  size_t tokens = 0;
+  for (unsigned i = 0; i < c.sentences; ++i) {
+    unsigned len = length();
+    for (unsigned j = 0; j < len; ++j) {
+      out << (j ? " w" : "w") << words(gen);
+    }
+    out << "\n";
+    tokens += len;
+  }
+  amunmt_UTIL_THROW_IF2(!out, "Could not write corpus to " << path);
+  return tokens;
+}
+
+std::string WriteSyntheticModel(const SyntheticModel& m, const std::string& dir) {
+  WriteSyntheticWeights(m, dir + "/model.npz");
+  WriteSyntheticVocab(m.srcVocab, dir + "/vocab.src.yml");
+  WriteSyntheticVocab(m.trgVocab, dir + "/vocab.trg.yml");
+
+  std::string configPath = dir + "/config.yml";
+  std::ofstream config(configPath);
+  config << "scorers:\n"
+         << "  F0:\n"
+         << "    type: " << m.type << "\n"
+         << "    path: " << dir << "/model.npz\n"
+         << "weights:\n"
+         << "  F0: 1.0\n"
+         << "source-vocab: " << dir << "/vocab.src.yml\n"
+         << "target-vocab: " << dir << "/vocab.trg.yml\n";
+  amunmt_UTIL_THROW_IF2(!config, "Could not write config to " << configPath);
+  return configPath;
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+
+namespace amunmt {
+
+// Description of a model with random weights, used to benchmark the decoder
+// without downloading a trained model. The weights have the names and shapes
+// of a Nematus/dl4mt model, so they are loaded by the regular CPU loaders.
+struct SyntheticModel {
+  // "nematus" for dl4mt style models, "nematus2" for newer Nematus models
+  // with layer normalization biases and deep transition
+  std::string type = "nematus";
+
+  unsigned srcVocab = 1000;
+  unsigned trgVocab = 1000;
+  unsigned dimEmb = 256;
+  unsigned dimState = 512;
+
+  bool layerNorm = false;
+
+  // number of transition blocks after the encoder and second decoder GRU,
+  // only used by "nematus2" models
+  unsigned encTransitionDepth = 0;
+  unsigned decTransitionDepth = 0;
+
+  // output layer shares its weights with the target embeddings
+  bool tiedEmbeddings = false;
+
+  unsigned seed = 1234;
+};
+
+// Description of a corpus of random sentences over the words of a synthetic
+// vocabulary, with a controlled distribution of sentence lengths.
+struct SyntheticCorpus {
+  unsigned sentences = 1000;
+  unsigned vocab = 1000;
+
+  // "uniform" between minLength and maxLength, or "normal"/"lognormal" with
+  // the given mean and standard deviation, clipped to [minLength, maxLength]
+  std::string distribution = "normal";
+  float meanLength = 20;
+  float stddevLength = 10;
+  unsigned minLength = 1;
+  unsigned maxLength = 100;
+
+  unsigned seed = 1234;
+};
+
+// writes the weights of the model to an .npz file
+void WriteSyntheticWeights(const SyntheticModel& model, const std::string& path);
+
+// writes a vocabulary of the given size: </s>, <unk>, w2, w3, ...
+void WriteSyntheticVocab(unsigned size, const std::string& path);
+
+// writes one sentence per line, returns the number of tokens written
+size_t WriteSyntheticCorpus(const SyntheticCorpus& corpus, const std::string& path);
+
+// writes model.npz, vocab.src.yml, vocab.trg.yml and config.yml into an
+// existing directory. Returns the path of the config file
+std::string WriteSyntheticModel(const SyntheticModel& model, const std::string& dir);
+
+}
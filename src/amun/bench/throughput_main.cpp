@@ -0,0 +1,291 @@
+// End-to-end throughput of the amun executable on a corpus. amun runs as a
+// child process exactly as it would in production; every line written to its
+// standard input is timestamped and matched with the corresponding output
+// line to measure per-sentence latency:
+//
+//   amun_throughput --amun ./amun -c config.yml -i corpus.txt [--rate 50]
+//                   [-- <further amun options>]
+//
+// One maxi-batch of copies of the first sentence is translated before
+// measuring, so model loading is reported separately and not counted in
+// latency or throughput.
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+void WriteLine(int fd, const std::string& line) {
+  std::string data = line + "\n";
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "Error: amun stopped reading its input: " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    written += n;
+  }
+}
+
+bool ReadLine(FILE* in, std::string& line) {
+  line.clear();
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (c == '\n') {
+      return true;
+    }
+    line += char(c);
+  }
+  return !line.empty();
+}
+
+size_t CountTokens(const std::string& line) {
+  size_t tokens = 0;
+  bool inToken = false;
+  for (char c : line) {
+    if (c == ' ' || c == '\t') {
+      inToken = false;
+    } else if (!inToken) {
+      inToken = true;
+      ++tokens;
+    }
+  }
+  return tokens;
+}
+
+double Seconds(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// runs args in the child process of a fork
+void Exec(std::vector<std::string> args) {
+  std::vector<char*> argv;
+  for (auto& arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+  execv(argv[0], argv.data());
+  perror(argv[0]);
+  _exit(127);
+}
+
+// the maxi-batch size amun runs with, from its --dump-config output; amun
+// only starts translating once it read that many sentences or its input ended
+unsigned MaxiBatchSize(std::vector<std::string> args) {
+  args.push_back("--dump-config");
+
+  int fromAmun[2];
+  if (pipe(fromAmun)) {
+    perror("pipe");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    dup2(fromAmun[1], STDOUT_FILENO);
+    close(fromAmun[0]); close(fromAmun[1]);
+    Exec(args);
+  }
+  close(fromAmun[1]);
+
+  const std::string key = "maxi-batch: ";
+  unsigned size = 1;
+  FILE* output = fdopen(fromAmun[0], "r");
+  std::string line;
+  while (ReadLine(output, line)) {
+    if (line.compare(0, key.size(), key) == 0) {
+      size = std::max(1, std::atoi(line.c_str() + key.size()));
+    }
+  }
+  fclose(output);
+  waitpid(pid, nullptr, 0);
+  return size;
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = std::min(sorted.size() - 1, size_t(p / 100.0 * sorted.size()));
+  return sorted[i];
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  std::string amun, config, inputPath;
+  double rate;
+  std::vector<std::string> amunArgs;
+
+  po::options_description options("Throughput harness options");
+  options.add_options()
+    ("amun", po::value(&amun)->default_value("./amun"),
+     "Path to the amun executable")
+    ("config,c", po::value(&config)->required(),
+     "amun configuration file")
+    ("input-file,i", po::value(&inputPath)->required(),
+     "Corpus to translate, one sentence per line")
+    ("rate", po::value(&rate)->default_value(0),
+     "Sentences per second sent to amun, 0 sends them as fast as amun reads them")
+    ("amun-args", po::value(&amunArgs)->multitoken(),
+     "Further options for amun, also accepted after --")
+    ("help,h", po::value<bool>()->zero_tokens()->default_value(false),
+     "Print this help message and exit")
+  ;
+  po::positional_options_description positional;
+  positional.add("amun-args", -1);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(options).positional(positional).run(), vm);
+    if (vm["help"].as<bool>()) {
+      std::cerr << "Usage: " << argv[0] << " -c <config> -i <corpus> [options] [-- amun options]"
+                << std::endl << std::endl << options << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl << std::endl << options << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> corpus;
+  size_t srcTokens = 0;
+  {
+    std::ifstream in(inputPath);
+    std::string line;
+    while (std::getline(in, line)) {
+      srcTokens += CountTokens(line);
+      corpus.push_back(line);
+    }
+  }
+  if (corpus.empty()) {
+    std::cerr << "Error: " << inputPath << " is empty" << std::endl;
+    return 1;
+  }
+
+  // output has to reach the pipe as soon as a sentence is translated
+  std::vector<std::string> args = {amun, "-c", config, "--line-buffered",
+                                   "--log-info", "off", "--log-progress", "off"};
+  args.insert(args.end(), amunArgs.begin(), amunArgs.end());
+  const unsigned warmUp = MaxiBatchSize(args);
+
+  int toAmun[2], fromAmun[2];
+  if (pipe(toAmun) || pipe(fromAmun)) {
+    perror("pipe");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  Clock::time_point launched = Clock::now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return 1;
+  }
+  if (pid == 0) {
+    dup2(toAmun[0], STDIN_FILENO);
+    dup2(fromAmun[1], STDOUT_FILENO);
+    close(toAmun[0]); close(toAmun[1]);
+    close(fromAmun[0]); close(fromAmun[1]);
+    Exec(args);
+  }
+  close(toAmun[0]);
+  close(fromAmun[1]);
+  FILE* output = fdopen(fromAmun[0], "r");
+
+  std::string line;
+  for (unsigned i = 0; i < warmUp; ++i) {
+    WriteLine(toAmun[1], corpus[0]);
+  }
+  for (unsigned i = 0; i < warmUp; ++i) {
+    if (!ReadLine(output, line)) {
+      std::cerr << "Error: amun exited before translating the first sentence" << std::endl;
+      return 1;
+    }
+  }
+  double loadTime = Seconds(launched, Clock::now());
+
+  // written by the writer thread, read once the translation comes back
+  std::unique_ptr<std::atomic<Clock::rep>[]> sent(new std::atomic<Clock::rep>[corpus.size()]);
+  Clock::time_point start = Clock::now();
+
+  std::thread writer([&] {
+    for (size_t i = 0; i < corpus.size(); ++i) {
+      if (rate > 0) {
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                                                std::chrono::duration<double>(i / rate)));
+      }
+      sent[i] = Clock::now().time_since_epoch().count();
+      WriteLine(toAmun[1], corpus[i]);
+    }
+    close(toAmun[1]);
+  });
+
+  std::vector<double> latencies;
+  size_t trgTokens = 0;
+  Clock::time_point end = start;
+  while (latencies.size() < corpus.size() && ReadLine(output, line)) {
+    end = Clock::now();
+    Clock::time_point sentTime{Clock::duration(sent[latencies.size()].load())};
+    latencies.push_back(Seconds(sentTime, end));
+    trgTokens += CountTokens(line);
+  }
+
+  writer.join();
+  fclose(output);
+
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+
+  if (latencies.size() < corpus.size()) {
+    std::cerr << "Error: amun returned " << latencies.size() << " translations for "
+              << corpus.size() << " sentences" << std::endl;
+    return 1;
+  }
+
+  double wall = Seconds(start, end);
+  std::sort(latencies.begin(), latencies.end());
+
+  printf("sentences       %zu\n", corpus.size());
+  printf("source tokens   %zu\n", srcTokens);
+  printf("target tokens   %zu\n", trgTokens);
+  printf("load time       %.3f s\n", loadTime);
+  printf("wall time       %.3f s\n", wall);
+  printf("sentences/s     %.2f\n", corpus.size() / wall);
+  printf("source tok/s    %.1f\n", srcTokens / wall);
+  printf("target tok/s    %.1f\n", trgTokens / wall);
+  printf("latency p50     %.2f ms\n", 1000 * Percentile(latencies, 50));
+  printf("latency p95     %.2f ms\n", 1000 * Percentile(latencies, 95));
+  printf("latency p99     %.2f ms\n", 1000 * Percentile(latencies, 99));
+  printf("latency max     %.2f ms\n", 1000 * latencies.back());
+  printf("peak RSS        %.1f MB\n", usage.ru_maxrss / 1024.0);
+
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
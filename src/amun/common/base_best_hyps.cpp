@@ -1,5 +1,6 @@
 #include "base_best_hyps.h"
 #include "god.h"
+#include "exception.h"
 
 using namespace std;
 
@@ -7,11 +8,33 @@ namespace amunmt {
 
 BestHypsBase::BestHypsBase(const God &god)
 : god_(god),
-  forbidUNK_(!god.Get<bool>("allow-unk")),
-  isInputFiltered_(god.Get<std::vector<std::string>>("softmax-filter").size()),
-  returnAttentionWeights_(god.Get<bool>("return-alignment") || god.Get<bool>("return-soft-alignment") || god.Get<bool>("return-nematus-alignment")),
-  weights_(god.GetScorerWeights())
+  forbidUNK_(!god.GetOptions().allowUnk),
+  isInputFiltered_(god.GetOptions().softmaxFilter),
+  returnAttentionWeights_(god.GetOptions().ReturnAttentionWeights()),
+  weights_(god.GetScorerWeights()),
+  sampler_(god.GetOptions())
 {}
 
+void BestHypsBase::CalcForced(
+    const Beam& prevHyps,
+    const std::vector<ScorerPtr>& scorers,
+    const Words& filterIndices,
+    const Words& words,
+    Beam& beam,
+    const std::vector<unsigned>& rows)
+{
+  amunmt_UTIL_THROW2("Forced decoding is not supported on this device");
+}
+
+void BestHypsBase::CalcSample(
+    const std::vector<ScorerPtr>& scorers,
+    const Words& filterIndices,
+    std::vector<SampleRandom>& randoms,
+    Words& words,
+    std::vector<float>& costs)
+{
+  amunmt_UTIL_THROW2("Sampling is not supported on this device");
+}
+
 }
 
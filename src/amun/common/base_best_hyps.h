@@ -6,6 +6,7 @@
 
 #include "common/types.h"
 #include "scorer.h"
+#include "common/sampling.h"
 
 namespace amunmt {
 
@@ -25,12 +26,34 @@ class BestHypsBase
         std::vector<Beam>& beams,
         std::vector<unsigned>& beamSizes) = 0;
 
+    // forced decoding: extends prevHyps[i] with words[i] instead of searching,
+    // for target prefixes and rescoring; the hypotheses always get the cost
+    // breakdown by scorer. prevHyps[i] continues row rows[i] of the scorers'
+    // output, row i if rows is empty.
+    virtual void CalcForced(
+        const Beam& prevHyps,
+        const std::vector<ScorerPtr>& scorers,
+        const Words& filterIndices,
+        const Words& words,
+        Beam& beam,
+        const std::vector<unsigned>& rows = std::vector<unsigned>());
+
+    // sampling search, one hypothesis per sentence: draws the next word of
+    // row i of the scorers' output with randoms[i], and its model score
+    virtual void CalcSample(
+        const std::vector<ScorerPtr>& scorers,
+        const Words& filterIndices,
+        std::vector<SampleRandom>& randoms,
+        Words& words,
+        std::vector<float>& costs);
+
   protected:
     const God &god_;
     const bool forbidUNK_;
     const bool isInputFiltered_;
     const bool returnAttentionWeights_;
     const std::map<std::string, float> weights_;
+    Sampler sampler_;
 
 };
 
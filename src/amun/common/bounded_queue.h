@@ -0,0 +1,73 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace amunmt {
+
+// Blocking FIFO queue with a maximum size, used to connect the stages of the
+// input pipeline. Once closed, Push() fails and Pop() drains what is left.
+template <class T>
+class BoundedQueue {
+  public:
+    explicit BoundedQueue(size_t bound)
+      : bound_(bound), closed_(false)
+    {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+
+    // blocks while the queue is full. Returns false if the queue was closed
+    bool Push(T item) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < bound_; });
+        if (closed_) {
+          return false;
+        }
+        items_.push_back(std::move(item));
+      }
+      notEmpty_.notify_one();
+      return true;
+    }
+
+    // blocks while the queue is empty. Returns false once it is closed and empty
+    bool Pop(T& item) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+          return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+      }
+      notFull_.notify_one();
+      return true;
+    }
+
+    void Close() {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        closed_ = true;
+      }
+      notFull_.notify_all();
+      notEmpty_.notify_all();
+    }
+
+    size_t size() const {
+      std::unique_lock<std::mutex> lock(mutex_);
+      return items_.size();
+    }
+
+  private:
+    std::deque<T> items_;
+    const size_t bound_;
+    bool closed_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+};
+
+}
@@ -110,9 +110,92 @@ void Validate(const YAML::Node& config) {
   //amunmt_UTIL_THROW_IF2(config["cpu-threads"].as<int>() > 0 && config["batch-size"].as<int>() > 1,
   //              "Different number of models and weights in config file");
 
+  amunmt_UTIL_THROW_IF2(config["preprocess-threads"].as<unsigned>() == 0,
+                "preprocess-threads must be at least 1");
+
   amunmt_UTIL_THROW_IF2(config["maxi-batch"].as<int>() < config["mini-batch"].as<int>(),
                 "maxi-batch (" << config["maxi-batch"].as<int>()
                 << ") < mini-batch (" << config["mini-batch"].as<int>() << ")");
+
+  amunmt_UTIL_THROW_IF2(config["workers"].as<unsigned>() == 0,
+                "workers must be at least 1");
+
+  amunmt_UTIL_THROW_IF2(config["workers"].as<unsigned>() > 1 && config["server"].as<bool>(),
+                "--workers is not supported with --server");
+
+  amunmt_UTIL_THROW_IF2(config["workers"].as<unsigned>() > 1 && config["reload-on-sighup"].as<bool>(),
+                "--reload-on-sighup is not supported with --workers");
+
+  if (config["corpus-dir"]) {
+    amunmt_UTIL_THROW_IF2(!config["input-file"], "--corpus-dir needs an --input-file");
+    amunmt_UTIL_THROW_IF2(config["server"].as<bool>() || config["workers"].as<unsigned>() > 1,
+                  "--corpus-dir is not supported with --server or --workers");
+    amunmt_UTIL_THROW_IF2(config["corpus-shard-size"].as<unsigned>() == 0,
+                  "corpus-shard-size must be at least 1");
+  }
+
+  if (config["rescore"]) {
+    amunmt_UTIL_THROW_IF2(config["server"].as<bool>() || config["workers"].as<unsigned>() > 1
+                  || config["corpus-dir"] || config["sampling"].as<bool>(),
+                  "--rescore is not supported with --server, --workers, --corpus-dir or --sampling");
+
+    // only the CPU best-hyps decode forced
+#ifdef HAS_CPU
+    amunmt_UTIL_THROW_IF2(config["cpu-threads"].as<unsigned>() == 0, "--rescore needs cpu-threads to decode");
+#else
+    amunmt_UTIL_THROW2("--rescore needs cpu-threads to decode");
+#endif
+#ifdef CUDA
+    amunmt_UTIL_THROW_IF2(config["gpu-threads"].as<unsigned>() > 0, "--rescore decodes on the CPU only, set --gpu-threads 0");
+#endif
+#ifdef HAS_FPGA
+    amunmt_UTIL_THROW_IF2(config["fpga-threads"].as<unsigned>() > 0, "--rescore decodes on the CPU only, set --fpga-threads 0");
+#endif
+  }
+
+  if (config["sampling"].as<bool>()) {
+    amunmt_UTIL_THROW_IF2(config["n-best"].as<bool>(), "--sampling gives one translation, no n-best list");
+    amunmt_UTIL_THROW_IF2(config["return-alignment"].as<bool>() || config["return-soft-alignment"].as<bool>()
+                  || config["return-nematus-alignment"].as<bool>(),
+                  "--sampling does not return alignments");
+    amunmt_UTIL_THROW_IF2(config["sampling-top-p"].as<float>() <= 0 || config["sampling-top-p"].as<float>() > 1,
+                  "sampling-top-p must be in (0, 1]");
+    amunmt_UTIL_THROW_IF2(config["sampling-temperature"].as<float>() <= 0,
+                  "sampling-temperature must be positive");
+
+    // only the CPU best-hyps draw samples
+#ifdef HAS_CPU
+    amunmt_UTIL_THROW_IF2(config["cpu-threads"].as<unsigned>() == 0, "--sampling needs cpu-threads to decode");
+#else
+    amunmt_UTIL_THROW2("--sampling needs cpu-threads to decode");
+#endif
+#ifdef CUDA
+    amunmt_UTIL_THROW_IF2(config["gpu-threads"].as<unsigned>() > 0, "--sampling decodes on the CPU only, set --gpu-threads 0");
+#endif
+#ifdef HAS_FPGA
+    amunmt_UTIL_THROW_IF2(config["fpga-threads"].as<unsigned>() > 0, "--sampling decodes on the CPU only, set --fpga-threads 0");
+#endif
+  }
+
+#ifdef HAS_CPU
+  std::string numaWeights = config["numa-weights"].as<std::string>();
+  amunmt_UTIL_THROW_IF2(numaWeights != "shared" && numaWeights != "replicate" && numaWeights != "interleave",
+                "numa-weights must be shared, replicate or interleave, not " << numaWeights);
+
+  amunmt_UTIL_THROW_IF2(config["encoder-threads"].as<unsigned>() > 0 && config["cpu-threads"].as<unsigned>() == 0,
+                "encoder-threads need cpu-threads to decode");
+#endif
+
+  // the workers are forked after the models are loaded, which GPU and FPGA
+  // contexts do not survive
+#ifdef CUDA
+  amunmt_UTIL_THROW_IF2(config["workers"].as<unsigned>() > 1 && config["gpu-threads"].as<unsigned>() > 0,
+                "--workers only works on the CPU, set --gpu-threads 0");
+#endif
+#ifdef HAS_FPGA
+  amunmt_UTIL_THROW_IF2(config["workers"].as<unsigned>() > 1 && config["fpga-threads"].as<unsigned>() > 0,
+                "--workers only works on the CPU, set --fpga-threads 0");
+#endif
 }
 
 void OutputRec(const YAML::Node node, YAML::Emitter& out) {
@@ -182,6 +265,30 @@ void Config::AddOptions(unsigned argc, char** argv) {
      "Configuration file")
     ("input-file,i", po::value(&inputPath),
       "Take input from a file instead of stdin")
+    ("server", po::value<bool>()->zero_tokens()->default_value(false),
+     "Serve translations on a local socket instead of translating the input: "
+     "one request per line, plain text or {\"id\": ..., \"text\": ...} JSON")
+    ("port", po::value<unsigned>()->default_value(8080),
+     "TCP port on 127.0.0.1 for --server")
+    ("socket", po::value<std::string>(),
+     "Unix-domain socket for --server, instead of a TCP port")
+    ("max-batch-wait", po::value<unsigned>()->default_value(10),
+     "Maximum time in ms a --server request waits for others to fill its mini-batch")
+    ("workers", po::value<unsigned>()->default_value(1),
+     "Load the model once and translate the input in arg forked processes sharing it, "
+     "output is merged in input order. CPU only")
+    ("corpus-dir", po::value<std::string>(),
+     "Translate --input-file out of core with arg as work directory: the input is indexed and "
+     "translated in length-sorted shards, which are merged at the end. Resumes an interrupted job")
+    ("corpus-shard-size", po::value<unsigned>()->default_value(100000),
+     "Lines per shard of --corpus-dir, the unit of work lost when a job is interrupted")
+    ("rescore", po::value<std::string>(),
+     "Instead of translating, score the candidates of the Moses n-best list arg "
+     "(line ||| target ...) against the lines of the input by forced decoding; "
+     "writes the list with the score of every scorer added to the features. CPU only")
+    ("reload-on-sighup", po::value<bool>()->zero_tokens()->default_value(false),
+     "Load the model files again in the background on SIGHUP and swap them in once warmed up: "
+     "new mini-batches use the new models, the ones in flight finish with the old")
     ("model,m", po::value(&modelPaths)->multitoken(),
      "Overwrite scorer section in config file with these models. "
      "Assumes models of type Nematus and assigns model names F0, F1, ...")
@@ -212,6 +319,14 @@ void Config::AddOptions(unsigned argc, char** argv) {
      ("cpu-threads", po::value<unsigned>()->default_value(1),
       "Number of threads on the CPU.")
   #endif
+    ("pin-threads", po::value<bool>()->zero_tokens()->default_value(false),
+     "Pin each CPU thread to a core. Threads are split into contiguous groups, one per NUMA node")
+    ("numa-weights", po::value<std::string>()->default_value("shared"),
+     "Placement of the CPU model weights on NUMA machines: shared (one copy where it was loaded), "
+     "replicate (one copy per node, threads use the local one) or interleave (one copy spread over all nodes)")
+    ("encoder-threads", po::value<unsigned>()->default_value(0),
+     "Number of CPU threads that only encode, handing the encoded mini-batches to the cpu-threads, "
+     "which then only decode. 0: every thread encodes its own mini-batches")
 #endif
 
 #ifdef HAS_FPGA
@@ -223,6 +338,11 @@ void Config::AddOptions(unsigned argc, char** argv) {
         "Implicitly sets minimal number of threads to number of devices.")
 #endif
 
+    ("preprocess-threads", po::value<unsigned>()->default_value(1),
+     "Number of threads preprocessing the input (tokenization, BPE, vocabulary lookup).")
+    ("cache-size", po::value<unsigned>()->default_value(0),
+     "Keep the translations of up to arg sentences and answer exact repeats from this cache; "
+     "repeats within a maxi-batch are decoded once. 0 disables")
     ("mini-batch", po::value<unsigned>()->default_value(1),
      "Number of sentences in mini batch.")
     ("maxi-batch", po::value<unsigned>()->default_value(1),
@@ -235,6 +355,12 @@ void Config::AddOptions(unsigned argc, char** argv) {
      "Load scorer weights from this file")
     ("wipo", po::value<bool>()->zero_tokens()->default_value(false),
      "Use WIPO specific n-best-list format and non-buffering single-threading")
+    ("line-buffered", po::value<bool>()->zero_tokens()->default_value(false),
+     "Flush the output after every translation, for interactive use")
+    ("stable-prefix", po::value<bool>()->zero_tokens()->default_value(false),
+     "While a sentence is decoded, output the words all hypotheses in the beam agree on: "
+     "as lines 'PARTIAL: ...' before the translation of the next sentence of the output, "
+     "and as {\"id\": ..., \"partial\": ...} to JSON requests of --server")
     ("return-alignment", po::value<bool>()->zero_tokens()->default_value(false),
      "If true, return alignment.")
     ("return-soft-alignment", po::value<bool>()->zero_tokens()->default_value(false),
@@ -249,6 +375,23 @@ void Config::AddOptions(unsigned argc, char** argv) {
      "Print this help message and exit")
     ("log-progress",po::value<std::string>()->default_value("info")->implicit_value("info"),
      "Log level for progress logging to stderr (trace - debug - info - warn - err(or) - critical - off).")
+    ("profile", po::value<std::string>(),
+     "Collect per-stage timings, decoder step counts and matrix product statistics "
+     "and write them as JSON to this file at exit or on SIGUSR1")
+    ("trace", po::value<std::string>(),
+     "Record a timeline of pool tasks, searches, decoder steps and scorer calls "
+     "and write it at exit to this file in Chrome trace-event JSON format")
+    ("metrics-port", po::value<unsigned>()->default_value(0),
+     "Serve metrics in Prometheus text format over HTTP on this port, 0 disables")
+    ("metrics-address", po::value<std::string>()->default_value("127.0.0.1"),
+     "IPv4 address the --metrics-port is bound to, 0.0.0.0 for all interfaces")
+    ("metrics-file", po::value<std::string>(),
+     "Write metrics in Prometheus text format to this file every --metrics-interval seconds and at exit")
+    ("metrics-interval", po::value<unsigned>()->default_value(10),
+     "Seconds between two writes of --metrics-file")
+    ("stats-interval", po::value<unsigned>()->default_value(0),
+     "Log per-sentence latency percentiles (batching, queueing, decoding, total) "
+     "and throughput to the progress logger every arg seconds and at exit, 0 disables")
     ("log-info",po::value<std::string>()->default_value("info")->implicit_value("info"),
      "Log level for informative messages to stderr (trace - debug - info - warn - err(or) - critical - off).")
   ;
@@ -265,6 +408,17 @@ void Config::AddOptions(unsigned argc, char** argv) {
      "Allow generation of UNK")
     ("n-best", po::value<bool>()->zero_tokens()->default_value(false),
      "Output n-best list with n = beam-size")
+    ("sampling", po::value<bool>()->zero_tokens()->default_value(false),
+     "Sample one translation per sentence from the model instead of beam search, "
+     "e.g. for back-translation. CPU only")
+    ("sampling-top-k", po::value<unsigned>()->default_value(0),
+     "Sample from the arg best words only, 0 for the whole vocabulary")
+    ("sampling-top-p", po::value<float>()->default_value(1.0),
+     "Sample from the smallest set of best words with a probability of at least arg")
+    ("sampling-temperature", po::value<float>()->default_value(1.0),
+     "Divide the scores by arg before sampling, lower is closer to greedy search")
+    ("sampling-seed", po::value<unsigned>()->default_value(1234),
+     "Seed of --sampling, combined with the line number of each sentence")
   ;
 
   po::options_description configuration("Configuration meta options");
@@ -310,6 +464,8 @@ void Config::AddOptions(unsigned argc, char** argv) {
 
   // Simple overwrites
   SET_OPTION("n-best", bool);
+  SET_OPTION("line-buffered", bool);
+  SET_OPTION("stable-prefix", bool);
   SET_OPTION("normalize", bool);
   SET_OPTION("wipo", bool);
   SET_OPTION("return-alignment", bool);
@@ -319,6 +475,13 @@ void Config::AddOptions(unsigned argc, char** argv) {
   SET_OPTION("allow-unk", bool);
   SET_OPTION("no-debpe", bool);
   SET_OPTION("beam-size", unsigned);
+  SET_OPTION("sampling", bool);
+  SET_OPTION("sampling-top-k", unsigned);
+  SET_OPTION("sampling-top-p", float);
+  SET_OPTION("sampling-temperature", float);
+  SET_OPTION("sampling-seed", unsigned);
+  SET_OPTION("preprocess-threads", unsigned);
+  SET_OPTION("cache-size", unsigned);
   SET_OPTION("mini-batch", unsigned);
   SET_OPTION("maxi-batch", unsigned);
   SET_OPTION("mini-batch-words", int);
@@ -330,6 +493,9 @@ void Config::AddOptions(unsigned argc, char** argv) {
 #endif
 #ifdef HAS_CPU
   SET_OPTION("cpu-threads", unsigned);
+  SET_OPTION("pin-threads", bool);
+  SET_OPTION("numa-weights", std::string);
+  SET_OPTION("encoder-threads", unsigned);
 #endif
 #ifdef HAS_FPGA
   SET_OPTION("fpga-threads", unsigned);
@@ -339,8 +505,24 @@ void Config::AddOptions(unsigned argc, char** argv) {
   SET_OPTION_NONDEFAULT("load-weights", std::string);
   SET_OPTION("relative-paths", bool);
   SET_OPTION_NONDEFAULT("input-file", std::string);
+  SET_OPTION("server", bool);
+  SET_OPTION("port", unsigned);
+  SET_OPTION_NONDEFAULT("socket", std::string);
+  SET_OPTION("max-batch-wait", unsigned);
+  SET_OPTION("workers", unsigned);
+  SET_OPTION_NONDEFAULT("corpus-dir", std::string);
+  SET_OPTION("corpus-shard-size", unsigned);
+  SET_OPTION_NONDEFAULT("rescore", std::string);
+  SET_OPTION("reload-on-sighup", bool);
   SET_OPTION("log-progress", std::string);
   SET_OPTION("log-info", std::string);
+  SET_OPTION_NONDEFAULT("profile", std::string);
+  SET_OPTION_NONDEFAULT("trace", std::string);
+  SET_OPTION("stats-interval", unsigned);
+  SET_OPTION("metrics-port", unsigned);
+  SET_OPTION("metrics-address", std::string);
+  SET_OPTION_NONDEFAULT("metrics-file", std::string);
+  SET_OPTION("metrics-interval", unsigned);
   // @TODO: Apply complex overwrites
 
   if (Has("load-weights")) {
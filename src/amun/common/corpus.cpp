@@ -0,0 +1,351 @@
+#include "common/corpus.h"
+
+#include <fstream>
+#include <future>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <boost/filesystem.hpp>
+
+#include "common/god.h"
+#include "common/exception.h"
+#include "common/histories.h"
+#include "common/history.h"
+#include "common/logging.h"
+#include "common/printer.h"
+#include "common/sentence.h"
+#include "common/sentences.h"
+#include "common/translation_task.h"
+#include "common/utils.h"
+
+namespace fs = boost::filesystem;
+
+namespace amunmt {
+
+namespace {
+
+// one bucket per source length in words, longer lines share the last one
+const unsigned NUM_BUCKETS = 128;
+
+// files open at once while merging the shards
+const size_t MAX_MERGE = 256;
+
+struct IndexRecord {
+  uint64_t lineNum;
+  uint64_t offset;
+};
+
+// translations as "<line number> <size>\n<translation>\n"
+void WriteRecord(std::ostream& out, uint64_t lineNum, const std::string& output) {
+  out << lineNum << " " << output.size() << "\n";
+  out.write(output.data(), output.size());
+  out << "\n";
+}
+
+class RecordReader {
+  public:
+    RecordReader(const std::string& path)
+      : in_(path, std::ios::binary)
+    {
+      amunmt_UTIL_THROW_IF2(!in_, "Could not open " << path);
+    }
+
+    bool Next() {
+      size_t size;
+      if (!(in_ >> lineNum >> size)) {
+        return false;
+      }
+      in_.get();
+      output.resize(size);
+      in_.read(&output[0], size);
+      in_.get();
+      return bool(in_);
+    }
+
+    uint64_t lineNum;
+    std::string output;
+
+  private:
+    std::ifstream in_;
+};
+
+// merges files of records sorted by line number
+void MergeRecords(const std::vector<std::string>& paths,
+                  const std::function<void(uint64_t, const std::string&)>& write) {
+  std::vector<std::unique_ptr<RecordReader>> readers;
+  typedef std::pair<uint64_t, size_t> Head;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+  for (const std::string& path : paths) {
+    readers.emplace_back(new RecordReader(path));
+    if (readers.back()->Next()) {
+      heads.emplace(readers.back()->lineNum, readers.size() - 1);
+    }
+  }
+
+  while (!heads.empty()) {
+    size_t index = heads.top().second;
+    heads.pop();
+    RecordReader& reader = *readers[index];
+    write(reader.lineNum, reader.output);
+    if (reader.Next()) {
+      heads.emplace(reader.lineNum, index);
+    }
+  }
+}
+
+}
+
+Corpus::Corpus(God &god)
+  : god_(god),
+    inputPath_(god.Get<std::string>("input-file")),
+    dir_(god.Get<std::string>("corpus-dir")),
+    shardSize_(god.Get<unsigned>("corpus-shard-size"))
+{}
+
+void Corpus::Run()
+{
+  BuildIndex();
+  std::vector<Shard> shards = GetShards();
+  Translate(shards);
+  Merge(shards);
+}
+
+std::string Corpus::GetPath(const std::string& name) const
+{
+  return (fs::path(dir_) / name).string();
+}
+
+std::string Corpus::GetShardPath(const Shard& shard) const
+{
+  return GetPath("shard." + std::to_string(shard.bucket) + "." + std::to_string(shard.first / shardSize_));
+}
+
+void Corpus::BuildIndex()
+{
+  fs::create_directories(dir_);
+
+  // resuming is only safe for the same input and shards
+  std::stringstream stamp;
+  stamp << fs::absolute(inputPath_).string() << " " << fs::file_size(inputPath_)
+        << " " << fs::last_write_time(inputPath_) << " " << shardSize_;
+
+  std::string indexPath = GetPath("index");
+  if (fs::exists(indexPath)) {
+    std::ifstream index(indexPath);
+    std::string indexStamp;
+    std::getline(index, indexStamp);
+    amunmt_UTIL_THROW_IF2(indexStamp != stamp.str(),
+                          dir_ << " holds the work of a different input or --corpus-shard-size: " << indexStamp);
+    uint64_t size;
+    while (index >> size) {
+      bucketSizes_.push_back(size);
+    }
+    amunmt_UTIL_THROW_IF2(bucketSizes_.size() != NUM_BUCKETS, "Corrupt index " << indexPath);
+    LOG(info)->info("Resuming from {}", dir_);
+    return;
+  }
+
+  LOG(info)->info("Indexing {} in {}", inputPath_, dir_);
+  std::vector<std::unique_ptr<std::ofstream>> buckets(NUM_BUCKETS);
+  bucketSizes_.assign(NUM_BUCKETS, 0);
+
+  std::ifstream input(inputPath_, std::ios::binary);
+  amunmt_UTIL_THROW_IF2(!input, "Could not open " << inputPath_);
+  std::string line;
+  IndexRecord record = { 0, 0 };
+  while (std::getline(input, line)) {
+    unsigned bucket = std::min(CountWords(line), NUM_BUCKETS) - 1;
+    if (!buckets[bucket]) {
+      buckets[bucket].reset(new std::ofstream(GetPath("bucket." + std::to_string(bucket)), std::ios::binary));
+    }
+    buckets[bucket]->write(reinterpret_cast<const char*>(&record), sizeof(record));
+    ++bucketSizes_[bucket];
+
+    ++record.lineNum;
+    record.offset += line.size() + 1;
+  }
+
+  for (auto& bucket : buckets) {
+    if (bucket) {
+      bucket->close();
+      amunmt_UTIL_THROW_IF2(!*bucket, "Could not write the index to " << dir_);
+    }
+  }
+
+  // the index is complete once it has a name
+  {
+    std::ofstream index(indexPath + ".tmp");
+    index << stamp.str() << "\n";
+    for (uint64_t size : bucketSizes_) {
+      index << size << "\n";
+    }
+    index.close();
+    amunmt_UTIL_THROW_IF2(!index, "Could not write " << indexPath);
+  }
+  fs::rename(indexPath + ".tmp", indexPath);
+  LOG(info)->info("Indexed {} lines", record.lineNum);
+}
+
+std::vector<Corpus::Shard> Corpus::GetShards() const
+{
+  std::vector<Shard> shards;
+  for (unsigned bucket = 0; bucket < bucketSizes_.size(); ++bucket) {
+    for (uint64_t first = 0; first < bucketSizes_[bucket]; first += shardSize_) {
+      shards.push_back({ bucket, first, std::min(shardSize_, bucketSizes_[bucket] - first) });
+    }
+  }
+  return shards;
+}
+
+void Corpus::Translate(const std::vector<Shard>& shards)
+{
+  const Options& options = god_.GetOptions();
+  // the CPU decoder translates one sentence at a time
+  const unsigned miniSize = (options.cpuThreads == 0) ? options.miniBatch : 1;
+
+  struct Pending {
+    const Shard* shard;
+    std::vector<std::pair<unsigned, std::string>> outputs;
+    std::vector<std::future<void>> tasks;
+  };
+
+  // the last shard is finished while the decoder threads start on the next
+  std::unique_ptr<Pending> previous;
+  auto finish = [this, &shards](Pending& pending) {
+    for (auto& task : pending.tasks) {
+      task.get();
+    }
+
+    std::string path = GetShardPath(*pending.shard);
+    {
+      std::ofstream out(path + ".tmp", std::ios::binary);
+      for (const auto& output : pending.outputs) {
+        WriteRecord(out, output.first, output.second);
+      }
+      out.close();
+      amunmt_UTIL_THROW_IF2(!out, "Could not write " << path);
+    }
+    fs::rename(path + ".tmp", path);
+    LOG(info)->info("Shard {} of {} done, {} lines of {} words",
+                    pending.shard - shards.data() + 1, shards.size(), pending.outputs.size(),
+                    pending.shard->bucket + 1);
+  };
+
+  std::ifstream input(inputPath_, std::ios::binary);
+  amunmt_UTIL_THROW_IF2(!input, "Could not open " << inputPath_);
+  size_t done = 0;
+  for (const Shard& shard : shards) {
+    if (fs::exists(GetShardPath(shard))) {
+      ++done;
+      continue;
+    }
+
+    std::vector<IndexRecord> records(shard.size);
+    {
+      std::ifstream bucket(GetPath("bucket." + std::to_string(shard.bucket)), std::ios::binary);
+      bucket.seekg(shard.first * sizeof(IndexRecord));
+      bucket.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(IndexRecord));
+      amunmt_UTIL_THROW_IF2(!bucket, "Corrupt index in " << dir_);
+    }
+
+    std::unique_ptr<Pending> pending(new Pending());
+    pending->shard = &shard;
+    pending->outputs.resize(shard.size);
+    for (size_t i = 0; i < records.size(); ++i) {
+      input.seekg(records[i].offset);
+      pending->outputs[i].first = records[i].lineNum;
+      std::getline(input, pending->outputs[i].second);
+    }
+    amunmt_UTIL_THROW_IF2(input.bad(), "Could not read " << inputPath_);
+    input.clear();
+
+    // the lines are replaced by their translations
+    auto* outputs = &pending->outputs;
+    for (size_t begin = 0; begin < outputs->size(); begin += miniSize) {
+      size_t end = std::min(begin + miniSize, outputs->size());
+      for (size_t i = begin; i < end; ++i) {
+        god_.GetMetrics().SentenceStarted();
+      }
+      pending->tasks.push_back(god_.GetThreadPool().enqueue([this, outputs, begin, end] {
+        SentencesPtr sentences(new Sentences());
+        for (size_t i = begin; i < end; ++i) {
+          sentences->push_back(SentencePtr(new Sentence(god_, (*outputs)[i].first, (*outputs)[i].second)));
+        }
+
+        std::shared_ptr<Histories> histories = TranslationTask(god_, sentences);
+        for (unsigned i = 0; i < histories->size(); ++i) {
+          std::stringstream strm;
+          Printer(god_, *histories->at(i), strm, sentences->Get(i));
+          (*outputs)[begin + i].second = strm.str();
+          god_.GetMetrics().SentenceFinished();
+        }
+      }));
+    }
+
+    if (previous) {
+      finish(*previous);
+    }
+    previous.swap(pending);
+  }
+  if (previous) {
+    finish(*previous);
+  }
+
+  if (done) {
+    LOG(info)->info("{} of {} shards were translated before", done, shards.size());
+  }
+}
+
+void Corpus::Merge(const std::vector<Shard>& shards)
+{
+  std::vector<std::string> paths;
+  for (const Shard& shard : shards) {
+    paths.push_back(GetShardPath(shard));
+  }
+
+  // in rounds while there are too many files to open at once
+  for (unsigned round = 0; paths.size() > MAX_MERGE; ++round) {
+    std::vector<std::string> merged;
+    for (size_t begin = 0; begin < paths.size(); begin += MAX_MERGE) {
+      std::vector<std::string> group(paths.begin() + begin,
+                                     paths.begin() + std::min(begin + MAX_MERGE, paths.size()));
+      merged.push_back(GetPath("merge." + std::to_string(round) + "." + std::to_string(merged.size())));
+      std::ofstream out(merged.back(), std::ios::binary);
+      MergeRecords(group, [&out](uint64_t lineNum, const std::string& output) {
+        WriteRecord(out, lineNum, output);
+      });
+      out.close();
+      amunmt_UTIL_THROW_IF2(!out, "Could not write " << merged.back());
+
+      // shards are kept until the end, they are the checkpoint
+      if (round > 0) {
+        for (const std::string& path : group) {
+          fs::remove(path);
+        }
+      }
+    }
+    paths.swap(merged);
+  }
+
+  uint64_t lines = 0;
+  OutputCollector& outputCollector = god_.GetOutputCollector();
+  MergeRecords(paths, [&](uint64_t lineNum, const std::string& output) {
+    amunmt_UTIL_THROW_IF2(lineNum != lines, "Line " << lines << " missing in " << dir_);
+    outputCollector.Write(lineNum, output);
+    ++lines;
+  });
+  uint64_t total = 0;
+  for (uint64_t size : bucketSizes_) {
+    total += size;
+  }
+  amunmt_UTIL_THROW_IF2(lines != total, "Only " << lines << " of " << total << " lines in " << dir_);
+
+  for (const std::string& path : paths) {
+    if (path.find("merge.") != std::string::npos) {
+      fs::remove(path);
+    }
+  }
+  LOG(info)->info("Merged {} lines, {} can be removed", lines, dir_);
+}
+
+}
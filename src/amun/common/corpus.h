@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+namespace amunmt {
+
+class God;
+
+// Out-of-core translation of --input-file for bulk jobs, with --corpus-dir as
+// work directory:
+//
+//   index          an index of the input in length buckets, one file per
+//                  bucket with the line number and file offset of each line
+//   shard.B.K      translations of lines K * shard-size ... of bucket B, in
+//                  line order; a shard is written under a temporary name and
+//                  renamed once complete
+//
+// Shards are translated shortest bucket first, so every mini-batch holds
+// sentences of about the same length whatever the maxi-batch. At the end all
+// shards are merged back into input order and written out. A job that was
+// interrupted is resumed from the shards that are complete.
+class Corpus {
+  public:
+    Corpus(God &god);
+
+    void Run();
+
+  private:
+    struct Shard {
+      unsigned bucket;
+      uint64_t first;
+      uint64_t size;
+    };
+
+    void BuildIndex();
+    std::vector<Shard> GetShards() const;
+    void Translate(const std::vector<Shard>& shards);
+    void Merge(const std::vector<Shard>& shards);
+
+    std::string GetPath(const std::string& name) const;
+    std::string GetShardPath(const Shard& shard) const;
+
+    God &god_;
+    std::string inputPath_;
+    std::string dir_;
+    uint64_t shardSize_;
+    std::vector<uint64_t> bucketSizes_;
+};
+
+}
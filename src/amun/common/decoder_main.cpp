@@ -13,6 +13,11 @@
 #include "common/sentences.h"
 #include "common/exception.h"
 #include "common/translation_task.h"
+#include "common/input_pipeline.h"
+#include "common/server.h"
+#include "common/corpus.h"
+#include "common/rescorer.h"
+#include "common/workers.h"
 
 using namespace amunmt;
 using namespace std;
@@ -20,49 +25,60 @@ using namespace std;
 int main(int argc, char* argv[])
 {
   God god;
+  god.AllowWorkers();
   god.Init(argc, argv);
 
-  std::setvbuf(stdout, NULL, _IONBF, 0);
-  std::setvbuf(stdin, NULL, _IONBF, 0);
-  boost::timer::cpu_timer timer;
-
-
-  unsigned miniSize = (god.Get<unsigned>("cpu-threads") == 0) ? god.Get<unsigned>("mini-batch") : 1;
-  unsigned maxiSize = (god.Get<unsigned>("cpu-threads") == 0) ? god.Get<unsigned>("maxi-batch") : 1;
-  int miniWords = god.Get<int>("mini-batch-words");
-
-  LOG(info)->info("Reading input");
-
-  SentencesPtr maxiBatch(new Sentences());
-
-  std::string line;
-  unsigned lineNum = 0;
+  // the workers translate their input below, the parent hands out the input
+  if (god.GetWorkers() && !god.GetWorkers()->IsWorker()) {
+    boost::timer::cpu_timer timer;
+    god.GetWorkers()->Run(god);
+    god.Cleanup();
+    LOG(info)->info("Total time: {}", timer.format());
+    return 0;
+  }
 
-  while (std::getline(god.GetInputStream(), line)) {
-    maxiBatch->push_back(SentencePtr(new Sentence(god, lineNum++, line)));
+  if (god.Get<bool>("server")) {
+    Server(god).Run();
+    god.Cleanup();
+    return 0;
+  }
 
-    if (maxiBatch->size() >= maxiSize) {
+  if (god.Has("corpus-dir")) {
+    boost::timer::cpu_timer timer;
+    Corpus(god).Run();
+    god.Cleanup();
+    LOG(info)->info("Total time: {}", timer.format());
+    return 0;
+  }
 
-      maxiBatch->SortByLength();
-      while (maxiBatch->size()) {
-        SentencesPtr miniBatch = maxiBatch->NextMiniBatch(miniSize, miniWords);
-        //cerr << "miniBatch=" << miniBatch->size() << " maxiBatch=" << maxiBatch->size() << endl;
+  if (god.Has("rescore")) {
+    boost::timer::cpu_timer timer;
+    Rescorer(god).Run();
+    god.Cleanup();
+    LOG(info)->info("Total time: {}", timer.format());
+    return 0;
+  }
 
-        god.GetThreadPool().enqueue(
-            [&god,miniBatch]{ return TranslationTaskAndOutput(god, miniBatch); }
-            );
-      }
+  std::setvbuf(stdin, NULL, _IONBF, 0);
+  boost::timer::cpu_timer timer;
 
-      maxiBatch.reset(new Sentences());
-    }
 
-  }
+  LOG(info)->info("Reading input");
 
-  // last batch
-  if (maxiBatch->size()) {
-    maxiBatch->SortByLength();
-    while (maxiBatch->size()) {
-      SentencesPtr miniBatch = maxiBatch->NextMiniBatch(miniSize, miniWords);
+  InputPipeline pipeline(god, [&god](std::string& line) {
+    return bool(std::getline(god.GetInputStream(), line));
+  }, [&god](const SentencePtr& sentence, const TranslationCache::Entry& cached) {
+    god.GetLatencyStats().Record(*sentence, cached.targetLength);
+    god.GetOutputCollector().Write(sentence->GetLineNum(), cached.output);
+    god.GetMetrics().SentenceFinished();
+  });
+
+  while (SentencesPtr miniBatch = pipeline.NextMiniBatch()) {
+    if (ThreadPool *encoderPool = god.GetEncoderPool()) {
+      encoderPool->enqueue(
+          [&god,miniBatch]{ return EncodeTask(god, miniBatch); }
+          );
+    } else {
       god.GetThreadPool().enqueue(
           [&god,miniBatch]{ return TranslationTaskAndOutput(god, miniBatch); }
           );
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "common/god.h"
+#include "common/sentence.h"
+
+namespace amunmt {
+
+// Merges requests submitted from any number of threads into mini-batches,
+// for `amun --server` and libamun. A batch is handed on when it has
+// --mini-batch sentences or --mini-batch-words words, or when its oldest
+// request has waited --max-batch-wait ms. RequestPtr points to anything with
+// a SentencePtr sentence and the steady_clock time_point it arrived.
+template <class RequestPtr>
+class DynamicBatcher {
+  public:
+    typedef std::chrono::steady_clock Clock;
+    // called on the batcher thread, may block while the decoders are busy;
+    // requests that arrive meanwhile form the next batch
+    typedef std::function<void(std::vector<RequestPtr>)> Dispatch;
+
+    DynamicBatcher(const God &god, Dispatch dispatch)
+      : // the CPU decoder translates one sentence at a time
+        miniSize_((god.GetOptions().cpuThreads == 0) ? god.GetOptions().miniBatch : 1),
+        miniWords_(god.GetOptions().miniBatchWords),
+        maxWait_(std::chrono::milliseconds(god.Get<unsigned>("max-batch-wait"))),
+        dispatch_(dispatch),
+        stopping_(false),
+        thread_(&DynamicBatcher::Run, this)
+    {}
+
+    ~DynamicBatcher() {
+      Stop();
+    }
+
+    // false once Stop() was called, the requests are not queued then
+    bool Submit(const std::vector<RequestPtr>& requests) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+          return false;
+        }
+        queue_.insert(queue_.end(), requests.begin(), requests.end());
+      }
+      changed_.notify_all();
+      return true;
+    }
+
+    // hands on the queued requests without waiting for more, then returns
+    void Stop() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      changed_.notify_all();
+      if (thread_.joinable()) {
+        thread_.join();
+      }
+    }
+
+  private:
+    bool BatchFull() const {
+      if (queue_.size() >= miniSize_) {
+        return true;
+      }
+      if (miniWords_) {
+        int words = 0;
+        for (auto& request : queue_) {
+          words += request->sentence->size();
+        }
+        return words >= miniWords_;
+      }
+      return false;
+    }
+
+    void Run() {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      while (true) {
+        changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          break;
+        }
+
+        // give other requests until the oldest one times out to join the batch
+        Clock::time_point deadline = queue_.front()->arrived + maxWait_;
+        while (!stopping_ && !BatchFull() && Clock::now() < deadline) {
+          changed_.wait_until(lock, deadline);
+        }
+
+        std::vector<RequestPtr> batch;
+        int words = 0;
+        while (!queue_.empty() && batch.size() < miniSize_) {
+          int size = queue_.front()->sentence->size();
+          if (miniWords_ && !batch.empty() && words + size > miniWords_) {
+            break;
+          }
+          words += size;
+          batch.push_back(queue_.front());
+          queue_.pop_front();
+        }
+        lock.unlock();
+
+        auto enqueued = Clock::now();
+        for (auto& request : batch) {
+          request->sentence->GetTimestamps().enqueued = enqueued;
+        }
+        dispatch_(batch);
+
+        lock.lock();
+      }
+    }
+
+    const unsigned miniSize_;
+    const int miniWords_;
+    const Clock::duration maxWait_;
+    const Dispatch dispatch_;
+
+    std::deque<RequestPtr> queue_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool stopping_;
+
+    // last, started once the rest is initialized
+    std::thread thread_;
+};
+
+}
@@ -1,4 +1,6 @@
 #include <vector>
+#include <chrono>
+#include <csignal>
 #include <sstream>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/timer/timer.hpp>
@@ -18,6 +20,10 @@
 #include "common/sentences.h"
 #include "common/translation_task.h"
 #include "common/logging.h"
+#include "common/numa.h"
+#include "common/profiler.h"
+#include "common/tracer.h"
+#include "common/workers.h"
 
 #include "scorer.h"
 #include "loader_factory.h"
@@ -26,8 +32,43 @@ using namespace std;
 
 namespace amunmt {
 
+namespace {
+
+volatile std::sig_atomic_t reloadRequested = 0;
+
+extern "C" void RequestReload(int) {
+  reloadRequested = 1;
+}
+
+// holds the tasks of a pool until one has started on every thread
+class PoolBarrier {
+  public:
+    explicit PoolBarrier(size_t threads)
+      : waiting_(threads)
+    {}
+
+    void Wait() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (--waiting_ == 0) {
+        released_.notify_all();
+      } else {
+        released_.wait(lock, [this] { return waiting_ == 0; });
+      }
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    size_t waiting_;
+};
+
+}
+
 God::God()
- : threadIncr_(0)
+ : modelsVersion_(0),
+   reloadWatcherStopped_(false),
+   threadIncr_(0),
+   allowWorkers_(false)
 {
 }
 
@@ -61,6 +102,16 @@ God& God::Init(int argc, char** argv) {
   set_loglevel(*progress_, config_.Get<string>("log-progress"));
 
   config_.LogOptions();
+  options_ = Options(config_);
+
+  unsigned numWorkers = Get<unsigned>("workers");
+  amunmt_UTIL_THROW_IF2(numWorkers > 1 && !allowWorkers_,
+                        "--workers is only supported by the amun executable");
+
+  // the profiler starts a thread, which must not exist when the workers fork
+  if (numWorkers == 1) {
+    EnableProfiling("");
+  }
 
   if (Get("source-vocab").IsSequence()) {
     YAML::Node tabVocabs = Get("source-vocab");
@@ -88,20 +139,19 @@ God& God::Init(int argc, char** argv) {
     exit(0);
   }
 
-  LoadScorers();
+  LOG(info)->info("Loading scorers...");
+  models_ = LoadScorers(0);
   LoadFiltering();
 
-  returnNBestList_ = Get<bool>("n-best");
   useFusedSoftmax_ = true;
-  if (gpuLoaders_.size() != 1 || // more than 1 scorer
-      God::Get<unsigned>("beam-size") > 11 // beam size affect shared mem alloc in gLogSoftMax()
+  if (models_->gpuLoaders.size() != 1 || // more than 1 scorer
+      options_.beamSize > 11 // beam size affect shared mem alloc in gLogSoftMax()
       ) {
     useFusedSoftmax_ = false;
   }
   //cerr << "useFusedSoftmax_=" << useFusedSoftmax_ << endl;
 
-  useTensorCores_ = Get<bool>("tensor-cores");
-  cerr << "useTensorCores_=" << useTensorCores_ << endl;
+  LOG(info)->info("Use tensor cores: {}", options_.tensorCores);
 
   if (Has("input-file")) {
     LOG(info)->info("Reading from {}", Get<std::string>("input-file"));
@@ -114,32 +164,145 @@ God& God::Init(int argc, char** argv) {
 
   LoadPrePostProcessing();
 
+  unsigned cacheSize = Get<unsigned>("cache-size");
+  if (cacheSize && (options_.nBest || options_.returnNematusAlignment)) {
+    LOG(info)->warn("Translation cache disabled, n-best lists and Nematus alignments contain line numbers");
+    cacheSize = 0;
+  }
+  if (cacheSize && options_.sampling) {
+    LOG(info)->warn("Translation cache disabled, repeated lines get samples of their own");
+    cacheSize = 0;
+  }
+  if (cacheSize) {
+    translationCache_.Init(cacheSize, TranslationCache::Fingerprint(config_.Get()));
+    LOG(info)->info("Translation cache for {} sentences", cacheSize);
+  }
+
   unsigned totalThreads = GetTotalThreads();
   LOG(info)->info("Total number of threads: {}", totalThreads);
   amunmt_UTIL_THROW_IF2(totalThreads == 0, "Total number of threads is 0");
 
-  pool_.reset(new ThreadPool(totalThreads, totalThreads));
+  unsigned encoderThreads = 0;
+#ifdef HAS_CPU
+  encoderThreads = Get<unsigned>("encoder-threads");
+  amunmt_UTIL_THROW_IF2(encoderThreads && totalThreads != Get<unsigned>("cpu-threads"),
+                        "encoder-threads only work with CPU decoding");
+#endif
+
+  if (numWorkers > 1) {
+    // after loading, so the workers share the model; no thread runs yet
+    workers_.reset(new Workers(numWorkers));
+    if (workers_->IsWorker()) {
+      EnableProfiling(".worker" + std::to_string(workers_->GetWorkerId()));
+      inputStream_.reset(new InputFileStream(std::cin));
+      StartThreadPools(totalThreads, encoderThreads);
+      outputCollector_.Start(true, true);
+      latencyStats_.Start(Get<unsigned>("stats-interval"));
+    } else {
+      // the workers decode, the parent only merges their output
+      outputCollector_.Start(options_.lineBuffered);
+      latencyStats_.Start(Get<unsigned>("stats-interval"));
+      metrics_.Start(*this);
+    }
+    return *this;
+  }
+
+  StartThreadPools(totalThreads, encoderThreads);
+  outputCollector_.Start(options_.lineBuffered);
+  latencyStats_.Start(Get<unsigned>("stats-interval"));
+  metrics_.Start(*this);
+
+  if (Get<bool>("reload-on-sighup")) {
+    LOG(info)->info("Reloading the models on SIGHUP");
+    std::signal(SIGHUP, RequestReload);
+    reloadWatcher_ = std::thread(&God::WatchReloadSignal, this);
+  }
 
   return *this;
 }
 
+void God::StartThreadPools(unsigned totalThreads, unsigned encoderThreads)
+{
+  // the bounded queue of the decoder threads also holds the encoded
+  // mini-batches, the encoder threads wait while it is full
+  pool_.reset(new ThreadPool(totalThreads, totalThreads));
+  if (encoderThreads) {
+    LOG(info)->info("Encoding on {} separate threads", encoderThreads);
+    encoderPool_.reset(new ThreadPool(encoderThreads, encoderThreads));
+  }
+}
+
+void God::EnableProfiling(const std::string& suffix)
+{
+  if (Has("profile")) {
+    Profiler::Enable(Get<std::string>("profile") + suffix);
+  }
+  if (Has("trace")) {
+    Tracer::Enable(Get<std::string>("trace") + suffix);
+    Tracer::SetThreadName("main");
+  }
+}
+
 void God::Cleanup()
 {
-  pool_.reset();
-  cpuLoaders_.clear();
-  gpuLoaders_.clear();
-  fpgaLoaders_.clear();
+  // waits for a reload in progress
+  if (reloadWatcher_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(reloadWatcherMutex_);
+      reloadWatcherStopped_ = true;
+    }
+    reloadWatcherStop_.notify_one();
+    reloadWatcher_.join();
+    std::signal(SIGHUP, SIG_DFL);
+  }
+
+  // the encoder threads hand their last mini-batches to the decoder threads
+  encoderPool_.reset();
+
+  std::unique_ptr<ThreadPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    pool.swap(pool_);
+  }
+  // Cleanup() runs twice when called before the destructor
+  bool running = bool(pool);
+  pool.reset();
+  outputCollector_.Close();
+  if (running && translationCache_.Enabled()) {
+    LOG(info)->info("Translation cache: {} hits, {} misses, {} duplicates in batch, {} evictions",
+                    translationCache_.Hits(), translationCache_.Misses(),
+                    translationCache_.Duplicates(), translationCache_.Evictions());
+  }
+  latencyStats_.Stop();
+  metrics_.Stop();
+  Profiler::Finish();
+  Tracer::Finish();
+  std::lock_guard<std::mutex> lock(modelsMutex_);
+  models_.reset();
 }
 
-void God::LoadScorers() {
-  LOG(info)->info("Loading scorers...");
+ThreadPoolState God::GetThreadPoolState() const
+{
+  ThreadPoolState state;
+  std::lock_guard<std::mutex> lock(poolMutex_);
+  if (pool_) {
+    state.threads = pool_->getNumThreads();
+    state.busy = pool_->getNumBusy();
+    state.queued = pool_->getNumTasks();
+  }
+  return state;
+}
+
+ModelSetPtr God::LoadScorers(unsigned version) const {
+  std::unique_ptr<ModelSet> models(new ModelSet());
+  models->version = version;
 #ifdef CUDA
   unsigned gpuThreads = God::Get<unsigned>("gpu-threads");
   auto devices = God::Get<std::vector<unsigned>>("devices");
   if (gpuThreads > 0 && devices.size() > 0) {
     for (auto&& pair : config_.Get()["scorers"]) {
       std::string name = pair.first.as<std::string>();
-      gpuLoaders_.emplace(name, LoaderFactory::Create(*this, name, pair.second, GPUDevice));
+      models->gpuLoaders.emplace(name, LoaderFactory::Create(*this, name, pair.second, GPUDevice));
     }
   }
 #endif
@@ -148,7 +311,7 @@ void God::LoadScorers() {
   if (cpuThreads) {
     for (auto&& pair : config_.Get()["scorers"]) {
       std::string name = pair.first.as<std::string>();
-      cpuLoaders_.emplace(name, LoaderFactory::Create(*this, name, pair.second, CPUDevice));
+      models->cpuLoaders.emplace(name, LoaderFactory::Create(*this, name, pair.second, CPUDevice));
     }
   }
 #endif
@@ -157,11 +320,133 @@ void God::LoadScorers() {
   if (fpgaThreads) {
     for (auto&& pair : config_.Get()["scorers"]) {
       std::string name = pair.first.as<std::string>();
-      fpgaLoaders_.emplace(name, LoaderFactory::Create(*this, name, pair.second, FPGADevice));
+      models->fpgaLoaders.emplace(name, LoaderFactory::Create(*this, name, pair.second, FPGADevice));
+    }
+  }
+#endif
+
+  return ModelSetPtr(models.release(), [](const ModelSet* models) {
+    if (models->replaced) {
+      LOG(info)->info("Freeing the weights of model version {}", models->version);
+    }
+    delete models;
+  });
+}
+
+ModelSetPtr God::GetModels() const {
+  std::lock_guard<std::mutex> lock(modelsMutex_);
+  return models_;
+}
+
+void God::Reload() {
+  std::lock_guard<std::mutex> reloadLock(reloadMutex_);
+  boost::timer::cpu_timer timer;
+
+  ModelSetPtr current = GetModels();
+  amunmt_UTIL_THROW_IF2(!current, "No models to reload");
+  unsigned version = current->version + 1;
+  LOG(info)->info("Loading model version {}...", version);
+  ModelSetPtr models = LoadScorers(version);
+  WarmUp(*current, models);
+
+  {
+    std::lock_guard<std::mutex> lock(modelsMutex_);
+    models_ = models;
+  }
+  modelsVersion_.store(version, std::memory_order_release);
+  current->replaced = true;
+  current.reset();
+  SwitchPoolModels();
+
+  // the cache keys contain the size and time of the model files
+  if (translationCache_.Enabled()) {
+    translationCache_.Reset(TranslationCache::Fingerprint(config_.Get()));
+  }
+  LOG(info)->info("Model version {} loaded and warmed up in {}, used from the next mini-batch on",
+                  version, timer.format(3, "%ws"));
+}
+
+void God::SwitchPoolModels() {
+  std::lock_guard<std::mutex> lock(poolMutex_);
+  for (ThreadPool* pool : { pool_.get(), encoderPool_.get() }) {
+    if (!pool) {
+      continue;
+    }
+    // a task per thread, none of which returns before all have started, so
+    // that every thread gets one; idle threads would hold the old weights
+    // until their next mini-batch otherwise
+    std::shared_ptr<PoolBarrier> barrier(new PoolBarrier(pool->getNumThreads()));
+    for (size_t i = 0; i < pool->getNumThreads(); ++i) {
+      pool->enqueue([this, barrier] {
+        barrier->Wait();
+        GetSearch().UpdateModels();
+      });
     }
   }
+}
+
+void God::WarmUp(const ModelSet& current, const ModelSetPtr& models) const {
+  // a thread of the first device that decodes
+  DeviceInfo deviceInfo;
+  deviceInfo.threadInd = 0;
+  deviceInfo.deviceId = 0;
+  if (!models->cpuLoaders.empty()) {
+    deviceInfo.deviceType = CPUDevice;
+  } else if (!models->gpuLoaders.empty()) {
+    deviceInfo.deviceType = GPUDevice;
+#ifdef CUDA
+    deviceInfo.deviceId = Get<std::vector<unsigned>>("devices")[0];
+#endif
+  } else {
+    deviceInfo.deviceType = FPGADevice;
+#ifdef HAS_FPGA
+    deviceInfo.deviceId = Get<std::vector<unsigned>>("fpga-devices")[0];
 #endif
+  }
+
+  // the vocabularies are not reloaded
+  std::vector<ScorerPtr> scorers = GetScorers(*models, deviceInfo);
+  std::vector<ScorerPtr> currentScorers = GetScorers(current, deviceInfo);
+  for (unsigned i = 0; i < scorers.size(); ++i) {
+    amunmt_UTIL_THROW_IF2(scorers[i]->GetVocabSize() != currentScorers[i]->GetVocabSize(),
+                          "Scorer " << scorers[i]->GetName() << " has a target vocabulary of "
+                          << scorers[i]->GetVocabSize() << " words, the current model of "
+                          << currentScorers[i]->GetVocabSize());
+  }
+  scorers.clear();
+  currentScorers.clear();
+
+  // a few words of every source vocabulary
+  std::string line;
+  for (unsigned tab = 0; tab < sourceVocabs_.size(); ++tab) {
+    const Vocab& vocab = GetSourceVocab(tab);
+    line += tab ? "\t" : "";
+    for (unsigned id = 2; id < std::min(10u, vocab.size()); ++id) {
+      line += ((id > 2) ? " " : "") + vocab[id];
+    }
+  }
+  Sentences sentences;
+  sentences.push_back(SentencePtr(new Sentence(*this, 0, line)));
+  Search search(*this, deviceInfo, models);
+  search.SetWarmUp();
+  search.Translate(sentences);
+}
 
+void God::WatchReloadSignal() {
+  std::unique_lock<std::mutex> lock(reloadWatcherMutex_);
+  while (!reloadWatcherStopped_) {
+    reloadWatcherStop_.wait_for(lock, std::chrono::milliseconds(100));
+    if (reloadRequested) {
+      reloadRequested = 0;
+      lock.unlock();
+      try {
+        Reload();
+      } catch (const std::exception& e) {
+        LOG(info)->error("Reloading the models failed, keeping version {}: {}", GetModelsVersion(), e.what());
+      }
+      lock.lock();
+    }
+  }
 }
 
 void God::LoadFiltering() {
@@ -242,19 +527,19 @@ OutputCollector& God::GetOutputCollector() const {
   return outputCollector_;
 }
 
-std::vector<ScorerPtr> God::GetScorers(const DeviceInfo &deviceInfo) const {
+std::vector<ScorerPtr> God::GetScorers(const ModelSet &models, const DeviceInfo &deviceInfo) const {
   std::vector<ScorerPtr> scorers;
 
   if (deviceInfo.deviceType == CPUDevice) {
-    for (auto&& loader : cpuLoaders_ | boost::adaptors::map_values)
+    for (auto&& loader : models.cpuLoaders | boost::adaptors::map_values)
       scorers.emplace_back(loader->NewScorer(*this, deviceInfo));
   }
   else if (deviceInfo.deviceType == GPUDevice) {
-    for (auto&& loader : gpuLoaders_ | boost::adaptors::map_values)
+    for (auto&& loader : models.gpuLoaders | boost::adaptors::map_values)
       scorers.emplace_back(loader->NewScorer(*this, deviceInfo));
   }
   else if (deviceInfo.deviceType == FPGADevice) {
-    for (auto&& loader : fpgaLoaders_ | boost::adaptors::map_values)
+    for (auto&& loader : models.fpgaLoaders | boost::adaptors::map_values)
       scorers.emplace_back(loader->NewScorer(*this, deviceInfo));
   }
   else {
@@ -264,15 +549,15 @@ std::vector<ScorerPtr> God::GetScorers(const DeviceInfo &deviceInfo) const {
   return scorers;
 }
 
-BestHypsBasePtr God::GetBestHyps(const DeviceInfo &deviceInfo) const {
+BestHypsBasePtr God::GetBestHyps(const ModelSet &models, const DeviceInfo &deviceInfo) const {
   if (deviceInfo.deviceType == CPUDevice) {
-    return cpuLoaders_.begin()->second->GetBestHyps(*this, deviceInfo);
+    return models.cpuLoaders.begin()->second->GetBestHyps(*this, deviceInfo);
   }
   else if (deviceInfo.deviceType == GPUDevice) {
-    return gpuLoaders_.begin()->second->GetBestHyps(*this, deviceInfo);
+    return models.gpuLoaders.begin()->second->GetBestHyps(*this, deviceInfo);
   }
   else if (deviceInfo.deviceType == FPGADevice) {
-    return fpgaLoaders_.begin()->second->GetBestHyps(*this, deviceInfo);
+    return models.fpgaLoaders.begin()->second->GetBestHyps(*this, deviceInfo);
   }
   else {
 	amunmt_UTIL_THROW2("Unknown device type:" << deviceInfo);
@@ -280,12 +565,13 @@ BestHypsBasePtr God::GetBestHyps(const DeviceInfo &deviceInfo) const {
 }
 
 std::vector<std::string> God::GetScorerNames() const {
+  ModelSetPtr models = GetModels();
   std::vector<std::string> scorerNames;
-  for(auto&& name : cpuLoaders_ | boost::adaptors::map_keys)
+  for(auto&& name : models->cpuLoaders | boost::adaptors::map_keys)
     scorerNames.push_back(name);
-  for(auto&& name : gpuLoaders_ | boost::adaptors::map_keys)
+  for(auto&& name : models->gpuLoaders | boost::adaptors::map_keys)
     scorerNames.push_back(name);
-  for(auto&& name : fpgaLoaders_ | boost::adaptors::map_keys)
+  for(auto&& name : models->fpgaLoaders | boost::adaptors::map_keys)
     scorerNames.push_back(name);
 
   return scorerNames;
@@ -317,6 +603,25 @@ std::vector<std::string> God::Preprocess(unsigned i, const std::vector<std::stri
   return processed;
 }
 
+void God::PreprocessWord(unsigned i, const std::string& word, std::vector<std::string>& pieces) const {
+  if (preprocessors_.size() < i + 1 || preprocessors_[i].empty()) {
+    pieces.resize(1);
+    pieces[0] = word;
+    return;
+  }
+
+  preprocessors_[i][0]->PreprocessWord(word, pieces);
+  for (unsigned p = 1; p < preprocessors_[i].size(); ++p) {
+    thread_local std::vector<std::string> input, output;
+    input.swap(pieces);
+    pieces.clear();
+    for (const std::string& piece : input) {
+      preprocessors_[i][p]->PreprocessWord(piece, output);
+      pieces.insert(pieces.end(), output.begin(), output.end());
+    }
+  }
+}
+
 std::vector<std::string> God::Postprocess(const std::vector<std::string>& input) const {
   std::vector<std::string> processed = input;
   for (const auto& processor : postprocessors_) {
@@ -338,7 +643,9 @@ DeviceInfo God::GetNextDevice() const
 #endif
 
 #ifdef HAS_CPU
-  cpuThreads = God::Get<unsigned>("cpu-threads");
+  // decoder and encoder threads share the CPU thread indices, in the order
+  // they first call GetSearch()
+  cpuThreads = God::Get<unsigned>("cpu-threads") + God::Get<unsigned>("encoder-threads");
 #endif
 
 #ifdef HAS_FPGA
@@ -355,6 +662,7 @@ DeviceInfo God::GetNextDevice() const
   if (threadIncr_ < cpuThreads) {
     ret.deviceType = CPUDevice;
     ret.threadInd = threadIncr_;
+    ret.numaNode = NumaTopology::Get().GetNode(threadIncr_, cpuThreads);
   }
   else if (threadIncr_ < cpuThreads + totGPUThreads) {
     ret.deviceType = GPUDevice;
@@ -381,10 +689,32 @@ DeviceInfo God::GetNextDevice() const
   }
 
   ++threadIncr_;
+  lock.unlock();
+
+#ifdef HAS_CPU
+  if (ret.deviceType == CPUDevice) {
+    PlaceCPUThread(ret, cpuThreads);
+  }
+#endif
 
   return ret;
 }
 
+void God::PlaceCPUThread(const DeviceInfo &deviceInfo, unsigned cpuThreads) const
+{
+  const NumaTopology& topology = NumaTopology::Get();
+  if (Get<bool>("pin-threads")) {
+    unsigned cpu = topology.GetCpu(deviceInfo.threadInd, cpuThreads);
+    PinThread({cpu});
+    LOG(info)->info("CPU thread {} pinned to CPU {} on NUMA node {}",
+                    deviceInfo.threadInd, cpu, topology.GetNodeId(deviceInfo.numaNode));
+  }
+  else if (Get<std::string>("numa-weights") == "replicate" && topology.GetNumNodes() > 1) {
+    // keep the thread next to its replica of the weights
+    PinThread(topology.GetCpus(deviceInfo.numaNode));
+  }
+}
+
 Search &God::GetSearch() const
 {
   thread_local Search obj(*this);
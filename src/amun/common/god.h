@@ -1,17 +1,24 @@
 #pragma once
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <iostream>
+#include <condition_variable>
 #include <boost/thread/shared_mutex.hpp>
 #include <boost/thread/locks.hpp>
 
 #include "common/processor/processor.h"
 #include "common/config.h"
+#include "common/options.h"
 #include "common/loader.h"
 #include "common/logging.h"
 #include "common/scorer.h"
 #include "common/types.h"
 #include "common/base_best_hyps.h"
 #include "common/output_collector.h"
+#include "common/latency_stats.h"
+#include "common/metrics.h"
+#include "common/translation_cache.h"
 #include "common/vocab.h"
 #include "common/factor_vocab.h"
 #include "common/threadpool.h"
@@ -28,6 +35,27 @@ class Vocab;
 class FactorVocab;
 class Filter;
 class InputFileStream;
+class Workers;
+
+// the loaded scorers of one version of the models. A Search holds on to the
+// version it decodes with, so the weights of a version replaced by
+// God::Reload() are freed once the last search using them moved on.
+struct ModelSet {
+  typedef std::map<std::string, LoaderPtr> Loaders;
+  Loaders cpuLoaders, gpuLoaders, fpgaLoaders;
+  unsigned version = 0;
+  // set once a newer version was swapped in
+  mutable std::atomic<bool> replaced{false};
+};
+
+typedef std::shared_ptr<const ModelSet> ModelSetPtr;
+
+// load of the decoder thread pool, all zeros when there is no pool
+struct ThreadPoolState {
+  size_t threads = 0;
+  size_t busy = 0;
+  size_t queued = 0;
+};
 
 class God {
   public:
@@ -39,6 +67,15 @@ class God {
 
     void Cleanup();
 
+    // lets Init() fork the processes of --workers; only for executables that
+    // run the input loop of amun, see Workers
+    void AllowWorkers()
+    { allowWorkers_ = true; }
+
+    // null without --workers
+    Workers* GetWorkers() const
+    { return workers_.get(); }
+
     bool Has(const std::string& key) const {
       return config_.Has(key);
     }
@@ -52,6 +89,10 @@ class God {
       return config_.Get(key);
     }
 
+    // use these rather than Get() on per-sentence paths
+    const Options& GetOptions() const
+    { return options_; }
+
     Vocab& GetSourceVocab(unsigned tab = 0, unsigned factor = 0) const;
     FactorVocab& GetSourceVocabs(unsigned tab=0) const;
     Vocab& GetTargetVocab() const;
@@ -59,22 +100,49 @@ class God {
     std::istream& GetInputStream() const;
     OutputCollector& GetOutputCollector() const;
 
+    // latency and throughput of the sentences translated so far
+    LatencyStats& GetLatencyStats() const
+    { return latencyStats_; }
+
+    Metrics& GetMetrics() const
+    { return metrics_; }
+
+    TranslationCache& GetTranslationCache() const
+    { return translationCache_; }
+
     std::shared_ptr<const Filter> GetFilter() const;
 
-    BestHypsBasePtr GetBestHyps(const DeviceInfo &deviceInfo) const;
+    // the current version of the models, the one new mini-batches use
+    ModelSetPtr GetModels() const;
+    unsigned GetModelsVersion() const
+    { return modelsVersion_.load(std::memory_order_acquire); }
+
+    // loads the models again from the files of the configuration, e.g. after
+    // a rollout replaced them, and warms them up on the calling thread. Then
+    // they are swapped in: searches switch at their next mini-batch, the ones
+    // in flight finish with the old models, and idle threads of the pools
+    // switch right away. Vocabularies, filter and BPE stay. Throws and keeps
+    // the current models if the new ones fail to load. Must not be called
+    // from a thread of the pools.
+    void Reload();
+
+    BestHypsBasePtr GetBestHyps(const ModelSet &models, const DeviceInfo &deviceInfo) const;
 
-    std::vector<ScorerPtr> GetScorers(const DeviceInfo &deviceInfo) const;
+    std::vector<ScorerPtr> GetScorers(const ModelSet &models, const DeviceInfo &deviceInfo) const;
     std::vector<std::string> GetScorerNames() const;
     const std::map<std::string, float>& GetScorerWeights() const;
 
     std::vector<std::vector<std::string>> Preprocess
       (unsigned i, const std::vector<std::vector<std::string>>& input) const;
     std::vector<std::string> Preprocess(unsigned i, const std::vector<std::string>& input) const;
+    void PreprocessWord(unsigned i, const std::string& word, std::vector<std::string>& pieces) const;
     std::vector<std::string> Postprocess(const std::vector<std::string>& input) const;
 
 
     void LoadWeights(const std::string& path);
 
+    // device of the calling decoder thread; CPU threads are also pinned to
+    // their cores or NUMA node if requested
     DeviceInfo GetNextDevice() const;
     Search &GetSearch() const;
 
@@ -82,22 +150,39 @@ class God {
     ThreadPool &GetThreadPool()
     { return *pool_; }
 
+    // null without --encoder-threads
+    ThreadPool *GetEncoderPool()
+    { return encoderPool_.get(); }
+
+    // safe to call from any thread, also during Cleanup()
+    ThreadPoolState GetThreadPoolState() const;
+
     bool ReturnNBestList() const
-    { return returnNBestList_; }
+    { return options_.nBest; }
 
     bool UseFusedSoftmax() const
     { return useFusedSoftmax_; }
 
     bool UseTensorCores() const
-    { return useTensorCores_; }
+    { return options_.tensorCores; }
 
   private:
-    void LoadScorers();
+    ModelSetPtr LoadScorers(unsigned version) const;
+    void WarmUp(const ModelSet& current, const ModelSetPtr& models) const;
+    // makes the Search of every pool thread drop the models before Reload()
+    void SwitchPoolModels();
+    void WatchReloadSignal();
     void LoadFiltering();
     void LoadPrePostProcessing();
+    void EnableProfiling(const std::string& suffix);
+    void StartThreadPools(unsigned totalThreads, unsigned encoderThreads);
+
+    // pins the calling thread according to --pin-threads and --numa-weights
+    void PlaceCPUThread(const DeviceInfo &deviceInfo, unsigned cpuThreads) const;
 
 
     Config config_;
+    Options options_;
 
     // a list of source side factor vocabularies for each of the tabs
     mutable std::vector<FactorVocab> sourceVocabs_;
@@ -108,8 +193,18 @@ class God {
     std::vector<std::vector<PreprocessorPtr>> preprocessors_;
     std::vector<PostprocessorPtr> postprocessors_;
 
-    typedef std::map<std::string, LoaderPtr> Loaders;
-    Loaders cpuLoaders_, gpuLoaders_, fpgaLoaders_;
+    ModelSetPtr models_;
+    std::atomic<unsigned> modelsVersion_;
+    mutable std::mutex modelsMutex_;
+    // one Reload() at a time
+    std::mutex reloadMutex_;
+
+    // --reload-on-sighup
+    std::thread reloadWatcher_;
+    std::mutex reloadWatcherMutex_;
+    std::condition_variable reloadWatcherStop_;
+    bool reloadWatcherStopped_;
+
     std::map<std::string, float> weights_;
 
     std::shared_ptr<spdlog::logger> info_;
@@ -117,14 +212,21 @@ class God {
 
     mutable std::unique_ptr<InputFileStream> inputStream_;
     mutable OutputCollector outputCollector_;
+    mutable LatencyStats latencyStats_;
+    mutable Metrics metrics_;
+    mutable TranslationCache translationCache_;
 
     mutable unsigned threadIncr_;
     mutable boost::shared_mutex accessLock_;
 
     std::unique_ptr<ThreadPool> pool_;
+    std::unique_ptr<ThreadPool> encoderPool_;
+    mutable std::mutex poolMutex_;
+
+    bool allowWorkers_;
+    std::unique_ptr<Workers> workers_;
 
-    bool returnNBestList_;
-    bool useFusedSoftmax_, useTensorCores_;
+    bool useFusedSoftmax_;
 };
 
 }
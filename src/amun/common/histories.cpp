@@ -5,12 +5,12 @@ using namespace std;
 
 namespace amunmt {
 
-Histories::Histories(const Sentences& sentences, bool normalizeScore)
+Histories::Histories(const Sentences& sentences, bool normalizeScore, unsigned prefixLength)
  : coll_(sentences.size())
 {
   for (unsigned i = 0; i < sentences.size(); ++i) {
     const Sentence &sentence = sentences.Get(i);
-    History *history = new History(sentence, normalizeScore, 3 * sentence.size());
+    History *history = new History(sentence, normalizeScore, 3 * sentence.size() + prefixLength);
     coll_[i].reset(history);
   }
 }
@@ -6,7 +6,9 @@ namespace amunmt {
 class Histories {
   public:
     Histories() {} // for all histories in translation task
-    Histories(const Sentences& sentences, bool normalizeScore);
+    // prefixLength: target words forced before the search, which don't count
+    // against the maximum length
+    Histories(const Sentences& sentences, bool normalizeScore, unsigned prefixLength = 0);
 
     std::shared_ptr<History> at(unsigned id) const {
       return coll_.at(id);
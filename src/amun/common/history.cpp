@@ -8,7 +8,10 @@ namespace amunmt {
 History::History(const Sentence &sentence, bool normalizeScore, unsigned maxLength)
   : normalize_(normalizeScore),
     lineNo_(sentence.GetLineNum()),
-   maxLength_(maxLength)
+   maxLength_(maxLength),
+   stableSteps_(1),
+   finishedDepth_(0),
+   finishedCost_(0)
 {
   Add({HypothesisPtr(new Hypothesis(sentence))});
 }
@@ -24,6 +27,70 @@ void History::Add(const Beam& beam) {
   history_.push_back(beam);
 }
 
+namespace {
+
+// moves a to the deepest common ancestor of a and b; depths count words
+void JoinAncestor(HypothesisPtr& a, unsigned& aDepth, HypothesisPtr b, unsigned bDepth) {
+  if (!a) {
+    a = b;
+    aDepth = bDepth;
+    return;
+  }
+  for (; aDepth > bDepth; --aDepth) {
+    a = a->GetPrevHyp();
+  }
+  for (; bDepth > aDepth; --bDepth) {
+    b = b->GetPrevHyp();
+  }
+  for (; a != b; --aDepth) {
+    a = a->GetPrevHyp();
+    b = b->GetPrevHyp();
+  }
+}
+
+}
+
+bool History::UpdateStablePrefix()
+{
+  if (history_.size() == stableSteps_) {
+    return false;
+  }
+  stableSteps_ = history_.size();
+
+  const Beam& beam = history_.back();
+  unsigned depth = history_.size() - 1;
+  HypothesisPtr ancestor;
+  unsigned ancestorDepth = 0;
+  for (const HypothesisPtr& hyp : beam) {
+    if (hyp->GetWord() == EOS_ID || depth == maxLength_) {
+      // as in Add()
+      float cost = normalize_ ? hyp->GetCost() / depth : hyp->GetCost();
+      if (!finished_ || cost > finishedCost_) {
+        bool eos = hyp->GetWord() == EOS_ID;
+        finished_ = eos ? hyp->GetPrevHyp() : hyp;
+        finishedDepth_ = eos ? depth - 1 : depth;
+        finishedCost_ = cost;
+      }
+    } else {
+      JoinAncestor(ancestor, ancestorDepth, hyp, depth);
+    }
+  }
+  if (finished_) {
+    JoinAncestor(ancestor, ancestorDepth, finished_, finishedDepth_);
+  }
+
+  if (ancestorDepth <= stablePrefix_.size()) {
+    return false;
+  }
+  unsigned prefixSize = stablePrefix_.size();
+  stablePrefix_.resize(ancestorDepth);
+  for (unsigned i = ancestorDepth; i > prefixSize; --i) {
+    stablePrefix_[i - 1] = ancestor->GetWord();
+    ancestor = ancestor->GetPrevHyp();
+  }
+  return true;
+}
+
 NBestList History::NBest(unsigned n) const
 {
   NBestList nbest;
@@ -46,12 +46,28 @@ class History {
     unsigned GetLineNum() const
     { return lineNo_; }
 
+    // Target words that every hypothesis which can still become Top() starts
+    // with: the common ancestor of the hypotheses in the last beam and of the
+    // best one that has finished. Call after every Add(); returns true if the
+    // prefix grew.
+    bool UpdateStablePrefix();
+
+    const Words& GetStablePrefix() const
+    { return stablePrefix_; }
+
   private:
     std::vector<Beam> history_;
     std::priority_queue<HypothesisCoord> topHyps_;
     bool normalize_;
     unsigned lineNo_;
     unsigned maxLength_;
+
+    Words stablePrefix_;
+    unsigned stableSteps_;
+    // best finished hypothesis, without its </s>; the others can't become Top()
+    HypothesisPtr finished_;
+    unsigned finishedDepth_;
+    float finishedCost_;
 };
 
 
@@ -0,0 +1,118 @@
+#include "common/input_pipeline.h"
+
+#include <unordered_map>
+
+#include "common/god.h"
+#include "common/sentence.h"
+#include "common/profiler.h"
+#include "common/tracer.h"
+
+using namespace std;
+
+namespace amunmt {
+
+InputPipeline::InputPipeline(const God &god, LineSource source, CacheHit cacheHit)
+  : god_(god),
+    source_(source),
+    cacheHit_(cacheHit),
+    // the CPU decoder translates one sentence at a time
+    miniSize_((god.GetOptions().cpuThreads == 0) ? god.GetOptions().miniBatch : 1),
+    maxiSize_((god.GetOptions().cpuThreads == 0) ? god.GetOptions().maxiBatch : 1),
+    miniWords_(god.GetOptions().miniBatchWords),
+    preprocessPool_(god.GetOptions().preprocessThreads,
+                    2 * maxiSize_ + 2 * god.GetOptions().preprocessThreads),
+    // let the reader run up to a maxi-batch ahead of the batching stage
+    sentences_(2 * maxiSize_ + 2 * god.GetOptions().preprocessThreads),
+    maxiBatch_(new Sentences())
+{
+  reader_ = std::thread(&InputPipeline::Read, this);
+}
+
+InputPipeline::~InputPipeline()
+{
+  // unblocks the reader if the consumer stopped before the end of the input
+  sentences_.Close();
+  reader_.join();
+}
+
+void InputPipeline::Read()
+{
+  Tracer::SetThreadName("reader");
+  std::string line;
+  unsigned lineNum = 0;
+
+  while (source_(line)) {
+    auto read = std::chrono::steady_clock::now();
+    god_.GetMetrics().SentenceStarted();
+    auto sentence = preprocessPool_.enqueue(
+        [this, lineNum, read](const std::string& line) {
+          ProfileScope profile(Profiler::PREPROCESS);
+          TraceScope trace("Sentence", "preprocess", "line", lineNum);
+          SentencePtr sentence(new Sentence(god_, lineNum, line));
+          sentence->GetTimestamps().read = read;
+          return sentence;
+        }, std::move(line));
+
+    if (!sentences_.Push(std::move(sentence))) {
+      break;
+    }
+    ++lineNum;
+  }
+
+  sentences_.Close();
+}
+
+bool InputPipeline::FillMaxiBatch()
+{
+  maxiBatch_.reset(new Sentences());
+
+  TranslationCache& cache = god_.GetTranslationCache();
+  bool useCache = cacheHit_ && cache.Enabled();
+  // first sentence of the maxi-batch with each key
+  std::unordered_map<std::string, SentencePtr> unique;
+
+  std::future<SentencePtr> next;
+  while (maxiBatch_->size() < maxiSize_ && sentences_.Pop(next)) {
+    SentencePtr sentence = next.get();
+    if (useCache) {
+      std::string key = cache.GetKey(*sentence);
+      sentence->SetCacheKey(key);
+      auto it = unique.find(key);
+      if (it != unique.end()) {
+        it->second->GetDuplicates().push_back(sentence);
+        cache.CountDuplicate();
+        continue;
+      }
+
+      TranslationCache::Entry entry;
+      if (cache.Get(key, entry)) {
+        auto now = std::chrono::steady_clock::now();
+        sentence->GetTimestamps().enqueued = now;
+        sentence->GetTimestamps().decodeStart = now;
+        cacheHit_(sentence, entry);
+        continue;
+      }
+      unique.emplace(std::move(key), sentence);
+    }
+    maxiBatch_->push_back(sentence);
+  }
+
+  maxiBatch_->SortByLength();
+  return maxiBatch_->size() > 0;
+}
+
+SentencesPtr InputPipeline::NextMiniBatch()
+{
+  if (maxiBatch_->size() == 0 && !FillMaxiBatch()) {
+    return nullptr;
+  }
+  SentencesPtr miniBatch = maxiBatch_->NextMiniBatch(miniSize_, miniWords_);
+
+  auto enqueued = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < miniBatch->size(); ++i) {
+    miniBatch->at(i)->GetTimestamps().enqueued = enqueued;
+  }
+  return miniBatch;
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <future>
+#include <functional>
+
+#include "common/sentences.h"
+#include "common/threadpool.h"
+#include "common/bounded_queue.h"
+#include "common/translation_cache.h"
+
+namespace amunmt {
+
+class God;
+
+// Front end of the decoder: a reader thread pulls lines from a source, a pool
+// of threads turns them into Sentences (tokenization, BPE, vocabulary lookup)
+// and the consumer receives length-sorted mini-batches formed from maxi-batch
+// windows. Line numbers are assigned in input order by the reader.
+//
+// Consumers that can take translations from the translation cache pass a
+// CacheHit; then repeated sentences never reach a mini-batch, and repeats
+// within a maxi-batch ride along as duplicates of the first one.
+class InputPipeline {
+  public:
+    // fills the string with the next line, returns false at the end of the input
+    typedef std::function<bool(std::string&)> LineSource;
+    typedef std::function<void(const SentencePtr&, const TranslationCache::Entry&)> CacheHit;
+
+    InputPipeline(const God &god, LineSource source, CacheHit cacheHit = nullptr);
+    ~InputPipeline();
+
+    // next mini-batch, or nullptr once the input has been exhausted
+    SentencesPtr NextMiniBatch();
+
+    unsigned GetMiniBatchSize() const
+    { return miniSize_; }
+
+    unsigned GetMaxiBatchSize() const
+    { return maxiSize_; }
+
+  private:
+    void Read();
+    bool FillMaxiBatch();
+
+    const God &god_;
+    LineSource source_;
+    CacheHit cacheHit_;
+
+    unsigned miniSize_;
+    unsigned maxiSize_;
+    int miniWords_;
+
+    ThreadPool preprocessPool_;
+    BoundedQueue<std::future<SentencePtr>> sentences_;
+    SentencesPtr maxiBatch_;
+
+    std::thread reader_;
+
+    InputPipeline(const InputPipeline&) = delete;
+};
+
+}
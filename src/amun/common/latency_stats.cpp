@@ -0,0 +1,187 @@
+#include "common/latency_stats.h"
+
+#include <sstream>
+#include <iomanip>
+
+#include "common/logging.h"
+#include "common/sentence.h"
+
+namespace amunmt {
+
+LatencyHistogram::LatencyHistogram()
+  : count_(0), sum_(0), max_(0)
+{
+  for (auto& count : counts_) {
+    count = 0;
+  }
+}
+
+unsigned LatencyHistogram::Bucket(uint64_t value) {
+  if (value < SUB_COUNT) {
+    return value;
+  }
+  unsigned shift = (63 - __builtin_clzll(value)) - SUB_BITS;
+  return (shift + 1) * SUB_COUNT + ((value >> shift) & (SUB_COUNT - 1));
+}
+
+uint64_t LatencyHistogram::BucketMax(unsigned bucket) {
+  if (bucket < SUB_COUNT) {
+    return bucket;
+  }
+  unsigned shift = bucket / SUB_COUNT - 1;
+  uint64_t lower = uint64_t(SUB_COUNT + bucket % SUB_COUNT) << shift;
+  return lower + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t micros) {
+  counts_[Bucket(micros)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(micros, std::memory_order_relaxed);
+
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (micros > max && !max_.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {}
+}
+
+uint64_t LatencyHistogram::Count() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() const {
+  return max_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const {
+  uint64_t count = Count();
+  return count ? double(sum_.load(std::memory_order_relaxed)) / count : 0.0;
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const {
+  // the buckets may be updated while we walk them, so the total is taken
+  // from the buckets themselves
+  uint64_t total = 0;
+  for (auto& count : counts_) {
+    total += count.load(std::memory_order_relaxed);
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = std::max<uint64_t>(1, uint64_t(p / 100.0 * total + 0.5));
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+    seen += counts_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return std::min(BucketMax(i), Max());
+    }
+  }
+  return Max();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+LatencyStats::LatencyStats()
+  : sentences_(0),
+    sourceTokens_(0),
+    targetTokens_(0),
+    created_(Clock::now()),
+    lastReport_(created_),
+    lastSentences_(0),
+    lastTargetTokens_(0),
+    stopped_(true)
+{}
+
+LatencyStats::~LatencyStats()
+{
+  Stop();
+}
+
+const char* LatencyStats::GetStageName(Stage stage) {
+  static const char* names[NUM_STAGES] = { "batch", "queue", "decode", "total" };
+  return names[stage];
+}
+
+void LatencyStats::Record(const Sentence& sentence, unsigned targetTokens) {
+  const Sentence::Timestamps& times = sentence.GetTimestamps();
+  // sentences that did not come through the input pipeline
+  if (times.read == Clock::time_point()) {
+    return;
+  }
+
+  auto micros = [](Clock::time_point start, Clock::time_point end) -> uint64_t {
+    return (end > start) ? std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
+                         : 0;
+  };
+
+  Clock::time_point output = Clock::now();
+  histograms_[BATCH].Record(micros(times.read, times.enqueued));
+  histograms_[QUEUE].Record(micros(times.enqueued, times.decodeStart));
+  histograms_[DECODE].Record(micros(times.decodeStart, output));
+  histograms_[TOTAL].Record(micros(times.read, output));
+
+  sentences_.fetch_add(1, std::memory_order_relaxed);
+  sourceTokens_.fetch_add(sentence.size(), std::memory_order_relaxed);
+  targetTokens_.fetch_add(targetTokens, std::memory_order_relaxed);
+}
+
+double LatencyStats::Elapsed() const {
+  return std::chrono::duration<double>(Clock::now() - created_).count();
+}
+
+std::string LatencyStats::Report() {
+  Clock::time_point now = Clock::now();
+  double seconds = std::chrono::duration<double>(now - lastReport_).count();
+  uint64_t sentences = Sentences();
+  uint64_t targetTokens = TargetTokens();
+
+  std::stringstream strm;
+  strm << std::fixed << std::setprecision(1)
+       << "Latency stats: " << sentences << " sentences, "
+       << (seconds > 0 ? (sentences - lastSentences_) / seconds : 0.0) << " sent/s, "
+       << (seconds > 0 ? (targetTokens - lastTargetTokens_) / seconds : 0.0) << " target tok/s";
+
+  for (unsigned i = 0; i < NUM_STAGES; ++i) {
+    const LatencyHistogram& histogram = histograms_[i];
+    strm << " | " << GetStageName(Stage(i))
+         << " p50 " << histogram.Percentile(50) / 1000.0
+         << " p95 " << histogram.Percentile(95) / 1000.0
+         << " p99 " << histogram.Percentile(99) / 1000.0
+         << " max " << histogram.Max() / 1000.0;
+  }
+  strm << " (ms)";
+
+  lastReport_ = now;
+  lastSentences_ = sentences;
+  lastTargetTokens_ = targetTokens;
+  return strm.str();
+}
+
+void LatencyStats::Start(unsigned interval) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (interval == 0 || !stopped_) {
+    return;
+  }
+  stopped_ = false;
+  reporter_ = std::thread(&LatencyStats::Run, this, interval);
+}
+
+void LatencyStats::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+  }
+  stop_.notify_all();
+  reporter_.join();
+  LOG(progress)->info(Report());
+}
+
+void LatencyStats::Run(unsigned interval) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_.wait_for(lock, std::chrono::seconds(interval), [this] { return stopped_; })) {
+    LOG(progress)->info(Report());
+  }
+}
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <condition_variable>
+
+namespace amunmt {
+
+class Sentence;
+
+// Lock-free histogram of durations in microseconds. Buckets are laid out as in
+// HdrHistogram: 16 linear sub-buckets per power of two, so any percentile is
+// reported within 1/16 of the recorded value at a fixed memory cost.
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void Record(uint64_t micros);
+
+    uint64_t Count() const;
+    uint64_t Max() const;
+    double Mean() const;
+
+    // smallest value that at least p percent of the recorded values are below
+    uint64_t Percentile(double p) const;
+
+  private:
+    static const unsigned SUB_BITS = 4;
+    static const unsigned SUB_COUNT = 1 << SUB_BITS;
+    static const unsigned NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    static unsigned Bucket(uint64_t value);
+    static uint64_t BucketMax(unsigned bucket);
+
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> counts_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+// Per-sentence latencies and throughput of the decoder, split at the
+// timestamps a sentence collects on its way through the pipeline
+// (see Sentence::Timestamps). Recording never blocks; a reporter thread can
+// print a summary through the progress logger at a fixed interval.
+class LatencyStats {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Stage {
+      BATCH,   // read to enqueued in a mini-batch
+      QUEUE,   // enqueued to start of decoding
+      DECODE,  // start of decoding to output
+      TOTAL,   // read to output
+      NUM_STAGES
+    };
+
+    LatencyStats();
+    ~LatencyStats();
+
+    static const char* GetStageName(Stage stage);
+
+    // records a translated sentence at output time
+    void Record(const Sentence& sentence, unsigned targetTokens);
+
+    const LatencyHistogram& Get(Stage stage) const
+    { return histograms_[stage]; }
+
+    uint64_t Sentences() const
+    { return sentences_; }
+
+    uint64_t SourceTokens() const
+    { return sourceTokens_; }
+
+    uint64_t TargetTokens() const
+    { return targetTokens_; }
+
+    // seconds since the statistics were created
+    double Elapsed() const;
+
+    // one line summary, rates are computed over the time since the last call
+    std::string Report();
+
+    // logs Report() every interval seconds until Stop(), which logs a last one
+    void Start(unsigned interval);
+    void Stop();
+
+  private:
+    void Run(unsigned interval);
+
+    std::array<LatencyHistogram, NUM_STAGES> histograms_;
+    std::atomic<uint64_t> sentences_;
+    std::atomic<uint64_t> sourceTokens_;
+    std::atomic<uint64_t> targetTokens_;
+
+    Clock::time_point created_;
+
+    Clock::time_point lastReport_;
+    uint64_t lastSentences_;
+    uint64_t lastTargetTokens_;
+
+    std::thread reporter_;
+    std::mutex mutex_;
+    std::condition_variable stop_;
+    bool stopped_;
+};
+
+}
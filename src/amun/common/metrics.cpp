@@ -0,0 +1,320 @@
+#include "common/metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common/god.h"
+#include "common/exception.h"
+#include "common/latency_stats.h"
+#include "common/output_collector.h"
+#include "common/translation_cache.h"
+
+namespace amunmt {
+
+namespace {
+
+void Append(std::string& out, const std::string& name, const std::string& type,
+            const std::string& help, double value) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.17g", value);
+  out += "# HELP " + name + " " + help + "\n";
+  out += "# TYPE " + name + " " + type + "\n";
+  out += name + " " + buf + "\n";
+}
+
+const time_t CLIENT_TIMEOUT_SECONDS = 1;
+const size_t MAX_REQUEST_BYTES = 16384;
+
+size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+}
+
+MetricsHistogram::MetricsHistogram(std::vector<uint64_t> bounds)
+  : bounds_(bounds),
+    counts_(new std::atomic<uint64_t>[bounds.size() + 1]),
+    sum_(0)
+{
+  for (size_t i = 0; i <= bounds_.size(); ++i) {
+    counts_[i] = 0;
+  }
+}
+
+void MetricsHistogram::Observe(uint64_t value) {
+  size_t i = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  counts_[i].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+void MetricsHistogram::Write(std::string& out, const std::string& name,
+                             const std::string& help) const {
+  out += "# HELP " + name + " " + help + "\n";
+  out += "# TYPE " + name + " histogram\n";
+
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= bounds_.size(); ++i) {
+    cumulative += counts_[i].load(std::memory_order_relaxed);
+    std::string le = (i < bounds_.size()) ? std::to_string(bounds_[i]) : "+Inf";
+    out += name + "_bucket{le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+  }
+  out += name + "_sum " + std::to_string(sum_.load(std::memory_order_relaxed)) + "\n";
+  out += name + "_count " + std::to_string(cumulative) + "\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Metrics::Metrics()
+  : inFlight_(0),
+    searches_(0),
+    sentences_(0),
+    steps_(0),
+    batchSize_({1, 2, 4, 8, 16, 32, 64, 128, 256}),
+    beamOccupancy_({10, 20, 30, 40, 50, 60, 70, 80, 90, 100}),
+    decodeSteps_({5, 10, 20, 50, 100, 200, 500, 1000}),
+    shortlistSize_({100, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000}),
+    god_(nullptr),
+    stopped_(true)
+{}
+
+Metrics::~Metrics()
+{
+  Stop();
+}
+
+void Metrics::CountSearch(unsigned batchSize, unsigned steps) {
+  searches_.fetch_add(1, std::memory_order_relaxed);
+  sentences_.fetch_add(batchSize, std::memory_order_relaxed);
+  steps_.fetch_add(steps, std::memory_order_relaxed);
+  batchSize_.Observe(batchSize);
+  for (unsigned i = 0; i < batchSize; ++i) {
+    decodeSteps_.Observe(steps);
+  }
+}
+
+std::string Metrics::Render(const God &god) const {
+  std::string out;
+
+  Append(out, "amun_sentences_in_flight", "gauge",
+         "Sentences read but not written out yet", inFlight_.load(std::memory_order_relaxed));
+
+  ThreadPoolState pool = god.GetThreadPoolState();
+  Append(out, "amun_threadpool_threads", "gauge", "Decoder threads", pool.threads);
+  Append(out, "amun_threadpool_busy_threads", "gauge", "Decoder threads running a task", pool.busy);
+  Append(out, "amun_threadpool_queued_tasks", "gauge", "Tasks waiting for a decoder thread", pool.queued);
+
+  Append(out, "amun_model_version", "gauge",
+         "Version of the models new batches are decoded with, counting reloads", god.GetModelsVersion());
+
+  Append(out, "amun_searches_total", "counter", "Batches searched", searches_.load(std::memory_order_relaxed));
+  Append(out, "amun_sentences_translated_total", "counter", "Sentences searched",
+         sentences_.load(std::memory_order_relaxed));
+  Append(out, "amun_decoder_steps_total", "counter", "Decoder steps of all batches",
+         steps_.load(std::memory_order_relaxed));
+
+  batchSize_.Write(out, "amun_batch_size", "Sentences per searched batch");
+  decodeSteps_.Write(out, "amun_decode_steps", "Decoder steps per sentence");
+  beamOccupancy_.Write(out, "amun_beam_occupancy_percent",
+                       "Hypotheses still alive after a beam search step, in percent of the beam size; "
+                       "forced decoding and sampling are not counted");
+  shortlistSize_.Write(out, "amun_shortlist_size", "Target words left by the vocabulary filter per batch");
+
+  const OutputCollector& output = god.GetOutputCollector();
+  Append(out, "amun_output_sentences_total", "counter", "Translations written",
+         output.GetWrittenSentences());
+  Append(out, "amun_output_bytes_total", "counter", "Bytes of translations written",
+         output.GetWrittenBytes());
+  Append(out, "amun_output_reorder_pending", "gauge",
+         "Translations waiting for an earlier sentence to be written", output.GetPending());
+
+  const TranslationCache& cache = god.GetTranslationCache();
+  Append(out, "amun_cache_hits_total", "counter", "Sentences answered from the translation cache", cache.Hits());
+  Append(out, "amun_cache_misses_total", "counter", "Sentences not found in the translation cache", cache.Misses());
+  Append(out, "amun_cache_duplicates_total", "counter",
+         "Sentences answered by an identical sentence of the same maxi-batch", cache.Duplicates());
+  Append(out, "amun_cache_evictions_total", "counter", "Translations evicted from the cache", cache.Evictions());
+  Append(out, "amun_cache_entries", "gauge", "Translations in the cache", cache.Size());
+  Append(out, "amun_cache_capacity", "gauge", "Capacity of the cache (--cache-size)", cache.Capacity());
+
+  const LatencyStats& latency = god.GetLatencyStats();
+  Append(out, "amun_source_tokens_total", "counter", "Source tokens translated", latency.SourceTokens());
+  Append(out, "amun_target_tokens_total", "counter", "Target tokens produced", latency.TargetTokens());
+
+  out += "# HELP amun_latency_seconds Per-sentence latency by pipeline stage\n";
+  out += "# TYPE amun_latency_seconds summary\n";
+  for (unsigned i = 0; i < LatencyStats::NUM_STAGES; ++i) {
+    LatencyStats::Stage stage = LatencyStats::Stage(i);
+    const LatencyHistogram& histogram = latency.Get(stage);
+    std::string labels = std::string("stage=\"") + LatencyStats::GetStageName(stage) + "\"";
+    for (double q : {0.5, 0.95, 0.99}) {
+      char buf[128];
+      snprintf(buf, sizeof(buf), "amun_latency_seconds{%s,quantile=\"%g\"} %g\n",
+               labels.c_str(), q, histogram.Percentile(100 * q) / 1e6);
+      out += buf;
+    }
+    char buf[128];
+    snprintf(buf, sizeof(buf), "amun_latency_seconds_sum{%s} %g\n", labels.c_str(),
+             histogram.Mean() * histogram.Count() / 1e6);
+    out += buf;
+    out += "amun_latency_seconds_count{" + labels + "} " + std::to_string(histogram.Count()) + "\n";
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  Append(out, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes", ResidentBytes());
+  Append(out, "process_max_resident_memory_bytes", "gauge", "Peak resident memory size in bytes",
+         usage.ru_maxrss * 1024.0);
+  Append(out, "process_uptime_seconds", "gauge", "Seconds since the decoder started", latency.Elapsed());
+
+  return out;
+}
+
+void Metrics::Start(const God &god) {
+  god_ = &god;
+  unsigned port = god.Get<unsigned>("metrics-port");
+  bool dump = god.Has("metrics-file");
+  if (!port && !dump) {
+    return;
+  }
+  stopped_ = false;
+
+  if (port) {
+    std::string address = god.Get<std::string>("metrics-address");
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    amunmt_UTIL_THROW_IF2(inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1,
+                          "Not an IPv4 address: " << address);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    amunmt_UTIL_THROW_IF2(fd < 0, "Could not serve metrics on port " << port << ": " << strerror(errno));
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+      int error = errno;
+      close(fd);
+      amunmt_UTIL_THROW2("Could not serve metrics on port " << port << ": " << strerror(error));
+    }
+    LOG(info)->info("Serving metrics on {}:{}", address, port);
+    exporters_.emplace_back(&Metrics::Serve, this, fd);
+  }
+
+  if (dump) {
+    exporters_.emplace_back(&Metrics::Dump, this, god.Get<std::string>("metrics-file"),
+                            god.Get<unsigned>("metrics-interval"));
+  }
+}
+
+void Metrics::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+  }
+  stop_.notify_all();
+  for (auto& exporter : exporters_) {
+    exporter.join();
+  }
+  exporters_.clear();
+}
+
+void Metrics::Serve(int fd) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopped_) {
+        break;
+      }
+    }
+
+    pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 200) <= 0) {
+      continue;
+    }
+    int client = accept(fd, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+
+    // the exporter serves one client at a time, so a client gets a second
+    // to send its request and to take the response
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(CLIENT_TIMEOUT_SECONDS);
+    timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // every request gets the metrics, whatever its path
+    std::string request;
+    char chunk[4096];
+    bool complete = false;
+    while (!complete && request.size() < MAX_REQUEST_BYTES) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      pollfd cpfd = { client, POLLIN, 0 };
+      if (left.count() <= 0 || poll(&cpfd, 1, left.count()) <= 0) {
+        break;
+      }
+      ssize_t n = recv(client, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        break;
+      }
+      request.append(chunk, n);
+      complete = request.find("\n\r\n") != std::string::npos || request.find("\n\n") != std::string::npos;
+    }
+    if (!complete) {
+      close(client);
+      continue;
+    }
+
+    std::string body = Render(*god_);
+    std::string response = "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+      ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      sent += n;
+    }
+    close(client);
+  }
+  close(fd);
+}
+
+void Metrics::Dump(const std::string& path, unsigned interval) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool last = false;
+  while (!last) {
+    last = stop_.wait_for(lock, std::chrono::seconds(std::max(interval, 1u)),
+                          [this] { return stopped_; });
+    // Serve() takes the mutex on every poll, scrapes don't wait for the file
+    lock.unlock();
+
+    // written to a temporary file first, so readers never see half of it
+    std::string tmp = path + ".tmp";
+    {
+      std::ofstream out(tmp);
+      out << Render(*god_);
+    }
+    std::rename(tmp.c_str(), path.c_str());
+    lock.lock();
+  }
+}
+
+}
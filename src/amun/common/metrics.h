@@ -0,0 +1,84 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+namespace amunmt {
+
+class God;
+
+// Prometheus histogram with fixed bucket bounds, updated lock-free.
+class MetricsHistogram {
+  public:
+    MetricsHistogram(std::vector<uint64_t> bounds);
+
+    void Observe(uint64_t value);
+
+    // appends the _bucket, _sum and _count series in Prometheus text format
+    void Write(std::string& out, const std::string& name, const std::string& help) const;
+
+  private:
+    std::vector<uint64_t> bounds_;
+    // one more than bounds_ for +Inf
+    std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+    std::atomic<uint64_t> sum_;
+};
+
+// Counters of a long-running decoder for monitoring. The decoder updates
+// them with relaxed atomics; Render() gathers them together with the state
+// of the thread pool and output collector in Prometheus text format, which
+// is served over HTTP (--metrics-port, on the loopback address unless
+// --metrics-address says otherwise) or written to a file at an interval
+// (--metrics-file).
+class Metrics {
+  public:
+    Metrics();
+    ~Metrics();
+
+    // a sentence entered or left the decoder
+    void SentenceStarted()
+    { inFlight_.fetch_add(1, std::memory_order_relaxed); }
+    void SentenceFinished()
+    { inFlight_.fetch_sub(1, std::memory_order_relaxed); }
+
+    void CountSearch(unsigned batchSize, unsigned steps);
+    // after a step of beam search; forced decoding and sampling have no beam
+    void CountBeamOccupancy(unsigned alive, unsigned beamSize)
+    { beamOccupancy_.Observe(100 * alive / beamSize); }
+    void CountShortlist(unsigned size)
+    { shortlistSize_.Observe(size); }
+
+    std::string Render(const God &god) const;
+
+    // starts the exporters requested in the options of god
+    void Start(const God &god);
+    void Stop();
+
+  private:
+    void Serve(int fd);
+    void Dump(const std::string& path, unsigned interval);
+
+    std::atomic<int64_t> inFlight_;
+    std::atomic<uint64_t> searches_;
+    std::atomic<uint64_t> sentences_;
+    std::atomic<uint64_t> steps_;
+
+    MetricsHistogram batchSize_;
+    MetricsHistogram beamOccupancy_;
+    MetricsHistogram decodeSteps_;
+    MetricsHistogram shortlistSize_;
+
+    const God *god_;
+    std::vector<std::thread> exporters_;
+    std::mutex mutex_;
+    std::condition_variable stop_;
+    bool stopped_;
+};
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace amunmt {
+
+// Unbounded lock-free queue for many producers and a single consumer
+// (D. Vyukov's intrusive MPSC queue). Push() never blocks; Pop() must only be
+// called from one thread at a time.
+template <class T>
+class MPSCQueue {
+  public:
+    MPSCQueue()
+      : head_(new Node()), tail_(head_.load())
+    {}
+
+    MPSCQueue(const MPSCQueue&) = delete;
+
+    ~MPSCQueue() {
+      T item;
+      while (Pop(item)) {}
+      delete tail_;
+    }
+
+    void Push(T item) {
+      Node* node = new Node(std::move(item));
+      Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+      prev->next.store(node);
+    }
+
+    // returns false if the queue is empty. A producer in the middle of a
+    // Push() may briefly make the queue look empty
+    bool Pop(T& item) {
+      Node* next = tail_->next.load();
+      if (next == nullptr) {
+        return false;
+      }
+      item = std::move(next->item);
+      delete tail_;
+      tail_ = next;
+      return true;
+    }
+
+    bool Empty() const {
+      return tail_->next.load() == nullptr;
+    }
+
+  private:
+    struct Node {
+      Node() : next(nullptr) {}
+      explicit Node(T&& item) : next(nullptr), item(std::move(item)) {}
+
+      std::atomic<Node*> next;
+      T item;
+    };
+
+    std::atomic<Node*> head_;
+    Node* tail_;
+};
+
+}
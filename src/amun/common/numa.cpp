@@ -0,0 +1,129 @@
+#include "common/numa.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <boost/filesystem.hpp>
+
+#include "common/logging.h"
+
+namespace amunmt {
+
+namespace {
+
+// from <numaif.h>, which is only there with libnuma
+const int MPOL_DEFAULT_POLICY = 0;
+const int MPOL_INTERLEAVE_POLICY = 3;
+
+// parses lists like "0-3,8-11"
+std::vector<unsigned> ParseCpuList(const std::string& list) {
+  std::vector<unsigned> cpus;
+  std::stringstream strm(list);
+  std::string range;
+  while (std::getline(strm, range, ',')) {
+    if (range.empty() || !isdigit(range[0])) {
+      continue;
+    }
+    size_t dash = range.find('-');
+    unsigned first = std::stoul(range.substr(0, dash));
+    unsigned last = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+    for (unsigned cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}
+
+const NumaTopology& NumaTopology::Get()
+{
+  static NumaTopology topology;
+  return topology;
+}
+
+NumaTopology::NumaTopology()
+{
+  namespace fs = boost::filesystem;
+  boost::system::error_code ec;
+  std::vector<unsigned> ids;
+  for (fs::directory_iterator it("/sys/devices/system/node", ec), end; !ec && it != end; ++it) {
+    std::string name = it->path().filename().string();
+    if (name.size() > 4 && name.compare(0, 4, "node") == 0 && isdigit(name[4])) {
+      ids.push_back(std::stoul(name.substr(4)));
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+
+  for (unsigned id : ids) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+    std::string list;
+    std::getline(file, list);
+    std::vector<unsigned> cpus = ParseCpuList(list);
+    // nodes with memory only don't run decoder threads
+    if (!cpus.empty()) {
+      nodeIds_.push_back(id);
+      cpus_.push_back(cpus);
+    }
+  }
+
+  if (cpus_.empty()) {
+    std::vector<unsigned> cpus;
+    for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu) {
+      cpus.push_back(cpu);
+    }
+    nodeIds_.push_back(0);
+    cpus_.push_back(cpus);
+  }
+}
+
+unsigned NumaTopology::GetNode(unsigned threadInd, unsigned numThreads) const
+{
+  return (unsigned long long)threadInd * GetNumNodes() / std::max(numThreads, 1u);
+}
+
+unsigned NumaTopology::GetCpu(unsigned threadInd, unsigned numThreads) const
+{
+  unsigned node = GetNode(threadInd, numThreads);
+  // first thread of the node's group
+  unsigned first = ((unsigned long long)node * numThreads + GetNumNodes() - 1) / GetNumNodes();
+  const std::vector<unsigned>& cpus = cpus_[node];
+  return cpus[(threadInd - first) % cpus.size()];
+}
+
+void PinThread(const std::vector<unsigned>& cpus)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    LOG(info)->warn("Could not pin thread to {} CPUs", cpus.size());
+  }
+}
+
+void InterleaveMemory(bool enable)
+{
+  const NumaTopology& topology = NumaTopology::Get();
+  unsigned long mask = 0;
+  for (unsigned node = 0; node < topology.GetNumNodes(); ++node) {
+    if (topology.GetNodeId(node) < 8 * sizeof(mask)) {
+      mask |= 1UL << topology.GetNodeId(node);
+    }
+  }
+
+  long ret = enable
+      ? syscall(SYS_set_mempolicy, MPOL_INTERLEAVE_POLICY, &mask, 8 * sizeof(mask))
+      : syscall(SYS_set_mempolicy, MPOL_DEFAULT_POLICY, nullptr, 0);
+  if (ret != 0) {
+    LOG(info)->warn("Could not set the NUMA memory policy");
+  }
+}
+
+}
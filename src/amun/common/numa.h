@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+namespace amunmt {
+
+// NUMA nodes of the machine and their CPUs, read from /sys. Machines without
+// NUMA information look like a single node with all online CPUs.
+class NumaTopology {
+  public:
+    static const NumaTopology& Get();
+
+    unsigned GetNumNodes() const
+    { return cpus_.size(); }
+
+    const std::vector<unsigned>& GetCpus(unsigned node) const
+    { return cpus_[node]; }
+
+    // number of the node in /sys
+    unsigned GetNodeId(unsigned node) const
+    { return nodeIds_[node]; }
+
+    // node and CPU of decoder thread threadInd of numThreads: threads are
+    // split into contiguous groups, one per node, and spread over its CPUs
+    unsigned GetNode(unsigned threadInd, unsigned numThreads) const;
+    unsigned GetCpu(unsigned threadInd, unsigned numThreads) const;
+
+  private:
+    NumaTopology();
+
+    std::vector<unsigned> nodeIds_;
+    std::vector<std::vector<unsigned>> cpus_;
+};
+
+// restricts the calling thread to cpus
+void PinThread(const std::vector<unsigned>& cpus);
+
+// while enabled, pages first touched by the calling thread are spread
+// round-robin over all nodes instead of coming from the local node
+void InterleaveMemory(bool enable);
+
+// interleaves the pages first touched by the calling thread for its lifetime,
+// also when the scope is left by an exception
+class InterleavedMemoryScope {
+  public:
+    InterleavedMemoryScope()
+    { InterleaveMemory(true); }
+
+    ~InterleavedMemoryScope()
+    { InterleaveMemory(false); }
+
+    InterleavedMemoryScope(const InterleavedMemoryScope&) = delete;
+    InterleavedMemoryScope& operator=(const InterleavedMemoryScope&) = delete;
+};
+
+}
@@ -0,0 +1,74 @@
+#include "common/options.h"
+
+#include <string>
+#include <vector>
+
+#include "common/config.h"
+
+namespace amunmt {
+
+Options::Options()
+  : beamSize(12),
+    normalize(false),
+    allowUnk(false),
+    nBest(false),
+    softmaxFilter(false),
+    sampling(false),
+    samplingTopK(0),
+    samplingTopP(1.0),
+    samplingTemperature(1.0),
+    samplingSeed(1234),
+    maxLength(500),
+    miniBatch(1),
+    maxiBatch(1),
+    miniBatchWords(0),
+    preprocessThreads(1),
+    wipo(false),
+    returnAlignment(false),
+    returnSoftAlignment(false),
+    returnNematusAlignment(false),
+    lineBuffered(false),
+    stablePrefix(false),
+    cpuThreads(0),
+    gpuThreads(0),
+    tensorCores(false)
+{}
+
+Options::Options(const Config& config)
+  : Options()
+{
+  beamSize = config.Get<unsigned>("beam-size");
+  normalize = config.Get<bool>("normalize");
+  allowUnk = config.Get<bool>("allow-unk");
+  nBest = config.Get<bool>("n-best");
+  softmaxFilter = config.Get<std::vector<std::string>>("softmax-filter").size();
+
+  sampling = config.Get<bool>("sampling");
+  samplingTopK = config.Get<unsigned>("sampling-top-k");
+  samplingTopP = config.Get<float>("sampling-top-p");
+  samplingTemperature = config.Get<float>("sampling-temperature");
+  samplingSeed = config.Get<unsigned>("sampling-seed");
+
+  maxLength = config.Get<unsigned>("max-length");
+  miniBatch = config.Get<unsigned>("mini-batch");
+  maxiBatch = config.Get<unsigned>("maxi-batch");
+  miniBatchWords = config.Get<int>("mini-batch-words");
+  preprocessThreads = config.Get<unsigned>("preprocess-threads");
+
+  wipo = config.Get<bool>("wipo");
+  returnAlignment = config.Get<bool>("return-alignment");
+  returnSoftAlignment = config.Get<bool>("return-soft-alignment");
+  returnNematusAlignment = config.Get<bool>("return-nematus-alignment");
+  lineBuffered = config.Get<bool>("line-buffered");
+  stablePrefix = config.Get<bool>("stable-prefix");
+
+#ifdef HAS_CPU
+  cpuThreads = config.Get<unsigned>("cpu-threads");
+#endif
+#ifdef CUDA
+  gpuThreads = config.Get<unsigned>("gpu-threads");
+  tensorCores = config.Get<bool>("tensor-cores");
+#endif
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+namespace amunmt {
+
+class Config;
+
+// Typed snapshot of the options used while translating, resolved once in
+// God::Init. Code that runs per sentence or per decoder step reads these
+// instead of going through God::Get, which does a YAML lookup and conversion.
+struct Options {
+  Options();
+  explicit Options(const Config& config);
+
+  // search
+  unsigned beamSize;
+  bool normalize;
+  bool allowUnk;
+  bool nBest;
+  bool softmaxFilter;
+
+  // sampling search
+  bool sampling;
+  unsigned samplingTopK;
+  float samplingTopP;
+  float samplingTemperature;
+  unsigned samplingSeed;
+
+  // input
+  unsigned maxLength;
+  unsigned miniBatch;
+  unsigned maxiBatch;
+  int miniBatchWords;
+  unsigned preprocessThreads;
+
+  // output
+  bool wipo;
+  bool returnAlignment;
+  bool returnSoftAlignment;
+  bool returnNematusAlignment;
+  bool lineBuffered;
+  bool stablePrefix;
+
+  // devices, 0 if the build has no support for them
+  unsigned cpuThreads;
+  unsigned gpuThreads;
+  bool tensorCores;
+
+  bool ReturnAttentionWeights() const {
+    return returnAlignment || returnSoftAlignment || returnNematusAlignment;
+  }
+};
+
+}
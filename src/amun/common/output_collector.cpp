@@ -1,58 +1,211 @@
 #include <cassert>
+#include <algorithm>
 #include "output_collector.h"
 #include "logging.h"
+#include "profiler.h"
+#include "tracer.h"
 
 using namespace std;
 
 namespace amunmt {
 
+namespace {
+  const size_t INITIAL_REORDER_SIZE = 1024;
+  const size_t BUFFER_SIZE = 1 << 20;
+}
+
 OutputCollector::OutputCollector()
- : nextId_(0),
-  outStrm_(&std::cout)
+ : outStrm_(&std::cout),
+   lineBuffered_(false),
+   framed_(false),
+   nextId_(0),
+   pending_(INITIAL_REORDER_SIZE),
+   isPending_(INITIAL_REORDER_SIZE, false),
+   sleeping_(false),
+   closed_(false),
+   writtenSentences_(0),
+   writtenBytes_(0),
+   numPending_(0)
+{
+  buffer_.reserve(BUFFER_SIZE);
+}
+
+OutputCollector::~OutputCollector()
+{
+  Close();
+}
+
+void OutputCollector::Start(bool lineBuffered, bool framed)
+{
+  lineBuffered_ = lineBuffered;
+  framed_ = framed;
+  writer_ = std::thread(&OutputCollector::Run, this);
+}
+
+void OutputCollector::Close()
 {
+  if (!writer_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  wakeUp_.notify_one();
+  writer_.join();
 }
 
 void OutputCollector::Write(long sourceId, const std::string& output)
 {
-  boost::mutex::scoped_lock lock(mutex_);
-  if (sourceId == nextId_) {
-    LOG(progress)->info("Best translation {} : {}", sourceId, output);
-    *outStrm_ << output << std::endl;
-    
-    ++nextId_;
+  Push({ sourceId, output, false });
+}
+
+void OutputCollector::WritePartial(long sourceId, const std::string& output)
+{
+  if (!framed_) {
+    Push({ sourceId, output, true });
+  }
+}
+
+void OutputCollector::Push(Output&& output)
+{
+  queue_.Push(std::move(output));
+
+  // only pay for the lock when the writer is waiting for work
+  if (sleeping_.load()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sleeping_ = false;
+    wakeUp_.notify_one();
+  }
+}
+
+void OutputCollector::Run()
+{
+  Tracer::SetThreadName("output");
+  Output output;
+  bool closed = false;
+  while (true) {
+    while (queue_.Pop(output)) {
+      Reorder(output);
+    }
 
-    Outputs::const_iterator iter, iterNext;
-    iter = outputs_.begin();
-    while (iter != outputs_.end()) {
-      long currId = iter->first;
+    if (closed) {
+      break;
+    }
 
-      if (currId == nextId_) {
-        // 1st element in the map is the next
-        const string &currOutput = iter->second;
-        LOG(progress)->info("Best translation {} : {}", currId, currOutput);
-        *outStrm_ << currOutput << std::endl;
+    // nothing to do, make what we have visible before going to sleep
+    {
+      ProfileScope profile(Profiler::OUTPUT);
+      Flush();
+    }
 
-        ++nextId_;
+    std::unique_lock<std::mutex> lock(mutex_);
+    sleeping_ = true;
+    if (queue_.Empty() && !closed_) {
+      wakeUp_.wait(lock, [this] { return !sleeping_ || closed_; });
+    }
+    sleeping_ = false;
+    // drain once more after the producers are done
+    closed = closed_;
+  }
+
+  {
+    ProfileScope profile(Profiler::OUTPUT);
+    Flush();
+  }
+  assert(std::find(isPending_.begin(), isPending_.end(), true) == isPending_.end());
+}
 
-        // delete current record, move iter on 1
-        iterNext = iter;
-        ++iterNext;
-        outputs_.erase(iter);
-        iter = iterNext;
+void OutputCollector::Reorder(Output& output)
+{
+  long sourceId = output.first;
+  ProfileScope profile(Profiler::OUTPUT);
+  TraceScope trace("Reorder", "output", "line", sourceId);
+  if (output.partial) {
+    // only the sentence everybody is waiting for
+    if (sourceId == nextId_) {
+      buffer_ += "PARTIAL: ";
+      buffer_ += output.second;
+      buffer_ += '\n';
+      Flush();
+    }
+    return;
+  }
+  if (sourceId != nextId_) {
+    assert(sourceId > nextId_);
+    if (size_t(sourceId - nextId_) >= pending_.size()) {
+      // too far ahead, grow the ring and move pending translations to their new slots
+      size_t size = pending_.size();
+      while (size_t(sourceId - nextId_) >= size) {
+        size *= 2;
       }
-      else {
-        // not the next. stop iterating
-        assert(nextId_ < currId);
-        break;
+
+      std::vector<std::string> pending(size);
+      std::vector<char> isPending(size, false);
+      for (long id = nextId_; id < nextId_ + long(pending_.size()); ++id) {
+        size_t slot = id % pending_.size();
+        if (isPending_[slot]) {
+          pending[id % size].swap(pending_[slot]);
+          isPending[id % size] = true;
+        }
       }
+      pending_.swap(pending);
+      isPending_.swap(isPending);
     }
 
-  }
-  else {
     // save for later
-    outputs_[sourceId] = output;
+    size_t slot = sourceId % pending_.size();
+    pending_[slot].swap(output.second);
+    isPending_[slot] = true;
+    ++numPending_;
+    return;
+  }
+
+  Append(sourceId, output.second);
+  ++nextId_;
+
+  size_t slot = nextId_ % pending_.size();
+  while (isPending_[slot]) {
+    Append(nextId_, pending_[slot]);
+    pending_[slot].clear();
+    isPending_[slot] = false;
+    --numPending_;
+
+    ++nextId_;
+    slot = nextId_ % pending_.size();
   }
 }
 
+void OutputCollector::Append(long sourceId, const std::string& output)
+{
+  LOG(progress)->info("Best translation {} : {}", sourceId, output);
+  size_t size = buffer_.size();
+  if (framed_) {
+    buffer_ += std::to_string(output.size());
+    buffer_ += '\n';
+    buffer_ += output;
+  } else {
+    buffer_ += output;
+    buffer_ += '\n';
+  }
+  writtenSentences_.fetch_add(1, std::memory_order_relaxed);
+  writtenBytes_.fetch_add(buffer_.size() - size, std::memory_order_relaxed);
+
+  if (lineBuffered_ || buffer_.size() >= BUFFER_SIZE) {
+    Flush();
+  }
+}
+
+void OutputCollector::Flush()
+{
+  if (buffer_.empty()) {
+    return;
+  }
+  TraceScope trace("Flush", "output", "bytes", buffer_.size());
+  outStrm_->write(buffer_.data(), buffer_.size());
+  outStrm_->flush();
+  buffer_.clear();
 }
 
+}
@@ -1,28 +1,90 @@
 #pragma once
 
 #include <iostream>
-#include <map>
-#include <boost/thread/mutex.hpp>
-#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "common/mpsc_queue.h"
 
 namespace amunmt {
 
+// Writes translations in input order. Decoder threads hand their output to a
+// lock-free queue; a dedicated writer thread puts it back in order through a
+// ring buffer indexed by sentence id and writes it out in large chunks.
 class OutputCollector {
  public:
   OutputCollector();
   OutputCollector(const OutputCollector&) = delete;
+  ~OutputCollector();
+
+  // starts the writer thread. With lineBuffered every translation is flushed
+  // as soon as it is written, otherwise output is flushed when the writer runs
+  // out of work or its buffer is full. framed writes every translation as its
+  // size in bytes and a newline, followed by the translation, for a parent
+  // process collecting the output of --workers
+  void Start(bool lineBuffered, bool framed = false);
 
+  // writes everything that has been queued and stops the writer thread
+  void Close();
+
+  // never blocks on I/O
   void Write(long sourceId, const std::string& output);
 
+  // partial translation of a sentence that is still being decoded, written as
+  // a line "PARTIAL: <output>" if the sentence is the next one of the output
+  // and dropped otherwise. Must be written before the translation of the
+  // sentence, by the same thread. Framed output has no partial translations
+  void WritePartial(long sourceId, const std::string& output);
+
+  // for monitoring, safe to call from any thread
+  uint64_t GetWrittenSentences() const
+  { return writtenSentences_.load(std::memory_order_relaxed); }
+
+  uint64_t GetWrittenBytes() const
+  { return writtenBytes_.load(std::memory_order_relaxed); }
+
+  uint64_t GetPending() const
+  { return numPending_.load(std::memory_order_relaxed); }
+
  protected:
+  struct Output {
+    long first;
+    std::string second;
+    bool partial;
+  };
+
+  void Run();
+  void Push(Output&& output);
+  void Reorder(Output& output);
+  void Append(long sourceId, const std::string& output);
+  void Flush();
+
   std::ostream* outStrm_;
-  boost::mutex mutex_;
+  bool lineBuffered_;
+  bool framed_;
   long nextId_;
 
-  typedef std::map<long, std::string> Outputs;
-  Outputs outputs_;
+  MPSCQueue<Output> queue_;
+
+  // translation of sentence id is kept at slot id % size until it can be written
+  std::vector<std::string> pending_;
+  std::vector<char> isPending_;
 
+  std::string buffer_;
+
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable wakeUp_;
+  std::atomic<bool> sleeping_;
+  bool closed_;
+
+  std::atomic<uint64_t> writtenSentences_;
+  std::atomic<uint64_t> writtenBytes_;
+  std::atomic<uint64_t> numPending_;
 };
 
 }
-
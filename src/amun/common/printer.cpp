@@ -36,17 +36,23 @@ std::string GetAlignmentString(const std::vector<unsigned>& alignment) {
   return alignString.str();
 }
 
-std::string GetSoftAlignmentString(const HypothesisPtr& hypothesis) {
+std::vector<SoftAlignment> GetSoftAlignment(const HypothesisPtr& hypothesis) {
   std::vector<SoftAlignment> aligns;
   HypothesisPtr last = hypothesis->GetPrevHyp();
   while (last->GetPrevHyp().get() != nullptr) {
     aligns.push_back(*(last->GetAlignment(0)));
     last = last->GetPrevHyp();
   }
+  std::reverse(aligns.begin(), aligns.end());
+  return aligns;
+}
+
+std::string GetSoftAlignmentString(const HypothesisPtr& hypothesis) {
+  std::vector<SoftAlignment> aligns = GetSoftAlignment(hypothesis);
 
   std::stringstream alignString;
   alignString << " |||";
-  for (auto it = aligns.rbegin(); it != aligns.rend(); ++it) {
+  for (auto it = aligns.begin(); it != aligns.end(); ++it) {
     alignString << " ";
     for (unsigned i = 0; i < it->size(); ++i) {
       if (i>0) alignString << ",";
@@ -90,5 +96,17 @@ std::string GetNematusAlignmentString(const HypothesisPtr& hypothesis, std::stri
   return firstline.str() + alignString.str();
 }
 
+std::string GetStablePrefixString(const God &god, const Words& prefix) {
+  std::vector<std::string> tokens = god.GetTargetVocab()(prefix);
+  std::vector<std::string> words = god.Postprocess(tokens);
+
+  // an empty next token only becomes a word of its own if the last one is complete
+  tokens.emplace_back();
+  if (!words.empty() && god.Postprocess(tokens).size() == words.size()) {
+    words.pop_back();
+  }
+  return Join(words);
+}
+
 }
 
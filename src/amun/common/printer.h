@@ -16,33 +16,41 @@ namespace amunmt {
 
 std::vector<unsigned> GetAlignment(const HypothesisPtr& hypothesis);
 
+// attention weights of every target word, in target order
+std::vector<SoftAlignment> GetSoftAlignment(const HypothesisPtr& hypothesis);
+
 std::string GetAlignmentString(const std::vector<unsigned>& alignment);
 std::string GetSoftAlignmentString(const HypothesisPtr& hypothesis);
 std::string GetNematusAlignmentString(const HypothesisPtr& hypothesis, std::string best, std::string source, unsigned linenum);
 
+// postprocessed text of a stable prefix, see History::UpdateStablePrefix();
+// a last word the postprocessing may still join with the next is held back
+std::string GetStablePrefixString(const God &god, const Words& prefix);
+
 template <class OStream>
 void Printer(const God &god, const History& history, OStream& out, const Sentence& sentence) { 
+  const Options& options = god.GetOptions();
   auto bestTranslation = history.Top();
   std::vector<std::string> bestSentenceWords = god.Postprocess(god.GetTargetVocab()(bestTranslation.first));
 
   std::string best = Join(bestSentenceWords);
-  if (god.Get<bool>("return-nematus-alignment")) {
+  if (options.returnNematusAlignment) {
 	//Get the source sentence for printing Nematus style soft alignments
 	std::string source = Join(god.Postprocess(god.GetSourceVocab()(sentence.GetWords(0))));
     best = GetNematusAlignmentString(bestTranslation.second, best, source, history.GetLineNum());
   }else{
-    if (god.Get<bool>("return-alignment")) {
+    if (options.returnAlignment) {
       best += GetAlignmentString(GetAlignment(bestTranslation.second));
     }
-    if (god.Get<bool>("return-soft-alignment")) {
+    if (options.returnSoftAlignment) {
       best += GetSoftAlignmentString(bestTranslation.second);
     }
   }
 
-  if (god.Get<bool>("n-best")) {
+  if (options.nBest) {
     std::vector<std::string> scorerNames = god.GetScorerNames();
-    const NBestList &nbl = history.NBest(god.Get<unsigned>("beam-size"));
-    if (god.Get<bool>("wipo")) {
+    const NBestList &nbl = history.NBest(options.beamSize);
+    if (options.wipo) {
       out << "OUT: " << nbl.size() << std::endl;
     }
     for (unsigned i = 0; i < nbl.size(); ++i) {
@@ -50,11 +58,11 @@ void Printer(const God &god, const History& history, OStream& out, const Sentenc
       const Words &words = result.first;
       const HypothesisPtr &hypo = result.second;
 
-      if(god.Get<bool>("wipo")) {
+      if(options.wipo) {
         out << "OUT: ";
       }
       std::string translation = Join(god.Postprocess(god.GetTargetVocab()(words)));
-      if (god.Get<bool>("return-alignment")) {
+      if (options.returnAlignment) {
         translation += GetAlignmentString(GetAlignment(bestTranslation.second));
       }
       out << history.GetLineNum() << " ||| " << translation << " |||";
@@ -64,7 +72,7 @@ void Printer(const God &god, const History& history, OStream& out, const Sentenc
         out << " " << scorerNames[j] << "= " << std::setprecision(3) << std::fixed << hypo->GetCostBreakdown()[j];
       }
 
-      if(god.Get<bool>("normalize")) {
+      if(options.normalize) {
         out << " ||| " << std::setprecision(3) << std::fixed << hypo->GetCost() / words.size();
       }
       else {
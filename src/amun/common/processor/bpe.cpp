@@ -1,8 +1,9 @@
 #include "common/processor/bpe.h"
 
-#include <mutex>
+#include <queue>
 #include <sstream>
 #include <iostream>
+#include <functional>
 
 #include "utf8/utf8.h"
 #include "common/utils.h"
@@ -10,6 +11,70 @@
 
 namespace amunmt {
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+BPE::MergeTable::MergeTable()
+  : keys_(16, UINT64_MAX),
+    values_(16),
+    size_(0)
+{}
+
+size_t BPE::MergeTable::Slot(uint64_t key) const {
+  // fibonacci hashing, keys_.size() is always a power of 2
+  return (key * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctzll(keys_.size()));
+}
+
+void BPE::MergeTable::Grow() {
+  std::vector<uint64_t> oldKeys(keys_.size() * 2, UINT64_MAX);
+  std::vector<Merge> oldValues(values_.size() * 2);
+  // swap in the doubled, empty tables and re-insert from the old ones
+  keys_.swap(oldKeys);
+  values_.swap(oldValues);
+
+  size_ = 0;
+  for (size_t i = 0; i < oldKeys.size(); ++i) {
+    if (oldKeys[i] != UINT64_MAX) {
+      Insert(oldKeys[i] >> 32, oldKeys[i] & UINT32_MAX, oldValues[i]);
+    }
+  }
+}
+
+void BPE::MergeTable::Insert(SymbolId left, SymbolId right, const Merge& merge) {
+  if (2 * (size_ + 1) > keys_.size()) {
+    Grow();
+  }
+
+  uint64_t key = Key(left, right);
+  size_t mask = keys_.size() - 1;
+  size_t slot = Slot(key);
+  while (keys_[slot] != UINT64_MAX && keys_[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+
+  if (keys_[slot] == UINT64_MAX) {
+    keys_[slot] = key;
+    ++size_;
+  }
+  values_[slot] = merge;
+}
+
+const BPE::Merge* BPE::MergeTable::Find(SymbolId left, SymbolId right) const {
+  if (left == NO_SYMBOL || right == NO_SYMBOL) {
+    return nullptr;
+  }
+
+  uint64_t key = Key(left, right);
+  size_t mask = keys_.size() - 1;
+  size_t slot = Slot(key);
+  while (keys_[slot] != UINT64_MAX) {
+    if (keys_[slot] == key) {
+      return &values_[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////
 std::vector<bpeFactors> BPE::Preprocess(const std::vector<bpeFactors> input) const {
   return Encode(input);
 }
@@ -18,6 +83,11 @@ std::vector<std::string> BPE::Preprocess(const std::vector<std::string> input) c
   return Encode(input);
 }
 
+void BPE::PreprocessWord(const std::string& word, std::vector<std::string>& pieces) const {
+  const std::vector<std::string>& encoded = Encode(word);
+  pieces.assign(encoded.begin(), encoded.end());
+}
+
 std::vector<std::string> BPE::Postprocess(const std::vector<std::string> input) const {
   std::vector<std::string> debped;
   std::stringstream currWord;
@@ -39,12 +109,15 @@ std::vector<std::string> BPE::Postprocess(const std::vector<std::string> input)
 }
 
 BPE::BPE()
-  : sep_("@@") {}
+  : endOfWord_(NO_SYMBOL),
+    sep_("@@") {}
 
 BPE::BPE(std::ifstream&& file, const std::string sep)
   : sep_(sep) {
+  endOfWord_ = Intern("</w>");
+
   std::string inputLine;
-  size_t index = 0;
+  uint32_t index = 0;
   bool firstLine = true;
   while (std::getline(file, inputLine)) {
     if (firstLine) {
@@ -55,35 +128,50 @@ BPE::BPE(std::ifstream&& file, const std::string sep)
     }
     std::vector<std::string> code;
     Split(inputLine, code);
-    bpeCodes_[make_pair(code[0], code[1])] = index++;
+    if (code.size() < 2) {
+      continue;
+    }
+
+    SymbolId left = Intern(code[0]);
+    SymbolId right = Intern(code[1]);
+    SymbolId merged = Intern(code[0] + code[1]);
+    bpeCodes_.Insert(left, right, {index++, merged});
   }
+  LOG(info)->info("Loaded {} BPE merges over {} symbols", bpeCodes_.size(), symbols_.size());
 }
 
 BPE::BPE(const std::string& path, const std::string sep)
   : BPE(std::ifstream(path), sep) {}
 
-std::vector<std::string> BPE::Segment(const std::string& sentence) {
+BPE::SymbolId BPE::Intern(const std::string& symbol) {
+  auto it = symbols_.emplace(symbol, symbols_.size());
+  return it.first->second;
+}
+
+BPE::SymbolId BPE::GetSymbolId(const std::string& symbol) const {
+  auto it = symbols_.find(symbol);
+  return (it == symbols_.end()) ? NO_SYMBOL : it->second;
+}
+
+std::vector<std::string> BPE::Segment(const std::string& sentence) const {
   std::vector<std::string> words, tokens;
   Split(sentence, words);
 
   for (auto& word : words) {
     if (word.empty()) continue;
-    auto codes = Encode(word);
-    for (size_t i = 0; i < codes.size() - 1; ++i) {
-      tokens.emplace_back(codes[i]);
-    }
-    tokens.push_back(codes.back());
+    const auto& codes = Encode(word);
+    tokens.insert(tokens.end(), codes.begin(), codes.end());
   }
   return tokens;
 }
 
-void BPE::PrintSegment(const std::string& sentence) {
+void BPE::PrintSegment(const std::string& sentence) const {
   std::vector<std::string> words, tokens;
   Split(sentence, words);
 
   for (size_t wi = 0; wi < words.size(); ++wi) {
     if (words[wi].empty()) continue;
-    auto codes = Encode(words[wi]);
+    const auto& codes = Encode(words[wi]);
 
     for (size_t i = 0; i < codes.size() - 1; ++i) {
       std::cout << codes[i] << " ";
@@ -97,79 +185,114 @@ void BPE::PrintSegment(const std::string& sentence) {
   }
 }
 
-std::set<BPE::BPEPair> BPE::GetPairs(const std::vector<std::string>& word) const {
-  std::set<BPE::BPEPair> pairSet;
-  for (size_t i = 1; i < word.size(); ++i) {
-    pairSet.emplace(word[i-1], word[i]);
+const std::vector<std::string>& BPE::Encode(const std::string& word) const {
+  CacheShard& shard = cache_[std::hash<std::string>()(word) % NUM_CACHE_SHARDS];
+
+  {
+    boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+    auto it = shard.words.find(word);
+    if (it != shard.words.end()) {
+      return it->second;
+    }
   }
-  return pairSet;
+
+  std::vector<std::string> encoded = EncodeUncached(word);
+
+  boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+  // another thread may have got there first, in which case emplace keeps its result
+  return shard.words.emplace(word, std::move(encoded)).first->second;
 }
 
-const BPE::BPEPair* BPE::FindBestBigram(const std::set<BPEPair>& pairs) const {
-  size_t minDist = bpeCodes_.size();
-  auto best = bpeCodes_.begin();
+std::vector<std::string> BPE::EncodeUncached(const std::string& word) const {
+  // a symbol covers the bytes [begin, end) of the word. Symbols form a linked list
+  // so that merging two of them doesn't have to move the rest of the word
+  struct Symbol {
+    SymbolId id;
+    int prev;
+    int next;
+    size_t begin;
+    size_t end;
+    bool endOfWord;
+  };
+
+  // merge candidate, ordered by rank of the merge and then left to right
+  struct Candidate {
+    uint32_t rank;
+    int pos;
+    SymbolId left;
+    SymbolId right;
+    SymbolId merged;
+
+    bool operator>(const Candidate& other) const {
+      return rank > other.rank || (rank == other.rank && pos > other.pos);
+    }
+  };
 
-  for (const auto& pair : pairs) {
-    auto it = bpeCodes_.find(pair);
-    if (it == bpeCodes_.end()) {
-      continue;
+  std::vector<Symbol> symbols;
+  const char* b = word.c_str();
+  const char* e = b + word.size();
+  while (b != e) {
+    size_t begin = b - word.c_str();
+    utf8::next(b, e);
+    size_t end = b - word.c_str();
+    SymbolId id = GetSymbolId(word.substr(begin, end - begin));
+    symbols.push_back({id, int(symbols.size()) - 1, int(symbols.size()) + 1, begin, end, false});
+  }
+  symbols.push_back({endOfWord_, int(symbols.size()) - 1, -1, word.size(), word.size(), true});
+
+  std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+  auto addCandidate = [&](int pos) {
+    const Symbol& left = symbols[pos];
+    if (left.next < 0) {
+      return;
     }
-    if (it->second < minDist) {
-      minDist = it->second;
-      best = it;
+    const Symbol& right = symbols[left.next];
+    const Merge* merge = bpeCodes_.Find(left.id, right.id);
+    if (merge) {
+      queue.push({merge->rank, pos, left.id, right.id, merge->merged});
     }
-  }
-  if (minDist == bpeCodes_.size()) {
-    return nullptr;
-  }
-  else {
-  return &(best->first);
-  }
-}
+  };
 
-std::vector<std::string>& BPE::Encode(const std::string& word) const {
-  if (IsCached(word)) {
-    return cache_[word];
+  for (int pos = 0; pos + 1 < int(symbols.size()); ++pos) {
+    addCandidate(pos);
   }
 
-  std::vector<std::string> vWord = SplitWordIntoLetters(word);
-  vWord.push_back("</w>");
+  while (!queue.empty()) {
+    Candidate top = queue.top();
+    queue.pop();
 
-  auto pairs = GetPairs(vWord);
-
-  while (true) {
-    const BPEPair* bigram = FindBestBigram(pairs);
-    if (bigram == nullptr) {
-      break;
+    // skip candidates made stale by an earlier merge
+    Symbol& left = symbols[top.pos];
+    if (left.id != top.left || left.next < 0) {
+      continue;
+    }
+    Symbol& right = symbols[left.next];
+    if (right.id != top.right) {
+      continue;
     }
 
-    std::vector<std::string> newWord;
-
-    auto it = vWord.begin();
-    while (it != vWord.end()) {
-      auto jt = std::find(it, vWord.end(), bigram->first);
-      for (auto i = it; i != jt; ++i) {
-        newWord.push_back(*i);
-      }
+    left.id = top.merged;
+    left.end = right.end;
+    left.endOfWord = right.endOfWord;
+    left.next = right.next;
+    if (right.next >= 0) {
+      symbols[right.next].prev = top.pos;
+    }
+    right.id = NO_SYMBOL;
+    right.next = -1;
 
-      if (jt == vWord.end()) {
-        break;
-      }
-      it = jt;
-
-      if (*it == bigram->first && (it+1) != vWord.end() && *(it+1) == bigram->second) {
-        newWord.emplace_back(bigram->first + bigram->second);
-        it += 2;
-      } else {
-        newWord.push_back(*it);
-        it += 1;
-      }
+    if (left.prev >= 0) {
+      addCandidate(left.prev);
     }
-    std::swap(vWord, newWord);
-    if (newWord.size() == 1) {
-      break;
-    } else {
-      pairs = GetPairs(vWord);
+    addCandidate(top.pos);
+  }
+
+  std::vector<std::string> vWord;
+  for (int pos = 0; pos >= 0; pos = symbols[pos].next) {
+    const Symbol& symbol = symbols[pos];
+    vWord.emplace_back(word, symbol.begin, symbol.end - symbol.begin);
+    if (symbol.endOfWord) {
+      vWord.back() += "</w>";
     }
   }
 
@@ -177,20 +300,19 @@ std::vector<std::string>& BPE::Encode(const std::string& word) const {
     vWord.pop_back();
   }
 
+  if (vWord.empty()) {
+    return vWord;
+  }
+
   if (EndsWith(vWord.back(), "</w>")) {
     vWord.back().resize(vWord.back().size() - 4);
   }
 
   for (size_t i = 0;  i < vWord.size() - 1; ++i) {
-    vWord[i] = vWord[i] + sep_;
+    vWord[i] += sep_;
   }
 
-  std::mutex mtx;
-  mtx.lock();
-  cache_[word] = vWord;
-  mtx.unlock();
-
-  return cache_[word];
+  return vWord;
 }
 
 std::vector<bpeFactors> BPE::Encode(const std::vector<bpeFactors>& words) const {
@@ -198,8 +320,7 @@ std::vector<bpeFactors> BPE::Encode(const std::vector<bpeFactors>& words) const
   // each of the parts
   std::vector<std::vector<std::string>> result;
   for (const bpeFactors& factorlist : words) {
-    std::string word = factorlist[0];
-    std::vector<std::string>& encoded = Encode(word);
+    const std::vector<std::string>& encoded = Encode(factorlist[0]);
     for (const auto& bpePart : encoded)
     {
       result.push_back(bpeFactors());
@@ -214,33 +335,12 @@ std::vector<bpeFactors> BPE::Encode(const std::vector<bpeFactors>& words) const
 std::vector<std::string> BPE::Encode(const std::vector<std::string>& words) const {
   std::vector<std::string> result;
   for (const auto& word : words) {
-    auto& encoded = Encode(word);
+    const auto& encoded = Encode(word);
     result.insert(result.end(), encoded.begin(), encoded.end());
   }
   return result;
 }
 
-
-bool BPE::IsCached(const std::string& word) const {
-  return cache_.find(word) != cache_.end();
-}
-
-std::vector<std::string> BPE::SplitWordIntoLetters(const std::string& word) const {
-  char* charWord = (char*)word.c_str();
-  auto b = charWord;
-  auto e = charWord + strlen(charWord);
-
-  std::vector<std::string> letters;
-  int prevBegin = 0;
-  while (b != e) {
-    int end = utf8::next(b, e);
-    std::vector<unsigned char> utf8result;
-    utf8::utf32to8(&end,&end + 1, std::back_inserter(utf8result));
-    letters.emplace_back(utf8result.begin(), utf8result.end());
-  }
-  return letters;
-}
-
 bool BPE::EndsWith(std::string const &fullString, std::string const suffix) const {
   if (fullString.length() >= suffix.length()) {
     return (0 == fullString.compare(fullString.length() - suffix.length(), suffix.length(), suffix));
@@ -3,76 +3,93 @@
 #include <vector>
 #include <string>
 #include <fstream>
-#include <set>
+#include <array>
+#include <cstdint>
 #include <unordered_map>
-#include <iterator>
+#include <boost/thread/shared_mutex.hpp>
 
 #include "common/processor/processor.h"
 
-
-template<class T>
-inline void hash_combine(std::size_t & seed, const T & v)
-{
-  std::hash<T> hasher;
-  seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-}
-
-namespace std
-{
-  template<typename S, typename T> struct hash<pair<S, T>>
-  {
-      inline size_t operator()(const pair<S, T> & v) const
-      {
-            size_t seed = 0;
-            ::hash_combine(seed, v.first);
-            ::hash_combine(seed, v.second);
-            return seed;
-          }
-    };
-}
-
 namespace amunmt {
 
 typedef std::vector<std::string> bpeFactors;
 
 class BPE : public Processor {
-  using BPEPair = std::pair<std::string, std::string>;
-
   public:
     BPE();
     BPE(std::ifstream&& file, const std::string sep = "@@");
 
     BPE(const std::string& path, const std::string sep = "@@");
 
-    std::vector<std::string> Segment(const std::string& sentence);
+    std::vector<std::string> Segment(const std::string& sentence) const;
 
-    void PrintSegment(const std::string& sentence);
+    void PrintSegment(const std::string& sentence) const;
 
-    std::vector<std::string>& Encode(const std::string& word) const;
+    // thread-safe, the returned reference stays valid for the lifetime of the object
+    const std::vector<std::string>& Encode(const std::string& word) const;
 
     std::vector<bpeFactors> Encode(const std::vector<bpeFactors>& words) const;
     std::vector<std::string> Encode(const std::vector<std::string>& words) const;
 
     std::vector<std::string> Preprocess(const std::vector<std::string> input) const;
     std::vector<bpeFactors> Preprocess(const std::vector<bpeFactors> input) const;
+    void PreprocessWord(const std::string& word, std::vector<std::string>& pieces) const;
     std::vector<std::string> Postprocess(const std::vector<std::string> input) const;
 
     virtual ~BPE() {}
+
   private:
-    std::set<BPEPair> GetPairs(const std::vector<std::string>& word) const;
+    typedef uint32_t SymbolId;
+    static const SymbolId NO_SYMBOL = UINT32_MAX;
+
+    struct Merge {
+      uint32_t rank;
+      SymbolId merged;
+    };
 
-    const BPEPair* FindBestBigram(const std::set<BPEPair>& pairs) const;
+    // open addressing hash map from a pair of symbol ids, packed into 64 bits,
+    // to the rank of the merge and the id of the resulting symbol
+    class MergeTable {
+      public:
+        MergeTable();
 
-    bool IsCached(const std::string& word) const;
+        void Insert(SymbolId left, SymbolId right, const Merge& merge);
+        const Merge* Find(SymbolId left, SymbolId right) const;
 
-    std::vector<std::string> SplitWordIntoLetters(const std::string& word) const;
+        size_t size() const
+        { return size_; }
+
+      private:
+        static uint64_t Key(SymbolId left, SymbolId right) {
+          return (uint64_t(left) << 32) | right;
+        }
+        size_t Slot(uint64_t key) const;
+        void Grow();
+
+        std::vector<uint64_t> keys_;
+        std::vector<Merge> values_;
+        size_t size_;
+    };
+
+    struct CacheShard {
+      mutable boost::shared_mutex mutex;
+      std::unordered_map<std::string, std::vector<std::string>> words;
+    };
+    static const size_t NUM_CACHE_SHARDS = 64;
+
+    SymbolId Intern(const std::string& symbol);
+    SymbolId GetSymbolId(const std::string& symbol) const;
+
+    std::vector<std::string> EncodeUncached(const std::string& word) const;
 
     bool EndsWith(const std::string& fullString, const std::string suffix) const;
 
-    std::unordered_map<BPEPair, size_t> bpeCodes_;
+    std::unordered_map<std::string, SymbolId> symbols_;
+    MergeTable bpeCodes_;
+    SymbolId endOfWord_;
     const std::string sep_;
-    mutable std::unordered_map<std::string, std::vector<std::string>> cache_;
-
 
+    mutable std::array<CacheShard, NUM_CACHE_SHARDS> cache_;
 };
+
 }
@@ -10,6 +10,12 @@ class Preprocessor {
   public:
     virtual std::vector<std::string> Preprocess(const std::vector<std::string> input) const = 0;
     virtual std::vector<std::vector<std::string>> Preprocess(const std::vector<std::vector<std::string>> input) const = 0;
+
+    // preprocess a single word into pieces. pieces is overwritten so that callers can reuse its storage
+    virtual void PreprocessWord(const std::string& word, std::vector<std::string>& pieces) const {
+      pieces = Preprocess(std::vector<std::string>(1, word));
+    }
+
     virtual ~Preprocessor() {}
 };
 
@@ -0,0 +1,293 @@
+#include "common/profiler.h"
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <csignal>
+#include <condition_variable>
+
+#include "common/logging.h"
+
+namespace amunmt {
+
+std::atomic<bool> Profiler::enabled_(false);
+
+namespace {
+
+// counters are only written by their own thread, so there is no need for
+// an atomic read-modify-write. Atomics are only used to read them safely
+// from the thread writing the results
+void Increment(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+struct StageCounters {
+  StageCounters()
+    : calls(0), nanoseconds(0), gemms(0), flops(0)
+  {}
+
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> nanoseconds;
+  std::atomic<uint64_t> gemms;
+  std::atomic<uint64_t> flops;
+};
+
+// stage, m, n, k
+typedef std::array<size_t, 4> GemmShape;
+
+struct ThreadProfile {
+  explicit ThreadProfile(size_t vId)
+    : id(vId), current(Profiler::OTHER), sentences(0), steps(0)
+  {}
+
+  size_t id;
+  Profiler::Stage current;
+  std::array<StageCounters, Profiler::NUM_STAGES> stages;
+  std::atomic<uint64_t> sentences;
+  std::atomic<uint64_t> steps;
+
+  // only contended while the results are written
+  std::mutex gemmMutex;
+  std::map<GemmShape, uint64_t> gemmShapes;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadProfile>> threads;
+  std::string path;
+  std::chrono::steady_clock::time_point start;
+
+  // writes the results when SIGUSR1 was received
+  std::thread watcher;
+  std::condition_variable stopWatcher;
+  bool stop = false;
+};
+
+Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+ThreadProfile& GetThreadProfile() {
+  thread_local ThreadProfile* profile = nullptr;
+  if (profile == nullptr) {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.emplace_back(new ThreadProfile(registry.threads.size()));
+    profile = registry.threads.back().get();
+  }
+  return *profile;
+}
+
+volatile std::sig_atomic_t dumpRequested = 0;
+
+extern "C" void RequestDump(int) {
+  dumpRequested = 1;
+}
+
+void Watch() {
+  Registry& registry = GetRegistry();
+  std::unique_lock<std::mutex> lock(registry.mutex);
+  while (!registry.stop) {
+    registry.stopWatcher.wait_for(lock, std::chrono::milliseconds(100));
+    if (dumpRequested) {
+      dumpRequested = 0;
+      lock.unlock();
+      Profiler::Dump();
+      lock.lock();
+    }
+  }
+}
+
+double Seconds(uint64_t nanoseconds) {
+  return nanoseconds * 1e-9;
+}
+
+void WriteStage(std::ostream& out, const char* name,
+                uint64_t calls, uint64_t nanoseconds, uint64_t gemms, uint64_t flops) {
+  out << "\"" << name << "\": {"
+      << "\"calls\": " << calls
+      << ", \"seconds\": " << Seconds(nanoseconds)
+      << ", \"mean_us\": " << (calls ? nanoseconds * 1e-3 / calls : 0.0)
+      << ", \"gemms\": " << gemms
+      << ", \"gflop\": " << flops * 1e-9
+      << "}";
+}
+
+}
+
+void Profiler::Enable(const std::string& path) {
+  Registry& registry = GetRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (IsEnabled()) {
+      return;
+    }
+    registry.path = path;
+    registry.start = std::chrono::steady_clock::now();
+    registry.stop = false;
+    enabled_ = true;
+  }
+
+  std::signal(SIGUSR1, RequestDump);
+  registry.watcher = std::thread(Watch);
+  LOG(info)->info("Profiling, results will be written to {}", path);
+}
+
+void Profiler::Finish() {
+  if (!IsEnabled()) {
+    return;
+  }
+
+  Registry& registry = GetRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.stop = true;
+  }
+  registry.stopWatcher.notify_one();
+  registry.watcher.join();
+  std::signal(SIGUSR1, SIG_DFL);
+
+  Dump();
+  enabled_ = false;
+}
+
+const char* Profiler::GetStageName(Stage stage) {
+  switch (stage) {
+    case OTHER: return "other";
+    case PREPROCESS: return "preprocess";
+    case ENCODE: return "encode";
+    case GRU1: return "gru1";
+    case ATTENTION: return "attention";
+    case GRU2: return "gru2";
+    case SOFTMAX: return "softmax";
+    case CALC_BEAM: return "calc_beam";
+    case ASSEMBLE_BEAM_STATE: return "assemble_beam_state";
+    case POSTPROCESS: return "postprocess";
+    case OUTPUT: return "output";
+    default: return "unknown";
+  }
+}
+
+Profiler::Stage Profiler::Enter(Stage stage) {
+  ThreadProfile& profile = GetThreadProfile();
+  Stage previous = profile.current;
+  profile.current = stage;
+  return previous;
+}
+
+void Profiler::Leave(Stage stage, Stage previous, std::chrono::nanoseconds time) {
+  ThreadProfile& profile = GetThreadProfile();
+  profile.current = previous;
+
+  StageCounters& counters = profile.stages[stage];
+  Increment(counters.calls, 1);
+  Increment(counters.nanoseconds, time.count());
+}
+
+void Profiler::AddGemm(size_t m, size_t n, size_t k) {
+  ThreadProfile& profile = GetThreadProfile();
+  StageCounters& counters = profile.stages[profile.current];
+  Increment(counters.gemms, 1);
+  Increment(counters.flops, 2 * m * n * k);
+
+  std::lock_guard<std::mutex> lock(profile.gemmMutex);
+  ++profile.gemmShapes[GemmShape{{size_t(profile.current), m, n, k}}];
+}
+
+void Profiler::AddSentences(size_t sentences, size_t steps) {
+  ThreadProfile& profile = GetThreadProfile();
+  Increment(profile.sentences, sentences);
+  Increment(profile.steps, steps);
+}
+
+void Profiler::Dump() {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  std::array<uint64_t, NUM_STAGES> calls{}, nanoseconds{}, gemms{}, flops{};
+  uint64_t sentences = 0, steps = 0;
+  std::map<GemmShape, uint64_t> gemmShapes;
+
+  std::string tmpPath = registry.path + ".tmp";
+  std::ofstream out(tmpPath);
+  out << std::fixed << std::setprecision(6);
+  out << "{\n  \"threads\": [";
+
+  for (size_t t = 0; t < registry.threads.size(); ++t) {
+    ThreadProfile& profile = *registry.threads[t];
+    uint64_t threadSentences = profile.sentences.load(std::memory_order_relaxed);
+    uint64_t threadSteps = profile.steps.load(std::memory_order_relaxed);
+    sentences += threadSentences;
+    steps += threadSteps;
+
+    out << (t ? "," : "") << "\n    {\"thread\": " << profile.id
+        << ", \"sentences\": " << threadSentences
+        << ", \"steps\": " << threadSteps
+        << ", \"stages\": {";
+
+    bool first = true;
+    for (size_t s = 0; s < NUM_STAGES; ++s) {
+      const StageCounters& counters = profile.stages[s];
+      uint64_t stageCalls = counters.calls.load(std::memory_order_relaxed);
+      uint64_t stageTime = counters.nanoseconds.load(std::memory_order_relaxed);
+      uint64_t stageGemms = counters.gemms.load(std::memory_order_relaxed);
+      uint64_t stageFlops = counters.flops.load(std::memory_order_relaxed);
+
+      calls[s] += stageCalls;
+      nanoseconds[s] += stageTime;
+      gemms[s] += stageGemms;
+      flops[s] += stageFlops;
+
+      if (stageCalls || stageGemms) {
+        out << (first ? "" : ", ");
+        WriteStage(out, GetStageName(Stage(s)), stageCalls, stageTime, stageGemms, stageFlops);
+        first = false;
+      }
+    }
+    out << "}}";
+
+    std::lock_guard<std::mutex> gemmLock(profile.gemmMutex);
+    for (const auto& shape : profile.gemmShapes) {
+      gemmShapes[shape.first] += shape.second;
+    }
+  }
+  out << "\n  ],\n";
+
+  double wall = Seconds(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - registry.start).count());
+  out << "  \"wall_seconds\": " << wall << ",\n"
+      << "  \"sentences\": " << sentences << ",\n"
+      << "  \"steps\": " << steps << ",\n"
+      << "  \"stages\": {";
+  for (size_t s = 0; s < NUM_STAGES; ++s) {
+    out << (s ? "," : "") << "\n    ";
+    WriteStage(out, GetStageName(Stage(s)), calls[s], nanoseconds[s], gemms[s], flops[s]);
+  }
+  out << "\n  },\n";
+
+  out << "  \"gemm_shapes\": [";
+  bool first = true;
+  for (const auto& shape : gemmShapes) {
+    const GemmShape& key = shape.first;
+    out << (first ? "" : ",") << "\n    {\"stage\": \"" << GetStageName(Stage(key[0])) << "\""
+        << ", \"m\": " << key[1] << ", \"n\": " << key[2] << ", \"k\": " << key[3]
+        << ", \"calls\": " << shape.second
+        << ", \"gflop\": " << 2.0 * key[1] * key[2] * key[3] * shape.second * 1e-9 << "}";
+    first = false;
+  }
+  out << "\n  ]\n}\n";
+  out.close();
+
+  if (!out || std::rename(tmpPath.c_str(), registry.path.c_str()) != 0) {
+    LOG(info)->warn("Could not write profile to {}", registry.path);
+  }
+}
+
+}
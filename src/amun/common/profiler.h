@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace amunmt {
+
+// Built-in, low overhead profiling of the translation stages. Every thread
+// keeps its own counters, which are only summed up when the results are
+// written. When profiling is disabled each probe costs a relaxed atomic load.
+//
+// Results are written as JSON to the path given to Enable() when Finish() is
+// called, and whenever the process receives SIGUSR1.
+class Profiler {
+  public:
+    enum Stage {
+      OTHER,
+      PREPROCESS,
+      ENCODE,
+      GRU1,
+      ATTENTION,
+      GRU2,
+      SOFTMAX,
+      CALC_BEAM,
+      ASSEMBLE_BEAM_STATE,
+      POSTPROCESS,
+      OUTPUT,
+      NUM_STAGES
+    };
+
+    static void Enable(const std::string& path);
+
+    // writes the final results and stops profiling
+    static void Finish();
+
+    static bool IsEnabled() {
+      return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static const char* GetStageName(Stage stage);
+
+    // makes stage the current stage of the calling thread, returns the previous one
+    static Stage Enter(Stage stage);
+    static void Leave(Stage stage, Stage previous, std::chrono::nanoseconds time);
+
+    // a product of an (m x k) by a (k x n) matrix, attributed to the current stage
+    static void AddGemm(size_t m, size_t n, size_t k);
+
+    static void AddSentences(size_t sentences, size_t steps);
+
+    static void Dump();
+
+  private:
+    static std::atomic<bool> enabled_;
+};
+
+// times the enclosing scope as the given stage
+class ProfileScope {
+  public:
+    explicit ProfileScope(Profiler::Stage stage)
+      : stage_(stage),
+        active_(Profiler::IsEnabled())
+    {
+      if (active_) {
+        previous_ = Profiler::Enter(stage_);
+        start_ = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~ProfileScope() {
+      if (active_) {
+        Profiler::Leave(stage_, previous_, std::chrono::steady_clock::now() - start_);
+      }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+
+  private:
+    Profiler::Stage stage_;
+    Profiler::Stage previous_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}
@@ -0,0 +1,161 @@
+#include "common/rescorer.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "common/god.h"
+#include "common/exception.h"
+#include "common/hypothesis.h"
+#include "common/logging.h"
+#include "common/output_collector.h"
+#include "common/sentence.h"
+#include "common/sentences.h"
+#include "common/translation_task.h"
+#include "common/vocab.h"
+
+namespace amunmt {
+
+namespace {
+
+const std::string SEPARATOR = " ||| ";
+
+struct Candidate {
+  std::vector<std::string> fields;
+  Words target;
+};
+
+typedef std::vector<Candidate> Candidates;
+
+std::vector<std::string> SplitFields(const std::string& line) {
+  std::vector<std::string> fields;
+  size_t pos = 0;
+  while (true) {
+    size_t end = line.find(SEPARATOR, pos);
+    fields.push_back(line.substr(pos, end - pos));
+    if (end == std::string::npos) {
+      return fields;
+    }
+    pos = end + SEPARATOR.size();
+  }
+}
+
+std::string GetCandidateString(const God &god, Candidate candidate, const HypothesisPtr& hypothesis) {
+  const std::vector<std::string> scorerNames = god.GetScorerNames();
+  std::stringstream scores;
+  scores << std::setprecision(3) << std::fixed;
+  for (unsigned j = 0; j < hypothesis->GetCostBreakdown().size(); ++j) {
+    scores << (j ? " " : "") << scorerNames[j] << "= " << hypothesis->GetCostBreakdown()[j];
+  }
+
+  std::vector<std::string>& fields = candidate.fields;
+  if (fields.size() >= 3) {
+    fields[2] += (fields[2].empty() ? "" : " ") + scores.str();
+  } else {
+    float cost = hypothesis->GetCost();
+    if (god.GetOptions().normalize) {
+      cost /= candidate.target.size();
+    }
+    std::stringstream total;
+    total << std::setprecision(3) << std::fixed << cost;
+    fields.push_back(scores.str());
+    fields.push_back(total.str());
+  }
+
+  std::string output = fields[0];
+  for (unsigned i = 1; i < fields.size(); ++i) {
+    output += SEPARATOR + fields[i];
+  }
+  return output;
+}
+
+}
+
+Rescorer::Rescorer(God &god)
+  : god_(god),
+    nBestPath_(god.Get<std::string>("rescore"))
+{}
+
+void Rescorer::Run()
+{
+  std::ifstream nBest(nBestPath_);
+  amunmt_UTIL_THROW_IF2(!nBest, "Could not open " << nBestPath_);
+  std::istream& input = god_.GetInputStream();
+  const Vocab& targetVocab = god_.GetTargetVocab();
+
+  std::string source;
+  long sourceNum = -1;
+  long outputNum = 0;
+  std::shared_ptr<Candidates> candidates;
+  long candidatesNum = -1;
+  size_t numCandidates = 0;
+
+  // the candidates of one source line, as one task; output lines are numbered
+  // by task, a source line may have no candidates
+  auto submit = [&]() {
+    while (sourceNum < candidatesNum) {
+      amunmt_UTIL_THROW_IF2(!std::getline(input, source),
+                            nBestPath_ << " has candidates for line " << candidatesNum
+                            << " of an input of " << sourceNum + 1 << " lines");
+      ++sourceNum;
+    }
+
+    SentencesPtr sentences(new Sentences());
+    sentences->push_back(SentencePtr(new Sentence(god_, candidatesNum, source)));
+    god_.GetMetrics().SentenceStarted();
+    numCandidates += candidates->size();
+
+    God &god = god_;
+    god_.GetThreadPool().enqueue([&god, sentences, candidates, outputNum] {
+      std::vector<Words> targets;
+      for (const Candidate& candidate : *candidates) {
+        targets.push_back(candidate.target);
+      }
+      std::vector<HypothesisPtr> hypotheses = RescoreTask(god, sentences, targets);
+
+      std::string output;
+      for (unsigned i = 0; i < candidates->size(); ++i) {
+        output += (i ? "\n" : "") + GetCandidateString(god, (*candidates)[i], hypotheses[i]);
+      }
+      god.GetOutputCollector().Write(outputNum, output);
+      god.GetMetrics().SentenceFinished();
+    });
+    ++outputNum;
+  };
+
+  std::string line;
+  while (std::getline(nBest, line)) {
+    std::vector<std::string> fields = SplitFields(line);
+    amunmt_UTIL_THROW_IF2(fields.size() < 2, "Not an n-best list line: " << line);
+    char* end;
+    errno = 0;
+    long lineNum = std::strtol(fields[0].c_str(), &end, 10);
+    amunmt_UTIL_THROW_IF2(end == fields[0].c_str() || *end != '\0', "Not an n-best list line: " << line);
+    // sentences are numbered by an unsigned, and -1 is the number before the first line
+    amunmt_UTIL_THROW_IF2(errno == ERANGE || lineNum < 0
+                          || static_cast<unsigned long>(lineNum) > std::numeric_limits<unsigned>::max(),
+                          "Line number out of range in n-best list line: " << line);
+    if (lineNum != candidatesNum) {
+      amunmt_UTIL_THROW_IF2(lineNum < candidatesNum, nBestPath_ << " is not sorted by line number: " << line);
+      if (candidates) {
+        submit();
+      }
+      candidates.reset(new Candidates());
+      candidatesNum = lineNum;
+    }
+    Words target = targetVocab(fields[1]);
+    candidates->push_back({ fields, target });
+  }
+  if (candidates) {
+    submit();
+  }
+
+  LOG(info)->info("Rescoring {} candidates of {} sentences", numCandidates, outputNum);
+}
+
+}
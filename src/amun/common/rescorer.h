@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+namespace amunmt {
+
+class God;
+
+// amun --rescore NBEST: scores the candidates of a Moses n-best list,
+//
+//   <source line number> ||| <target> [||| <features> ||| <score>]
+//
+// by forced decoding against the source lines of the input instead of
+// translating them. Targets are split on spaces into target vocabulary words
+// without preprocessing. Every candidate is written back with the
+// log-probability of every scorer appended to its features, "F0= -12.345",
+// and a plain list also gets the weighted total as its score. All candidates
+// of a source line are scored as one batch on a decoder thread.
+class Rescorer {
+  public:
+    Rescorer(God &god);
+
+    void Run();
+
+  private:
+    God &god_;
+    std::string nBestPath_;
+};
+
+}
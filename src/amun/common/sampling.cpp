@@ -0,0 +1,114 @@
+#include "common/sampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "common/options.h"
+
+namespace amunmt {
+
+namespace {
+
+uint64_t SplitMix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// below it a word is never drawn, e.g. <unk> without --allow-unk
+const float MIN_LOG_WEIGHT = -87.0f;
+
+}
+
+SampleRandom::SampleRandom(uint64_t seed, uint64_t lineNum)
+  : state_(SplitMix64(SplitMix64(seed) ^ lineNum))
+{
+  // xorshift stays at 0
+  if (state_ == 0) {
+    state_ = 1;
+  }
+}
+
+Sampler::Sampler(const Options& options)
+  : topK_(options.samplingTopK),
+    topP_(options.samplingTopP),
+    invTemperature_(1.0f / options.samplingTemperature)
+{}
+
+float Sampler::Weight(float score, float maxScore) const
+{
+  float logWeight = (score - maxScore) * invTemperature_;
+  return (logWeight < MIN_LOG_WEIGHT) ? 0.0f : std::exp(logWeight);
+}
+
+unsigned Sampler::Sample(const float* scores, unsigned size, SampleRandom& random)
+{
+  const float maxScore = *std::max_element(scores, scores + size);
+  const unsigned k = (topK_ && topK_ < size) ? topK_ : size;
+  if (k == size && topP_ >= 1) {
+    return SampleAll(scores, size, maxScore, random);
+  }
+
+  auto better = [scores](unsigned a, unsigned b) {
+    return scores[a] > scores[b];
+  };
+  ids_.resize(size);
+  std::iota(ids_.begin(), ids_.end(), 0);
+  if (k < size) {
+    std::nth_element(ids_.begin(), ids_.begin() + k, ids_.end(), better);
+    ids_.resize(k);
+  }
+
+  float sum = 0;
+  for (unsigned id : ids_) {
+    sum += Weight(scores[id], maxScore);
+  }
+
+  if (topP_ < 1) {
+    // best words first until they reach top-p of the probability; sorted in
+    // growing chunks, the nucleus is usually small
+    const float target = topP_ * sum;
+    float cumulative = 0;
+    unsigned sorted = 0;
+    while (sorted < ids_.size()) {
+      unsigned chunk = std::min<unsigned>(ids_.size(), std::max(64u, 4 * sorted));
+      std::partial_sort(ids_.begin() + sorted, ids_.begin() + chunk, ids_.end(), better);
+      for (; sorted < chunk && cumulative < target; ++sorted) {
+        cumulative += Weight(scores[ids_[sorted]], maxScore);
+      }
+      if (cumulative >= target) {
+        ids_.resize(sorted);
+        break;
+      }
+    }
+    sum = cumulative;
+  }
+
+  float r = random.Uniform() * sum;
+  for (unsigned id : ids_) {
+    r -= Weight(scores[id], maxScore);
+    if (r < 0) {
+      return id;
+    }
+  }
+  return ids_.front();
+}
+
+unsigned Sampler::SampleAll(const float* scores, unsigned size, float maxScore, SampleRandom& random)
+{
+  // inverse of the cumulative distribution
+  weights_.resize(size);
+  float sum = 0;
+  for (unsigned i = 0; i < size; ++i) {
+    sum += Weight(scores[i], maxScore);
+    weights_[i] = sum;
+  }
+
+  float r = random.Uniform() * sum;
+  unsigned id = std::upper_bound(weights_.begin(), weights_.end(), r) - weights_.begin();
+  return std::min(id, size - 1);
+}
+
+}
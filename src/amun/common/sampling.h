@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace amunmt {
+
+struct Options;
+
+// xorshift64* generator of --sampling, one per sentence and seeded with its
+// line number, so that a sentence gets the same sample whatever thread or
+// batch decodes it
+class SampleRandom {
+  public:
+    SampleRandom(uint64_t seed, uint64_t lineNum);
+
+    // uniform in [0, 1)
+    float Uniform() {
+      state_ ^= state_ >> 12;
+      state_ ^= state_ << 25;
+      state_ ^= state_ >> 27;
+      return ((state_ * 0x2545F4914F6CDD1DULL) >> 40) * (1.0f / (1 << 24));
+    }
+
+  private:
+    uint64_t state_;
+};
+
+// Draws a word from scores, log-probabilities up to a constant: ancestral
+// sampling at --sampling-temperature, restricted to the --sampling-top-k best
+// words and to the --sampling-top-p nucleus when they are set.
+class Sampler {
+  public:
+    Sampler(const Options& options);
+
+    unsigned Sample(const float* scores, unsigned size, SampleRandom& random);
+
+  private:
+    unsigned SampleAll(const float* scores, unsigned size, float maxScore, SampleRandom& random);
+
+    float Weight(float score, float maxScore) const;
+
+    const unsigned topK_;
+    const float topP_;
+    const float invTemperature_;
+
+    // scratch space, a Sampler belongs to one decoder thread
+    std::vector<float> weights_;
+    std::vector<unsigned> ids_;
+};
+
+}
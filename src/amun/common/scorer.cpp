@@ -1,4 +1,5 @@
 #include "scorer.h"
+#include "exception.h"
 
 using namespace std;
 
@@ -14,4 +15,16 @@ Scorer::Scorer(const God &god,
 {
 }
 
+void Scorer::AssembleState(const State& in, const Words& words,
+                           const std::vector<unsigned>& stateIds, State& out)
+{
+  amunmt_UTIL_THROW2("Scorer " << name_ << " can only assemble beams of hypotheses");
+}
+
+void Scorer::GatherState(const std::vector<const State*>& in,
+                         const std::vector<unsigned>& rows, State& out)
+{
+  amunmt_UTIL_THROW2("Scorer " << name_ << " can't gather the states of different searches");
+}
+
 }
@@ -35,6 +35,16 @@ class State {
 typedef std::shared_ptr<State> StatePtr;
 typedef std::vector<StatePtr> States;
 
+// what a scorer keeps of the current sentences after Encode() and
+// BeginSentenceState(), taken out of one scorer and put into another scorer of
+// the same model on a different thread
+class EncodedSource {
+  public:
+    virtual ~EncodedSource() {}
+};
+
+typedef std::shared_ptr<EncodedSource> EncodedSourcePtr;
+
 class Scorer {
   public:
     Scorer(const God &god,
@@ -49,6 +59,16 @@ class Scorer {
 
     virtual void AssembleBeamState(const State& in, const Beam& beam, State& out) = 0;
 
+    // AssembleBeamState() for searches without hypotheses: row i of out
+    // continues row stateIds[i] of in with words[i]
+    virtual void AssembleState(const State& in, const Words& words,
+                               const std::vector<unsigned>& stateIds, State& out);
+
+    // row i of out is a copy of row rows[i] of *in[i], to decode the states
+    // of different searches of the current sentences as one batch
+    virtual void GatherState(const std::vector<const State*>& in,
+                             const std::vector<unsigned>& rows, State& out);
+
     virtual void Encode(const Sentences& sources) = 0;
 
     virtual void Filter(const std::vector<unsigned>&) = 0;
@@ -59,6 +79,14 @@ class Scorer {
 
     virtual void CleanAfterTranslation() {}
 
+    // moves the encoding of the current sentences out of the scorer, null if
+    // the scorer can't hand it over
+    virtual EncodedSourcePtr TakeEncodedSource()
+    { return EncodedSourcePtr(); }
+
+    // replaces Encode() and BeginSentenceState() with another scorer's work
+    virtual void SetEncodedSource(EncodedSource&) {}
+
     virtual const std::string& GetName() const {
       return name_;
     }
@@ -1,3 +1,4 @@
+#include <map>
 #include <boost/timer/timer.hpp>
 #include "common/search.h"
 #include "common/sentences.h"
@@ -6,6 +7,9 @@
 #include "common/histories.h"
 #include "common/filter.h"
 #include "common/base_matrix.h"
+#include "common/profiler.h"
+#include "common/tracer.h"
+#include "common/exception.h"
 
 #ifdef CUDA
 #include <cuda.h>
@@ -16,15 +20,80 @@ using namespace std;
 
 namespace amunmt {
 
+namespace {
+
+bool SameSource(const Sentence& a, const Sentence& b) {
+  if (a.GetNumTabs() != b.GetNumTabs()) {
+    return false;
+  }
+  for (unsigned i = 0; i < a.GetNumTabs(); ++i) {
+    if (a.GetWords(i) != b.GetWords(i) || a.GetFactors(i) != b.GetFactors(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// lends the encoding of a sentence to the scorers and takes it back when the
+// search is done, also when it throws, so the encoding isn't left with the
+// scorers' matrices
+class LentEncoding {
+  public:
+    LentEncoding(const std::vector<ScorerPtr>& scorers, std::vector<EncodedSourcePtr>& sources)
+      : scorers_(scorers),
+        sources_(sources)
+    {
+      for (unsigned i = 0; i < scorers_.size(); i++) {
+        scorers_[i]->SetEncodedSource(*sources_[i]);
+      }
+    }
+
+    ~LentEncoding()
+    {
+      Return();
+    }
+
+    void Return()
+    {
+      for (unsigned i = 0; i < scorers_.size(); i++) {
+        sources_[i] = scorers_[i]->TakeEncodedSource();
+      }
+      scorers_.clear();
+    }
+
+  private:
+    std::vector<ScorerPtr> scorers_;
+    std::vector<EncodedSourcePtr>& sources_;
+};
+
+}
+
 Search::Search(const God &god)
-  : deviceInfo_(god.GetNextDevice()),
-    scorers_(god.GetScorers(deviceInfo_)),
-    filter_(god.GetFilter()),
-    maxBeamSize_(god.Get<unsigned>("beam-size")),
-    normalizeScore_(god.Get<bool>("normalize")),
-    bestHyps_(god.GetBestHyps(deviceInfo_))
+  : Search(god, god.GetNextDevice(), god.GetModels())
 {}
 
+Search::Search(const God &god, const DeviceInfo &deviceInfo, std::shared_ptr<const ModelSet> models)
+  : god_(god),
+    deviceInfo_(deviceInfo),
+    models_(models),
+    followReloads_(models == god.GetModels()),
+    scorers_(god.GetScorers(*models_, deviceInfo_)),
+    filter_(god.GetFilter()),
+    maxBeamSize_(god.GetOptions().beamSize),
+    normalizeScore_(god.GetOptions().normalize),
+    sampling_(god.GetOptions().sampling),
+    samplingSeed_(god.GetOptions().samplingSeed),
+    bestHyps_(god.GetBestHyps(*models_, deviceInfo_)),
+    metrics_(god.GetMetrics()),
+    warmUp_(false)
+{
+  if (Tracer::IsEnabled()) {
+    for (auto& scorer : scorers_) {
+      traceNames_.push_back(Tracer::Intern(scorer->GetName()));
+    }
+  }
+}
+
 
 Search::~Search() {
 #ifdef CUDA
@@ -34,6 +103,20 @@ Search::~Search() {
 #endif
 }
 
+void Search::UpdateModels()
+{
+  if (!followReloads_ || god_.GetModelsVersion() == models_->version) {
+    return;
+  }
+
+  // the old scorers go before the weights they use
+  std::shared_ptr<const ModelSet> old = models_;
+  models_ = god_.GetModels();
+  scorers_ = god_.GetScorers(*models_, deviceInfo_);
+  bestHyps_ = god_.GetBestHyps(*models_, deviceInfo_);
+  LOG(progress)->info("Decoding with model version {}", models_->version);
+}
+
 void Search::CleanAfterTranslation()
 {
   for (auto scorer : scorers_) {
@@ -41,23 +124,62 @@ void Search::CleanAfterTranslation()
   }
 }
 
-std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
+std::shared_ptr<Histories> Search::Translate(const Sentences& sentences, EncodedSentencesPtr encoded,
+                                             const StablePrefixCallback& onStablePrefix) {
+  TraceScope trace("Translate", "search", "line", sentences.Get(0).GetLineNum());
   boost::timer::cpu_timer timer;
+  UpdateModels();
 
   if (filter_) {
     FilterTargetVocab(sentences);
   }
 
-  States states = Encode(sentences);
-  States nextStates = NewStates();
-  std::vector<unsigned> beamSizes(sentences.size(), 1);
+  States states;
+  if (encoded && encoded->version == models_->version) {
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      scorers_[i]->SetEncodedSource(*encoded->sources[i]);
+    }
+    states.swap(encoded->states);
+  } else {
+    states = Encode(sentences);
+  }
 
   std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_));
-  Beam prevHyps = histories->GetFirstHyps();
+  unsigned decoderStep;
+  if (sampling_) {
+    decoderStep = SampleSearch(sentences, *histories, states);
+  } else {
+    Beam prevHyps = histories->GetFirstHyps();
+    decoderStep = BeamSearch(sentences, histories, prevHyps, states, states, onStablePrefix);
+  }
 
-  for (unsigned decoderStep = 0; decoderStep < 3 * sentences.GetMaxLength(); ++decoderStep) {
+  CleanAfterTranslation();
+  if (!warmUp_) {
+    if (Profiler::IsEnabled()) {
+      Profiler::AddSentences(sentences.size(), decoderStep);
+    }
+    metrics_.CountSearch(sentences.size(), decoderStep);
+  }
+
+  LOG(progress)->info("Search took {}", timer.format(3, "%ws"));
+  return histories;
+}
+
+unsigned Search::BeamSearch(const Sentences& sentences,
+                            std::shared_ptr<Histories>& histories,
+                            Beam& prevHyps,
+                            States& begin,
+                            States& states,
+                            const StablePrefixCallback& onStablePrefix) {
+  States nextStates = NewStates();
+  std::vector<unsigned> beamSizes(histories->size(), 1);
+
+  unsigned decoderStep = 0;
+  for (; decoderStep < 3 * sentences.GetMaxLength(); ++decoderStep) {
+    TraceScope trace("step", "search", "step", decoderStep);
     for (unsigned i = 0; i < scorers_.size(); i++) {
-      scorers_[i]->Decode(*states[i], *nextStates[i], beamSizes);
+      TraceScope trace(TraceName(i), "scorer.decode");
+      scorers_[i]->Decode(decoderStep ? *states[i] : *begin[i], *nextStates[i], beamSizes);
     }
 
     if (decoderStep == 0) {
@@ -68,28 +190,473 @@ std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
     //cerr << "beamSizes=" << Debug(beamSizes, 1) << endl;
 
     bool hasSurvivors = CalcBeam(histories, beamSizes, prevHyps, states, nextStates);
+    if (onStablePrefix && hasSurvivors) {
+      for (unsigned i = 0; i < histories->size(); ++i) {
+        History& history = *histories->at(i);
+        if (beamSizes[i] && history.UpdateStablePrefix()) {
+          onStablePrefix(i, history.GetStablePrefix());
+        }
+      }
+    }
     if (!hasSurvivors) {
+      ++decoderStep;
+      break;
+    }
+  }
+  return decoderStep;
+}
+
+std::shared_ptr<Histories> Search::TranslateWithPrefix(PrefixSession& session,
+                                                       const Sentences& sentences,
+                                                       const Words& prefix) {
+  amunmt_UTIL_THROW_IF2(sentences.size() != 1, "Prefix decoding translates one sentence at a time");
+  TraceScope trace("TranslateWithPrefix", "search", "line", sentences.Get(0).GetLineNum());
+  boost::timer::cpu_timer timer;
+  std::lock_guard<std::mutex> lock(session.mutex_);
+  UpdateModels();
+
+  if (filter_) {
+    FilterTargetVocab(sentences, prefix);
+  }
+
+  const SentencePtr& sentence = sentences.at(0);
+  if (!session.sentence_ || session.version_ != models_->version || !SameSource(*session.sentence_, *sentence)) {
+    session.sentence_ = sentence;
+    session.version_ = models_->version;
+    session.encoded_.clear();
+    session.prefix_.clear();
+    session.states_.assign(1, Encode(sentences));
+    session.hyps_.assign(1, HypothesisPtr(new Hypothesis(*sentence)));
+  } else if (session.encoded_.empty()) {
+    Encode(sentences);
+  } else {
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      scorers_[i]->SetEncodedSource(*session.encoded_[i]);
+    }
+    // moved into the scorers until the search is done
+    session.encoded_.clear();
+  }
+
+  // only the words after the longest common prefix with the last call
+  unsigned reused = 0;
+  while (reused < session.prefix_.size() && reused < prefix.size()
+         && session.prefix_[reused] == prefix[reused]) {
+    ++reused;
+  }
+  session.prefix_.resize(reused);
+  session.states_.resize(reused + 1);
+  session.hyps_.resize(reused + 1);
+
+  States nextStates = NewStates();
+  const std::vector<unsigned> beamSizes(1, 1);
+  for (unsigned k = reused; k < prefix.size(); ++k) {
+    TraceScope trace("forced", "search", "step", k);
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.decode");
+      scorers_[i]->Decode(*session.states_[k][i], *nextStates[i], beamSizes);
+    }
+
+    Beam beam;
+    {
+      ProfileScope profile(Profiler::CALC_BEAM);
+      bestHyps_->CalcForced(Beam(1, session.hyps_[k]), scorers_, filterIndices_,
+                            Words(1, prefix[k]), beam);
+    }
+
+    ProfileScope profile(Profiler::ASSEMBLE_BEAM_STATE);
+    States states = NewStates();
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.assemble");
+      scorers_[i]->AssembleBeamState(*nextStates[i], beam, *states[i]);
+    }
+    session.prefix_.push_back(prefix[k]);
+    session.states_.push_back(states);
+    session.hyps_.push_back(beam[0]);
+  }
+
+  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_, prefix.size()));
+  for (unsigned k = 1; k < session.hyps_.size(); ++k) {
+    histories->Add(Beams(1, Beam(1, session.hyps_[k])));
+  }
+  Beam prevHyps(1, session.hyps_.back());
+  States states = NewStates();
+  unsigned decoderStep = BeamSearch(sentences, histories, prevHyps, session.states_.back(), states, nullptr);
+
+  // kept for the next call, unless a scorer can't hand it over
+  for (auto& scorer : scorers_) {
+    EncodedSourcePtr source = scorer->TakeEncodedSource();
+    if (!source) {
+      session.encoded_.clear();
       break;
     }
+    session.encoded_.push_back(source);
   }
 
   CleanAfterTranslation();
+  if (!warmUp_) {
+    if (Profiler::IsEnabled()) {
+      Profiler::AddSentences(1, decoderStep);
+    }
+    metrics_.CountSearch(1, decoderStep);
+  }
 
-  LOG(progress)->info("Search took {}", timer.format(3, "%ws"));
+  LOG(progress)->info("Search with a prefix of {} words, {} decoded, took {}",
+                      prefix.size(), prefix.size() - reused, timer.format(3, "%ws"));
   return histories;
 }
 
+unsigned Search::SampleSearch(const Sentences& sentences, Histories& histories, States& states) {
+  States nextStates = NewStates();
+  std::vector<unsigned> beamSizes(sentences.size(), 1);
+
+  // row i of the scorers' output continues the sample of sentence rows[i]
+  std::vector<unsigned> rows;
+  std::vector<SampleRandom> randoms;
+  for (unsigned i = 0; i < sentences.size(); ++i) {
+    rows.push_back(i);
+    randoms.emplace_back(samplingSeed_, sentences.Get(i).GetLineNum());
+  }
+  std::vector<Words> samples(sentences.size());
+  std::vector<std::vector<float>> costs(sentences.size());
+
+  Words words, nextWords;
+  std::vector<float> wordCosts;
+  std::vector<unsigned> stateIds;
+  unsigned decoderStep = 0;
+  while (!rows.empty()) {
+    TraceScope trace("step", "search", "step", decoderStep++);
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.decode");
+      scorers_[i]->Decode(*states[i], *nextStates[i], beamSizes);
+    }
+
+    {
+      ProfileScope profile(Profiler::CALC_BEAM);
+      bestHyps_->CalcSample(scorers_, filterIndices_, randoms, words, wordCosts);
+    }
+
+    nextWords.clear();
+    stateIds.clear();
+    unsigned live = 0;
+    for (unsigned i = 0; i < rows.size(); ++i) {
+      unsigned sentence = rows[i];
+      samples[sentence].push_back(words[i]);
+      costs[sentence].push_back((costs[sentence].empty() ? 0 : costs[sentence].back()) + wordCosts[i]);
+
+      // as long as beam search would go, see History::Add()
+      if (words[i] == EOS_ID || samples[sentence].size() == 3 * sentences.Get(sentence).size()) {
+        beamSizes[sentence] = 0;
+        continue;
+      }
+      nextWords.push_back(words[i]);
+      stateIds.push_back(i);
+      rows[live] = sentence;
+      randoms[live] = randoms[i];
+      ++live;
+    }
+    rows.resize(live);
+    randoms.erase(randoms.begin() + live, randoms.end());
+
+    if (live) {
+      ProfileScope profile(Profiler::ASSEMBLE_BEAM_STATE);
+      for (unsigned i = 0; i < scorers_.size(); i++) {
+        TraceScope trace(TraceName(i), "scorer.assemble");
+        scorers_[i]->AssembleState(*nextStates[i], nextWords, stateIds, *states[i]);
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < sentences.size(); ++i) {
+    History& history = *histories.at(i);
+    HypothesisPtr hyp = history.front()[0];
+    for (unsigned j = 0; j < samples[i].size(); ++j) {
+      hyp.reset(new Hypothesis(hyp, samples[i][j], 0, costs[i][j]));
+      history.Add({hyp});
+    }
+  }
+  return decoderStep;
+}
+
+std::vector<HypothesisPtr> Search::Rescore(const Sentences& sentences, const std::vector<Words>& targets) {
+  amunmt_UTIL_THROW_IF2(sentences.size() != 1, "Rescoring scores the candidates of one sentence at a time");
+  TraceScope trace("Rescore", "search", "line", sentences.Get(0).GetLineNum());
+  boost::timer::cpu_timer timer;
+  UpdateModels();
+
+  if (filter_) {
+    Words targetWords;
+    for (const Words& target : targets) {
+      targetWords.insert(targetWords.end(), target.begin(), target.end());
+    }
+    FilterTargetVocab(sentences, targetWords);
+  }
+
+  // one begin state per candidate
+  States states;
+  {
+    ProfileScope profile(Profiler::ENCODE);
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.encode");
+      scorers_[i]->Encode(sentences);
+      auto state = scorers_[i]->NewState();
+      scorers_[i]->BeginSentenceState(*state, targets.size());
+      states.emplace_back(state);
+    }
+  }
+  States nextStates = NewStates();
+
+  // row i of the scorers' output continues candidate rows[i]
+  std::vector<unsigned> rows;
+  for (unsigned i = 0; i < targets.size(); ++i) {
+    amunmt_UTIL_THROW_IF2(targets[i].empty(), "Empty candidate");
+    rows.push_back(i);
+  }
+  Beam prevHyps(targets.size(), HypothesisPtr(new Hypothesis(sentences.Get(0))));
+  std::vector<HypothesisPtr> results(targets.size());
+
+  Words words, nextWords;
+  std::vector<unsigned> stateIds;
+  unsigned decoderStep = 0;
+  for (; !rows.empty(); ++decoderStep) {
+    TraceScope trace("step", "search", "step", decoderStep);
+    const std::vector<unsigned> beamSizes(1, rows.size());
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.decode");
+      scorers_[i]->Decode(*states[i], *nextStates[i], beamSizes);
+    }
+
+    words.clear();
+    for (unsigned candidate : rows) {
+      words.push_back(targets[candidate][decoderStep]);
+    }
+    Beam beam;
+    {
+      ProfileScope profile(Profiler::CALC_BEAM);
+      bestHyps_->CalcForced(prevHyps, scorers_, filterIndices_, words, beam);
+    }
+
+    nextWords.clear();
+    stateIds.clear();
+    prevHyps.clear();
+    unsigned live = 0;
+    for (unsigned i = 0; i < rows.size(); ++i) {
+      unsigned candidate = rows[i];
+      if (decoderStep + 1 == targets[candidate].size()) {
+        results[candidate] = beam[i];
+        continue;
+      }
+      nextWords.push_back(words[i]);
+      stateIds.push_back(i);
+      prevHyps.push_back(beam[i]);
+      rows[live++] = candidate;
+    }
+    rows.resize(live);
+
+    if (live) {
+      ProfileScope profile(Profiler::ASSEMBLE_BEAM_STATE);
+      for (unsigned i = 0; i < scorers_.size(); i++) {
+        TraceScope trace(TraceName(i), "scorer.assemble");
+        scorers_[i]->AssembleState(*nextStates[i], nextWords, stateIds, *states[i]);
+      }
+    }
+  }
+
+  CleanAfterTranslation();
+  metrics_.CountSearch(1, decoderStep);
+
+  LOG(progress)->info("Rescoring {} candidates took {}", targets.size(), timer.format(3, "%ws"));
+  return results;
+}
+
+std::vector<StateRow> Search::ExtendStates(const Sentences& sentences,
+                                           const std::shared_ptr<const ModelSet>& models,
+                                           EncodedSentences& encoded,
+                                           const std::vector<const StateRow*>& parents,
+                                           const std::vector<Words>& phrases) {
+  amunmt_UTIL_THROW_IF2(sentences.size() != 1, "Phrases are scored for one sentence at a time");
+  TraceScope trace("ExtendStates", "search", "line", sentences.Get(0).GetLineNum());
+  boost::timer::cpu_timer timer;
+
+  std::vector<StateRow> results(parents.size());
+  // extensions still decoding, and the row of states each one continues
+  std::vector<unsigned> live, rows;
+  for (unsigned i = 0; i < parents.size(); ++i) {
+    if (phrases[i].empty()) {
+      results[i] = *parents[i];
+    } else {
+      live.push_back(i);
+    }
+  }
+  if (live.empty()) {
+    return results;
+  }
+
+  UpdateModels();
+  amunmt_UTIL_THROW_IF2(encoded.version != models->version, "The sentence was encoded by other models");
+  if (models != models_) {
+    // the sentence was encoded before God::Reload() and finishes with the
+    // models it was encoded with, on scorers of this thread's device
+    Search old(god_, deviceInfo_, models);
+    return old.ExtendStates(sentences, models, encoded, parents, phrases);
+  }
+  amunmt_UTIL_THROW_IF2(encoded.sources.size() != scorers_.size(), "The sentence is not encoded");
+
+  if (filter_) {
+    Words targetWords;
+    for (const Words& phrase : phrases) {
+      targetWords.insert(targetWords.end(), phrase.begin(), phrase.end());
+    }
+    FilterTargetVocab(sentences, targetWords);
+  }
+
+  LentEncoding lent(scorers_, encoded.sources);
+
+  // a row for every distinct parent state
+  States states = NewStates();
+  Beam rowHyps;
+  {
+    ProfileScope profile(Profiler::ASSEMBLE_BEAM_STATE);
+    std::map<std::pair<const State*, unsigned>, unsigned> parentRows;
+    std::vector<const StateRow*> unique;
+    for (unsigned i : live) {
+      auto key = std::make_pair(parents[i]->states[0].get(), parents[i]->row);
+      auto found = parentRows.emplace(key, unique.size());
+      if (found.second) {
+        unique.push_back(parents[i]);
+        rowHyps.push_back(parents[i]->hyp);
+      }
+      rows.push_back(found.first->second);
+    }
+
+    std::vector<const State*> in(unique.size());
+    std::vector<unsigned> inRows;
+    for (const StateRow* parent : unique) {
+      inRows.push_back(parent->row);
+    }
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      for (unsigned j = 0; j < unique.size(); ++j) {
+        in[j] = unique[j]->states[i].get();
+      }
+      scorers_[i]->GatherState(in, inRows, *states[i]);
+    }
+  }
+  States nextStates = NewStates();
+
+  Words words;
+  std::vector<unsigned> stateIds, continued;
+  unsigned decoderStep = 0;
+  for (; !live.empty(); ++decoderStep) {
+    TraceScope trace("step", "search", "step", decoderStep);
+    const std::vector<unsigned> beamSizes(1, rowHyps.size());
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.decode");
+      scorers_[i]->Decode(*states[i], *nextStates[i], beamSizes);
+    }
+
+    // a new row for every distinct row and word
+    std::map<std::pair<unsigned, Word>, unsigned> nextRows;
+    words.clear();
+    stateIds.clear();
+    Beam prevHyps;
+    for (unsigned j = 0; j < live.size(); ++j) {
+      Word word = phrases[live[j]][decoderStep];
+      auto found = nextRows.emplace(std::make_pair(rows[j], word), words.size());
+      if (found.second) {
+        words.push_back(word);
+        stateIds.push_back(rows[j]);
+        prevHyps.push_back(rowHyps[rows[j]]);
+      }
+      rows[j] = found.first->second;
+    }
+
+    Beam beam;
+    {
+      ProfileScope profile(Profiler::CALC_BEAM);
+      bestHyps_->CalcForced(prevHyps, scorers_, filterIndices_, words, beam, stateIds);
+    }
+
+    ProfileScope profile(Profiler::ASSEMBLE_BEAM_STATE);
+    States stepStates = NewStates();
+    for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.assemble");
+      scorers_[i]->AssembleState(*nextStates[i], words, stateIds, *stepStates[i]);
+    }
+
+    // finished extensions keep the rows of this step, the others go on with
+    // a compacted batch
+    std::vector<unsigned> compacted(beam.size(), beam.size());
+    continued.clear();
+    unsigned numLive = 0;
+    for (unsigned j = 0; j < live.size(); ++j) {
+      unsigned i = live[j];
+      unsigned row = rows[j];
+      if (decoderStep + 1 == phrases[i].size()) {
+        results[i] = { stepStates, row, beam[row] };
+        continue;
+      }
+      if (compacted[row] == beam.size()) {
+        compacted[row] = continued.size();
+        continued.push_back(row);
+      }
+      live[numLive] = i;
+      rows[numLive++] = compacted[row];
+    }
+    live.resize(numLive);
+    rows.resize(numLive);
+
+    rowHyps.clear();
+    for (unsigned row : continued) {
+      rowHyps.push_back(beam[row]);
+    }
+    if (continued.size() == beam.size()) {
+      states = stepStates;
+    } else if (!continued.empty()) {
+      states = NewStates();
+      for (unsigned i = 0; i < scorers_.size(); i++) {
+        std::vector<const State*> in(continued.size(), stepStates[i].get());
+        scorers_[i]->GatherState(in, continued, *states[i]);
+      }
+    }
+  }
+
+  lent.Return();
+  CleanAfterTranslation();
+  metrics_.CountSearch(1, decoderStep);
+
+  LOG(progress)->info("Scoring {} phrases took {}", parents.size(), timer.format(3, "%ws"));
+  return results;
+}
+
 States Search::Encode(const Sentences& sentences) {
+  ProfileScope profile(Profiler::ENCODE);
   States states;
-  for (auto& scorer : scorers_) {
-    scorer->Encode(sentences);
-    auto state = scorer->NewState();
-    scorer->BeginSentenceState(*state, sentences.size());
+  for (unsigned i = 0; i < scorers_.size(); i++) {
+    TraceScope trace(TraceName(i), "scorer.encode");
+    scorers_[i]->Encode(sentences);
+    auto state = scorers_[i]->NewState();
+    scorers_[i]->BeginSentenceState(*state, sentences.size());
     states.emplace_back(state);
   }
   return states;
 }
 
+EncodedSentencesPtr Search::EncodeOnly(const Sentences& sentences) {
+  TraceScope trace("Encode", "search", "line", sentences.Get(0).GetLineNum());
+  UpdateModels();
+  EncodedSentencesPtr encoded(new EncodedSentences());
+  encoded->states = Encode(sentences);
+  encoded->version = models_->version;
+  for (auto& scorer : scorers_) {
+    EncodedSourcePtr source = scorer->TakeEncodedSource();
+    if (!source) {
+      return EncodedSentencesPtr();
+    }
+    encoded->sources.push_back(source);
+  }
+  CleanAfterTranslation();
+  return encoded;
+}
+
 bool Search::CalcBeam(
     std::shared_ptr<Histories>& histories,
     std::vector<unsigned>& beamSizes,
@@ -99,8 +666,11 @@ bool Search::CalcBeam(
 {
     unsigned batchSize = beamSizes.size();
     Beams beams(batchSize);
-    bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes);
-    histories->Add(beams);
+    {
+      ProfileScope profile(Profiler::CALC_BEAM);
+      bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes);
+      histories->Add(beams);
+    }
 
     Beam survivors;
     for (unsigned batchId = 0; batchId < batchSize; ++batchId) {
@@ -111,13 +681,18 @@ bool Search::CalcBeam(
           --beamSizes[batchId];
         }
       }
+      if (beamSizes[batchId] && !warmUp_) {
+        metrics_.CountBeamOccupancy(beamSizes[batchId], maxBeamSize_);
+      }
     }
 
     if (survivors.size() == 0) {
       return false;
     }
 
+    ProfileScope profile(Profiler::ASSEMBLE_BEAM_STATE);
     for (unsigned i = 0; i < scorers_.size(); i++) {
+      TraceScope trace(TraceName(i), "scorer.assemble");
       scorers_[i]->AssembleBeamState(*nextStates[i], survivors, *states[i]);
     }
 
@@ -135,7 +710,7 @@ States Search::NewStates() const {
   return states;
 }
 
-void Search::FilterTargetVocab(const Sentences& sentences) {
+void Search::FilterTargetVocab(const Sentences& sentences, const Words& targetWords) {
   unsigned vocabSize = scorers_[0]->GetVocabSize();
   std::set<Word> srcWords;
   for (unsigned i = 0; i < sentences.size(); ++i) {
@@ -146,6 +721,15 @@ void Search::FilterTargetVocab(const Sentences& sentences) {
   }
 
   filterIndices_ = filter_->GetFilteredVocab(srcWords, vocabSize);
+  if (!targetWords.empty()) {
+    // forced words are scored whatever the shortlist
+    std::set<Word> filtered(filterIndices_.begin(), filterIndices_.end());
+    filtered.insert(targetWords.begin(), targetWords.end());
+    filterIndices_.assign(filtered.begin(), filtered.end());
+  }
+  if (!warmUp_) {
+    metrics_.CountShortlist(filterIndices_.size());
+  }
   for (auto& scorer : scorers_) {
     scorer->Filter(filterIndices_);
   }
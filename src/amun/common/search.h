@@ -1,7 +1,9 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <set>
+#include <functional>
 
 #include "common/scorer.h"
 #include "common/sentence.h"
@@ -11,20 +13,135 @@ namespace amunmt {
 
 class Histories;
 class Filter;
+class Metrics;
+struct ModelSet;
+
+// begin states and encoder output of a mini-batch, encoded by one Search and
+// decoded by another, see --encoder-threads
+struct EncodedSentences {
+  States states;
+  std::vector<EncodedSourcePtr> sources;
+  // of the models, see God::Reload()
+  unsigned version;
+};
+
+typedef std::shared_ptr<EncodedSentences> EncodedSentencesPtr;
+
+// called during Translate() whenever the stable prefix of a sentence grew, see
+// History::UpdateStablePrefix(); gets the index of the sentence in the batch
+typedef std::function<void(unsigned, const Words&)> StablePrefixCallback;
+
+// what Search::TranslateWithPrefix() keeps of a sentence between calls: the
+// encoding of the source and the decoder states after every word of the last
+// prefix. A session is used by one call at a time.
+class PrefixSession {
+  public:
+    PrefixSession() {}
+
+  private:
+    friend class Search;
+
+    std::mutex mutex_;
+    SentencePtr sentence_;
+    unsigned version_;
+    // empty if a scorer can't hand over its encoding
+    std::vector<EncodedSourcePtr> encoded_;
+    Words prefix_;
+    // states_[k] and hyps_[k] follow the first k words of prefix_
+    std::vector<States> states_;
+    Beam hyps_;
+
+    PrefixSession(const PrefixSession&) = delete;
+};
+
+typedef std::shared_ptr<PrefixSession> PrefixSessionPtr;
+
+// a row of a batch of decoder states, ready to decode the next word, and the
+// hypothesis of the words before it; see Search::ExtendStates()
+struct StateRow {
+  States states;
+  unsigned row;
+  HypothesisPtr hyp;
+};
 
 class Search {
   public:
     Search(const God &god);
+    // decodes with models and not with the current models of god, to warm
+    // them up before God::Reload() swaps them in
+    Search(const God &god, const DeviceInfo &deviceInfo, std::shared_ptr<const ModelSet> models);
     virtual ~Search();
 
-    std::shared_ptr<Histories> Translate(const Sentences& sentences);
+    // the models the next search decodes with, unless they are reloaded meanwhile
+    const std::shared_ptr<const ModelSet>& GetModels() const
+    { return models_; }
+
+    // encodes the sentences unless encoded is given
+    std::shared_ptr<Histories> Translate(const Sentences& sentences,
+                                         EncodedSentencesPtr encoded = EncodedSentencesPtr(),
+                                         const StablePrefixCallback& onStablePrefix = nullptr);
+
+    // the encoder half of Translate(); null if a scorer can't hand over its
+    // encoding, Translate() then encodes again
+    EncodedSentencesPtr EncodeOnly(const Sentences& sentences);
+
+    // interactive translation of a single sentence: the translation starts
+    // with prefix, forced word by word, and continues with beam search. Calls
+    // with the same session and source reuse its encoding and only decode the
+    // words of prefix that differ from the previous call's.
+    std::shared_ptr<Histories> TranslateWithPrefix(PrefixSession& session,
+                                                   const Sentences& sentences,
+                                                   const Words& prefix);
+
+    // forced decoding of candidate translations of one sentence, each ending
+    // with </s>: all candidates are decoded as one batch after a single
+    // encoder pass. Returns the last hypothesis of every candidate, with the
+    // cost breakdown by scorer.
+    std::vector<HypothesisPtr> Rescore(const Sentences& sentences, const std::vector<Words>& targets);
+
+    // forced decoding of phrases after decoder states of one sentence, for
+    // the Moses plugin: extends *parents[i] with phrases[i]. All extensions
+    // are decoded as one batch, a parent or phrase prefix they share only
+    // once. encoded is the sentence's EncodeOnly() with models, the
+    // GetModels() of that call, and is lent to the scorers; a sentence
+    // encoded before God::Reload() is decoded with its old models to the end.
+    std::vector<StateRow> ExtendStates(const Sentences& sentences,
+                                       const std::shared_ptr<const ModelSet>& models,
+                                       EncodedSentences& encoded,
+                                       const std::vector<const StateRow*>& parents,
+                                       const std::vector<Words>& phrases);
+
+    // switches to the current models of god_ if they were reloaded
+    void UpdateModels();
+
+    // for the warm-up of models: searches are left out of the metrics and
+    // the sentence counts of the profiler
+    void SetWarmUp()
+    { warmUp_ = true; }
 
   protected:
+
     States NewStates() const;
-    void FilterTargetVocab(const Sentences& sentences);
+    void FilterTargetVocab(const Sentences& sentences, const Words& targetWords = Words());
     States Encode(const Sentences& sentences);
+
+    // beam search from prevHyps, the first step decodes begin and the others
+    // states; returns the number of steps
+    unsigned BeamSearch(const Sentences& sentences,
+                        std::shared_ptr<Histories>& histories,
+                        Beam& prevHyps,
+                        States& begin,
+                        States& states,
+                        const StablePrefixCallback& onStablePrefix);
+
+    // --sampling instead of BeamSearch(): one hypothesis per sentence, which
+    // are only created once the samples are complete
+    unsigned SampleSearch(const Sentences& sentences, Histories& histories, States& states);
     void CleanAfterTranslation();
 
+    const char* TraceName(unsigned scorer) const
+    { return traceNames_.empty() ? "scorer" : traceNames_[scorer]; }
+
     bool CalcBeam(
     		std::shared_ptr<Histories>& histories,
     		std::vector<unsigned>& beamSizes,
@@ -35,13 +152,24 @@ class Search {
     Search(const Search&) = delete;
 
   protected:
+    const God &god_;
     DeviceInfo deviceInfo_;
+    // keeps the weights of scorers_ alive
+    std::shared_ptr<const ModelSet> models_;
+    const bool followReloads_;
     std::vector<ScorerPtr> scorers_;
     std::shared_ptr<const Filter> filter_;
     const unsigned maxBeamSize_;
     bool normalizeScore_;
+    const bool sampling_;
+    const unsigned samplingSeed_;
     Words filterIndices_;
     BestHypsBasePtr bestHyps_;
+    Metrics& metrics_;
+    bool warmUp_;
+
+    // scorer names for the timeline, only filled in when tracing
+    std::vector<const char*> traceNames_;
 };
 
 }
@@ -2,46 +2,86 @@
 #include "god.h"
 #include "utils.h"
 #include "common/vocab.h"
+#include "common/factor_vocab.h"
 
 using namespace std;
 
 namespace amunmt {
 
+namespace {
+
+// scratch space reused by every sentence parsed on the same thread, so that
+// tokenization doesn't allocate once the buffers have grown to fit the input
+struct TokenizerBuffers {
+  std::vector<boost::string_ref> tabs;
+  std::vector<boost::string_ref> tokens;
+  std::vector<boost::string_ref> factors;
+  std::vector<Factor> factorIds;
+  std::vector<std::string> pieces;
+  std::string word;
+};
+
+thread_local TokenizerBuffers buffers;
+
+}
+
 Sentence::Sentence(const God &god, unsigned vLineNum, const std::string& line)
   : lineNum_(vLineNum)
 {
-  std::vector<std::string> tabs;
-  Split(line, tabs, "\t");
+  std::vector<boost::string_ref>& tabs = buffers.tabs;
+  tabs.clear();
+  Split(line, tabs, '\t');
   if (tabs.size() == 0) {
     tabs.push_back("");
   }
 
-  unsigned maxLength = god.Get<unsigned>("max-length");
-  unsigned i = 0;
-  for (auto& tab : tabs) {
-    std::vector<std::string> lineTokens;
-    Trim(tab);
-    Split(tab, lineTokens, " ");
+  unsigned maxLength = god.GetOptions().maxLength;
+  words_.resize(tabs.size());
+  factors_.resize(tabs.size());
 
-    if (maxLength && lineTokens.size() > maxLength) {
-      lineTokens.resize(maxLength);
-    }
+  for (unsigned i = 0; i < tabs.size(); ++i) {
+    std::vector<boost::string_ref>& tokens = buffers.tokens;
+    tokens.clear();
+    Split(Trim(tabs[i]), tokens, ' ');
 
-    std::vector<std::vector<std::string>> lineFactors;
-    for (const std::string& token : lineTokens) {
-      std::vector<std::string> wordFactors;
-      Split(token, wordFactors, "|");
-      lineFactors.push_back(wordFactors);
+    if (maxLength && tokens.size() > maxLength) {
+      tokens.resize(maxLength);
     }
 
-    auto processed = god.Preprocess(i, lineFactors);
-    factors_.emplace_back(god.GetSourceVocabs(i)(processed));
-    Words lineWords(factors_.back().size());
-    for (unsigned i = 0; i < factors_.back().size(); ++i) {
-      lineWords[i] = factors_.back()[i][0];
+    const FactorVocab& vocabs = god.GetSourceVocabs(i);
+    Words& words = words_[i];
+    FactWords& factors = factors_[i];
+    words.reserve(tokens.size() + 1);
+    factors.reserve(tokens.size() + 1);
+
+    for (const boost::string_ref& token : tokens) {
+      buffers.factors.clear();
+      Split(token, buffers.factors, '|');
+      if (buffers.factors.empty()) {
+        buffers.factors.push_back(token);
+      }
+
+      // ids of the factors other than the surface form are shared by all its pieces
+      unsigned numFactors = buffers.factors.size();
+      buffers.factorIds.resize(numFactors);
+      for (unsigned f = 1; f < numFactors; ++f) {
+        buffers.word.assign(buffers.factors[f].data(), buffers.factors[f].size());
+        buffers.factorIds[f] = vocabs.GetVocab(f)[buffers.word];
+      }
+
+      buffers.word.assign(buffers.factors[0].data(), buffers.factors[0].size());
+      god.PreprocessWord(i, buffers.word, buffers.pieces);
+
+      const Vocab& vocab = vocabs.GetVocab(0);
+      for (const std::string& piece : buffers.pieces) {
+        buffers.factorIds[0] = vocab[piece];
+        words.push_back(buffers.factorIds[0]);
+        factors.emplace_back(buffers.factorIds.begin(), buffers.factorIds.end());
+      }
     }
-    words_.emplace_back(lineWords);
-    i++;
+
+    words.push_back(EOS_ID);
+    factors.emplace_back(factors.empty() ? 1 : factors.back().size(), EOS_ID);
   }
 }
 
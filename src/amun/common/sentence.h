@@ -1,4 +1,5 @@
 #pragma once
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <string>
@@ -21,6 +22,35 @@ class Sentence {
 
     unsigned GetLineNum() const;
 
+    unsigned GetNumTabs() const
+    { return words_.size(); }
+
+    // when the sentence reached each stage of the pipeline, for LatencyStats
+    struct Timestamps {
+      std::chrono::steady_clock::time_point read;
+      std::chrono::steady_clock::time_point enqueued;
+      std::chrono::steady_clock::time_point decodeStart;
+    };
+
+    const Timestamps& GetTimestamps() const
+    { return timestamps_; }
+
+    Timestamps& GetTimestamps()
+    { return timestamps_; }
+
+    // identical sentences of the same maxi-batch, which get the translation of
+    // this one instead of being decoded (--cache-size)
+    std::vector<std::shared_ptr<Sentence>>& GetDuplicates()
+    { return duplicates_; }
+
+    // the key the translation cache was looked up with, so the translation is
+    // stored under the models it was looked up for even if they are reloaded
+    // meanwhile; empty if the cache was not looked up
+    const std::string& GetCacheKey() const
+    { return cacheKey_; }
+
+    void SetCacheKey(const std::string& key)
+    { cacheKey_ = key; }
 
   private:
     void FillDummyFactors(const Words& line);
@@ -28,6 +58,9 @@ class Sentence {
     std::vector<Words> words_;
     std::vector<FactWords> factors_;
     unsigned lineNum_;
+    Timestamps timestamps_;
+    std::vector<std::shared_ptr<Sentence>> duplicates_;
+    std::string cacheKey_;
 
     Sentence(const Sentence &) = delete;
 };
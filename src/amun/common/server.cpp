@@ -0,0 +1,523 @@
+#include "common/server.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <yaml-cpp/yaml.h>
+
+#include "common/god.h"
+#include "common/dynamic_batcher.h"
+#include "common/exception.h"
+#include "common/histories.h"
+#include "common/printer.h"
+#include "common/sentences.h"
+#include "common/translation_task.h"
+#include "common/utils.h"
+
+namespace amunmt {
+
+namespace {
+
+std::atomic<bool> stopRequested(false);
+
+void RequestStop(int) {
+  stopRequested = true;
+}
+
+// responses are sent from the decoder threads, so a client that stops
+// reading can hold one up for at most this long before it is disconnected
+const time_t SEND_TIMEOUT_SECONDS = 1;
+
+}
+
+struct Server::Connection {
+  Connection(int fd)
+    : fd(fd), nextSeq(0), closed(false)
+  {}
+
+  ~Connection() {
+    close(fd);
+  }
+
+  // callers hold mutex
+  void Send(const std::string& line) {
+    std::string data = line + "\n";
+    size_t sent = 0;
+    while (!closed && sent < data.size()) {
+      ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (n < 0 && errno != EINTR) {
+        // the client may have got part of the line, so it gets nothing more
+        closed = true;
+        shutdown(fd, SHUT_RDWR);
+      } else if (n > 0) {
+        sent += n;
+      }
+    }
+  }
+
+  int fd;
+  std::mutex mutex;
+
+  // plain responses that wait for the ones of earlier lines
+  std::map<unsigned, std::string> pending;
+  unsigned nextSeq;
+
+  // unanswered JSON requests by id, for cancellation
+  std::map<std::string, std::weak_ptr<Request>> active;
+
+  // set when the client went away, its requests are not translated any more
+  std::atomic<bool> closed;
+};
+
+struct Server::Request {
+  ConnectionPtr connection;
+  SentencePtr sentence;
+  std::string cacheKey;
+  // identical requests of the same batch, answered with this one's translation
+  std::vector<RequestPtr> duplicates;
+  bool json;
+  std::string id;
+  unsigned seq;
+  Clock::time_point arrived;
+
+  // whoever sets answered first sends the only response to the request
+  std::atomic<bool> cancelled{false};
+  std::atomic<bool> answered{false};
+};
+
+Server::Server(God &god)
+  : god_(god),
+    nextLineNum_(0),
+    inFlight_(0),
+    activeReaders_(0)
+{}
+
+Server::~Server()
+{}
+
+int Server::Listen()
+{
+  int fd;
+  if (god_.Has("socket")) {
+    std::string path = god_.Get<std::string>("socket");
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    amunmt_UTIL_THROW_IF2(path.size() >= sizeof(addr.sun_path), "Socket path too long: " << path);
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    amunmt_UTIL_THROW_IF2(fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0,
+                          "Could not bind to " << path << ": " << strerror(errno));
+    LOG(info)->info("Listening on {}", path);
+  } else {
+    unsigned port = god_.Get<unsigned>("port");
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    amunmt_UTIL_THROW_IF2(fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0,
+                          "Could not bind to port " << port << ": " << strerror(errno));
+    LOG(info)->info("Listening on 127.0.0.1:{}", port);
+  }
+
+  amunmt_UTIL_THROW_IF2(listen(fd, 64) < 0, "Could not listen: " << strerror(errno));
+  return fd;
+}
+
+void Server::Run()
+{
+  int listenFd = Listen();
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = RequestStop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  batcher_.reset(new DynamicBatcher<RequestPtr>(god_, [this](std::vector<RequestPtr> batch) {
+    Dispatch(batch);
+  }));
+
+  // poll with a timeout so that a signal is noticed even without connections
+  while (!stopRequested) {
+    pollfd pfd = { listenFd, POLLIN, 0 };
+    if (poll(&pfd, 1, 200) <= 0) {
+      continue;
+    }
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+
+    timeval timeout = { SEND_TIMEOUT_SECONDS, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    ConnectionPtr connection(new Connection(fd));
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    connections_.insert(connection);
+    ++activeReaders_;
+    std::thread(&Server::Serve, this, connection).detach();
+  }
+
+  LOG(info)->info("Shutting down, finishing accepted requests");
+  close(listenFd);
+  if (god_.Has("socket")) {
+    unlink(god_.Get<std::string>("socket").c_str());
+  }
+
+  // stop reading, but keep the connections open for the responses
+  {
+    std::unique_lock<std::mutex> lock(connectionsMutex_);
+    for (auto& connection : connections_) {
+      shutdown(connection->fd, SHUT_RD);
+    }
+    readersDone_.wait(lock, [this] { return activeReaders_ == 0; });
+  }
+
+  batcher_->Stop();
+
+  std::unique_lock<std::mutex> lock(inFlightMutex_);
+  inFlightDone_.wait(lock, [this] { return inFlight_ == 0; });
+}
+
+void Server::Serve(ConnectionPtr connection)
+{
+  std::string buffer;
+  char chunk[65536];
+  unsigned plainSeq = 0;
+
+  while (true) {
+    ssize_t n = recv(connection->fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      // e.g. ECONNRESET, the client went away and doesn't need its
+      // translations, but on shutdown the accepted requests are still answered
+      if (!stopRequested) {
+        connection->closed = true;
+      }
+      break;
+    }
+    if (n == 0) {
+      // a client that half-closed after its last request still gets the
+      // answers, and that request needs no trailing newline; on shutdown
+      // the rest of the buffer may be a line the client is still sending
+      if (!buffer.empty() && !stopRequested) {
+        if (buffer.back() == '\r') {
+          buffer.pop_back();
+        }
+        Handle(connection, buffer, plainSeq);
+      }
+      break;
+    }
+    buffer.append(chunk, n);
+
+    size_t start = 0, end;
+    while ((end = buffer.find('\n', start)) != std::string::npos) {
+      std::string line = buffer.substr(start, end - start);
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      Handle(connection, line, plainSeq);
+      start = end + 1;
+    }
+    buffer.erase(0, start);
+  }
+
+  std::lock_guard<std::mutex> lock(connectionsMutex_);
+  connections_.erase(connection);
+  --activeReaders_;
+  readersDone_.notify_all();
+}
+
+void Server::Handle(ConnectionPtr connection, const std::string& line, unsigned& plainSeq)
+{
+  RequestPtr request(new Request());
+  request->connection = connection;
+  request->arrived = Clock::now();
+  unsigned lineNum = nextLineNum_++;
+
+  std::string text;
+  size_t first = line.find_first_not_of(" \t");
+  request->json = (first != std::string::npos && line[first] == '{');
+
+  if (request->json) {
+    // everything is read inside the try, yaml-cpp throws on the conversions too
+    bool cancel = false;
+    std::string id, error;
+    try {
+      YAML::Node node = YAML::Load(line);
+      cancel = node["cancel"].IsDefined();
+      if (!cancel && !node["text"]) {
+        error = "request without text";
+      }
+      for (const char* field : { "cancel", "text", "id" }) {
+        if (node[field] && !node[field].IsScalar()) {
+          error = std::string(field) + " is not a string";
+        }
+      }
+
+      if (error.empty() && cancel) {
+        id = node["cancel"].as<std::string>();
+      } else if (error.empty()) {
+        text = node["text"].as<std::string>();
+        id = node["id"] ? node["id"].as<std::string>() : std::to_string(lineNum);
+      }
+    } catch (YAML::Exception& e) {
+      error = e.what();
+    }
+
+    if (!error.empty()) {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      connection->Send("{\"error\": " + JsonString(error) + "}");
+      return;
+    }
+
+    if (cancel) {
+      std::lock_guard<std::mutex> lock(connection->mutex);
+      auto it = connection->active.find(id);
+      RequestPtr cancelled = (it != connection->active.end()) ? it->second.lock() : nullptr;
+      if (cancelled) {
+        cancelled->cancelled = true;
+        if (!cancelled->answered.exchange(true)) {
+          connection->active.erase(it);
+          connection->Send("{\"id\": " + JsonString(id) + ", \"cancelled\": true}");
+          return;
+        }
+      }
+      connection->Send("{\"id\": " + JsonString(id) + ", \"error\": \"no pending request with this id\"}");
+      return;
+    }
+    request->id = id;
+
+    std::lock_guard<std::mutex> lock(connection->mutex);
+    // otherwise the earlier request could not be cancelled any more
+    auto it = connection->active.find(id);
+    if (it != connection->active.end() && !it->second.expired()) {
+      connection->Send("{\"id\": " + JsonString(id) + ", \"error\": \"a request with this id is pending\"}");
+      return;
+    }
+    connection->active[id] = request;
+  } else {
+    text = line;
+    request->seq = plainSeq++;
+  }
+
+  // e.g. invalid UTF-8 with --bpe fails this request, not the server
+  try {
+    request->sentence.reset(new Sentence(god_, lineNum, text));
+  } catch (std::exception& e) {
+    RespondError(*request, e.what());
+    return;
+  }
+  request->sentence->GetTimestamps().read = request->arrived;
+  god_.GetMetrics().SentenceStarted();
+
+  TranslationCache& cache = god_.GetTranslationCache();
+  if (cache.Enabled()) {
+    request->cacheKey = cache.GetKey(*request->sentence);
+    TranslationCache::Entry cached;
+    if (cache.Get(request->cacheKey, cached)) {
+      request->sentence->GetTimestamps().enqueued = request->arrived;
+      request->sentence->GetTimestamps().decodeStart = request->arrived;
+      god_.GetLatencyStats().Record(*request->sentence, cached.targetLength);
+      Respond(*request, cached.output);
+      god_.GetMetrics().SentenceFinished();
+      return;
+    }
+  }
+  batcher_->Submit({request});
+}
+
+void Server::Dispatch(std::vector<RequestPtr> batch)
+{
+  {
+    std::lock_guard<std::mutex> lock(inFlightMutex_);
+    ++inFlight_;
+  }
+  // blocks while the pool is busy, meanwhile new requests pile up in the
+  // queue and form the next batch
+  god_.GetThreadPool().enqueue([this, batch] { Translate(batch); });
+}
+
+void Server::Translate(std::vector<RequestPtr> batch)
+{
+  TranslationCache& cache = god_.GetTranslationCache();
+  std::map<std::string, RequestPtr> unique;
+
+  std::vector<RequestPtr> requests;
+  for (auto& request : batch) {
+    if (request->cancelled || request->connection->closed) {
+      continue;
+    }
+    if (cache.Enabled()) {
+      auto it = unique.find(request->cacheKey);
+      if (it != unique.end()) {
+        it->second->duplicates.push_back(request);
+        cache.CountDuplicate();
+        continue;
+      }
+      unique.emplace(request->cacheKey, request);
+    }
+    requests.push_back(request);
+  }
+
+  if (!requests.empty()) {
+    // longest first, as in the mini-batches of the input pipeline
+    std::stable_sort(requests.begin(), requests.end(), [](const RequestPtr& a, const RequestPtr& b) {
+      return a->sentence->size() > b->sentence->size();
+    });
+
+    SentencesPtr sentences(new Sentences());
+    for (auto& request : requests) {
+      sentences->push_back(request->sentence);
+    }
+
+    StablePrefixCallback onStablePrefix;
+    std::vector<std::string> partials;
+    if (god_.GetOptions().stablePrefix) {
+      partials.resize(requests.size());
+      onStablePrefix = [&](unsigned i, const Words& prefix) {
+        std::string partial = GetStablePrefixString(god_, prefix);
+        if (partial != partials[i]) {
+          RespondPartial(*requests[i], partial);
+          for (auto& duplicate : requests[i]->duplicates) {
+            RespondPartial(*duplicate, partial);
+          }
+          partials[i].swap(partial);
+        }
+      };
+    }
+
+    // an error fails the requests of this batch, not the server
+    std::shared_ptr<Histories> histories;
+    std::string error;
+    try {
+      histories = TryTranslationTask(god_, sentences, nullptr, onStablePrefix);
+    } catch (std::exception& e) {
+      error = e.what();
+    } catch (...) {
+      error = "translation failed";
+    }
+
+    if (!histories) {
+      LOG(info)->error("Translation of a batch of {} requests failed: {}", requests.size(), error);
+      for (auto& request : requests) {
+        RespondError(*request, error);
+        for (auto& duplicate : request->duplicates) {
+          RespondError(*duplicate, error);
+        }
+      }
+    }
+
+    for (unsigned i = 0; histories && i < histories->size(); ++i) {
+      Request& request = *requests[i];
+      if (request.cancelled && request.duplicates.empty()) {
+        continue;
+      }
+
+      const History& history = *histories->at(i);
+      std::stringstream strm;
+      Printer(god_, history, strm, *request.sentence);
+      std::string translation = strm.str();
+      unsigned targetLength = history.Top().first.size();
+
+      if (!request.cancelled) {
+        god_.GetLatencyStats().Record(*request.sentence, targetLength);
+        Respond(request, translation);
+      }
+      for (auto& duplicate : request.duplicates) {
+        duplicate->sentence->GetTimestamps().decodeStart = request.sentence->GetTimestamps().decodeStart;
+        god_.GetLatencyStats().Record(*duplicate->sentence, targetLength);
+        Respond(*duplicate, translation);
+      }
+
+      if (cache.Enabled()) {
+        cache.Put(request.cacheKey, { translation, targetLength });
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < batch.size(); ++i) {
+    god_.GetMetrics().SentenceFinished();
+  }
+
+  std::lock_guard<std::mutex> lock(inFlightMutex_);
+  --inFlight_;
+  inFlightDone_.notify_all();
+}
+
+void Server::Respond(Request& request, const std::string& translation)
+{
+  if (request.answered.exchange(true)) {
+    return;
+  }
+
+  Connection& connection = *request.connection;
+  std::lock_guard<std::mutex> lock(connection.mutex);
+
+  if (request.json) {
+    connection.active.erase(request.id);
+    connection.Send("{\"id\": " + JsonString(request.id) + ", \"translation\": "
+                    + JsonString(translation) + "}");
+    return;
+  }
+
+  connection.pending[request.seq] = translation;
+  for (auto it = connection.pending.begin();
+       it != connection.pending.end() && it->first == connection.nextSeq;
+       it = connection.pending.erase(it)) {
+    connection.Send(it->second);
+    ++connection.nextSeq;
+  }
+}
+
+void Server::RespondError(Request& request, const std::string& error)
+{
+  if (!request.json) {
+    // an empty line keeps the answers of the connection in order
+    Respond(request, "");
+    return;
+  }
+  if (request.answered.exchange(true)) {
+    return;
+  }
+
+  Connection& connection = *request.connection;
+  std::lock_guard<std::mutex> lock(connection.mutex);
+  connection.active.erase(request.id);
+  connection.Send("{\"id\": " + JsonString(request.id) + ", \"error\": " + JsonString(error) + "}");
+}
+
+void Server::RespondPartial(Request& request, const std::string& partial)
+{
+  if (!request.json) {
+    return;
+  }
+
+  Connection& connection = *request.connection;
+  std::lock_guard<std::mutex> lock(connection.mutex);
+  // never after the response
+  if (!request.answered) {
+    connection.Send("{\"id\": " + JsonString(request.id) + ", \"partial\": "
+                    + JsonString(partial) + "}");
+  }
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <condition_variable>
+
+#include "common/sentence.h"
+
+namespace amunmt {
+
+class God;
+template <class RequestPtr> class DynamicBatcher;
+
+// Translation server on a local TCP port (--port) or Unix-domain socket
+// (--socket). Every line a client sends is a request:
+//
+//   a plain line of text               answered by its translation, in order
+//   {"id": "7", "text": "..."}         answered by {"id": "7", "translation": "..."}
+//   {"cancel": "7"}                    answered by {"id": "7", "cancelled": true}
+//                                      unless the translation was sent already
+//
+// With --stable-prefix, JSON requests also get {"id": "7", "partial": "..."}
+// before their translation, whenever the words all hypotheses agree on grew.
+//
+// JSON requests are answered as soon as they are translated, so responses of
+// one connection may come out of order. Requests of all connections are
+// merged into mini-batches, which are handed to the decoder thread pool when
+// full or when their oldest request has waited --max-batch-wait ms.
+// Cancelled requests, and requests of clients that went away or did not take
+// a response within a second, are dropped before decoding; a translation that
+// is cancelled while being decoded is discarded. With --cache-size, repeated
+// requests are answered from the translation cache without waiting for a
+// batch, and identical requests within a batch are decoded once.
+class Server {
+  public:
+    Server(God &god);
+    ~Server();
+
+    // serves until SIGINT or SIGTERM, then answers the requests it accepted
+    void Run();
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Connection;
+    struct Request;
+    typedef std::shared_ptr<Connection> ConnectionPtr;
+    typedef std::shared_ptr<Request> RequestPtr;
+
+    int Listen();
+    void Serve(ConnectionPtr connection);
+    void Handle(ConnectionPtr connection, const std::string& line, unsigned& plainSeq);
+
+    void Dispatch(std::vector<RequestPtr> batch);
+    void Translate(std::vector<RequestPtr> batch);
+    void Respond(Request& request, const std::string& translation);
+    // an error reply for JSON requests, an empty line for plain ones
+    void RespondError(Request& request, const std::string& error);
+    void RespondPartial(Request& request, const std::string& partial);
+
+    God &god_;
+
+    std::atomic<unsigned> nextLineNum_;
+
+    std::unique_ptr<DynamicBatcher<RequestPtr>> batcher_;
+
+    // batches handed to the thread pool and not finished yet
+    unsigned inFlight_;
+    std::mutex inFlightMutex_;
+    std::condition_variable inFlightDone_;
+
+    // connections and the number of threads still reading from them
+    std::set<ConnectionPtr> connections_;
+    unsigned activeReaders_;
+    std::mutex connectionsMutex_;
+    std::condition_variable readersDone_;
+};
+
+}
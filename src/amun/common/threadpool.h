@@ -28,6 +28,7 @@ This source code has been modified to have optional bounded size.
 #pragma once
 
 #include <iostream>
+#include <atomic>
 #include <vector>
 #include <queue>
 #include <memory>
@@ -38,6 +39,8 @@ This source code has been modified to have optional bounded size.
 #include <functional>
 #include <stdexcept>
 
+#include "common/tracer.h"
+
 namespace amunmt {
 
 class ThreadPool {
@@ -49,8 +52,17 @@ class ThreadPool {
         -> std::future<typename std::result_of<F(Args...)>::type>;
     ~ThreadPool();
 
+    // safe to call from any thread, for monitoring
     size_t getNumTasks() const {
-      return tasks.size();
+      return queued.load(std::memory_order_relaxed);
+    }
+
+    size_t getNumBusy() const {
+      return busy.load(std::memory_order_relaxed);
+    }
+
+    size_t getNumThreads() const {
+      return workers.size();
     }
 
  private:
@@ -65,11 +77,14 @@ class ThreadPool {
     std::size_t bound;
     std::condition_variable bounded_condition;
     bool stop;
+
+    std::atomic<size_t> queued;
+    std::atomic<size_t> busy;
 };
 
 // the constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(size_t threads, size_t in_bound)
-  : stop(false), bound(in_bound) {
+  : bound(in_bound), stop(false), queued(0), busy(0) {
     for (size_t i = 0;i<threads;++i)
       workers.emplace_back(
           [this] {
@@ -83,10 +98,16 @@ inline ThreadPool::ThreadPool(size_t threads, size_t in_bound)
                         return;
                     task = std::move(this->tasks.front());
                     this->tasks.pop();
+                    --this->queued;
+                    ++this->busy;
                   }
                   this->bounded_condition.notify_one();
 
-                  task();
+                  {
+                    TraceScope trace("task", "pool");
+                    task();
+                  }
+                  --this->busy;
               }
           }
       );
@@ -113,6 +134,7 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
       }
 
       tasks.emplace([task](){ (*task)(); });
+      ++queued;
   }
   condition.notify_one();
   return res;
@@ -0,0 +1,161 @@
+#include "common/tracer.h"
+
+#include <set>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+#include "common/logging.h"
+#include "common/utils.h"
+
+namespace amunmt {
+
+std::atomic<bool> Tracer::enabled_(false);
+
+namespace {
+
+struct Event {
+  const char* name;
+  const char* category;
+  Tracer::Clock::time_point start;
+  Tracer::Clock::time_point end;
+  const char* argName;
+  int64_t argValue;
+};
+
+// events kept per thread, about 12 MB; a long-running server or library
+// process keeps the most recent ones
+const size_t MAX_EVENTS = 1 << 18;
+
+struct ThreadBuffer {
+  explicit ThreadBuffer(size_t vId)
+    : id(vId), name(nullptr), next(0), dropped(0)
+  {
+    events.reserve(1 << 14);
+  }
+
+  void Add(const Event& event) {
+    if (events.size() < MAX_EVENTS) {
+      events.push_back(event);
+    } else {
+      events[next] = event;
+      next = (next + 1) % MAX_EVENTS;
+      ++dropped;
+    }
+  }
+
+  size_t id;
+  const char* name;
+
+  // ring of the last MAX_EVENTS events, the oldest at next once it is full
+  std::vector<Event> events;
+  size_t next;
+  size_t dropped;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> threads;
+  std::set<std::string> names;
+  std::string path;
+  Tracer::Clock::time_point start;
+};
+
+Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+ThreadBuffer& GetThreadBuffer() {
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (buffer == nullptr) {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.emplace_back(new ThreadBuffer(registry.threads.size()));
+    buffer = registry.threads.back().get();
+  }
+  return *buffer;
+}
+
+double Microseconds(Tracer::Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() * 1e-3;
+}
+
+}
+
+void Tracer::Enable(const std::string& path) {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.path = path;
+  registry.start = Clock::now();
+  enabled_ = true;
+  LOG(info)->info("Tracing, timeline will be written to {}", path);
+}
+
+void Tracer::Finish() {
+  if (!IsEnabled()) {
+    return;
+  }
+  enabled_ = false;
+
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  std::ofstream out(registry.path);
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+  bool first = true;
+  size_t dropped = 0;
+  for (const auto& thread : registry.threads) {
+    std::string name = thread->name ? thread->name : "thread " + std::to_string(thread->id);
+    out << (first ? "" : ",")
+        << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->id
+        << ", \"args\": {\"name\": " << JsonString(name) << "}}";
+    first = false;
+
+    for (size_t i = 0; i < thread->events.size(); ++i) {
+      const Event& event = thread->events[(thread->next + i) % thread->events.size()];
+      out << ",\n{\"name\": " << JsonString(event.name) << ", \"cat\": " << JsonString(event.category)
+          << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->id
+          << ", \"ts\": " << Microseconds(event.start - registry.start)
+          << ", \"dur\": " << Microseconds(event.end - event.start);
+      if (event.argName) {
+        out << ", \"args\": {" << JsonString(event.argName) << ": " << event.argValue << "}";
+      }
+      out << "}";
+    }
+    dropped += thread->dropped;
+  }
+  out << "\n]}\n";
+
+  if (dropped) {
+    LOG(info)->warn("Trace buffers were full, dropped the oldest {} events", dropped);
+  }
+
+  if (!out) {
+    LOG(info)->warn("Could not write trace to {}", registry.path);
+  }
+}
+
+const char* Tracer::Intern(const std::string& name) {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  return registry.names.insert(name).first->c_str();
+}
+
+void Tracer::SetThreadName(const char* name) {
+  if (IsEnabled()) {
+    GetThreadBuffer().name = name;
+  }
+}
+
+void Tracer::AddEvent(const char* name, const char* category,
+                      Clock::time_point start, Clock::time_point end,
+                      const char* argName, int64_t argValue) {
+  GetThreadBuffer().Add({name, category, start, end, argName, argValue});
+}
+
+}
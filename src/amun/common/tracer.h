@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace amunmt {
+
+// Timeline of what every thread was doing, written in the Chrome trace-event
+// format so that it can be loaded in Perfetto or about:tracing. Each thread
+// appends to its own buffer without locking; the buffers are only read when
+// the trace is written by Finish(), after the worker threads have stopped.
+// The buffers are bounded, once full they keep the most recent events.
+//
+// Event names and categories must outlive the tracer, use Intern() for
+// names that are not string literals.
+class Tracer {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static void Enable(const std::string& path);
+
+    // writes the trace and stops tracing
+    static void Finish();
+
+    static bool IsEnabled() {
+      return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static const char* Intern(const std::string& name);
+
+    // names the calling thread in the timeline
+    static void SetThreadName(const char* name);
+
+    // an event covering [start, end) on the calling thread, with an optional
+    // integer argument
+    static void AddEvent(const char* name, const char* category,
+                         Clock::time_point start, Clock::time_point end,
+                         const char* argName = nullptr, int64_t argValue = 0);
+
+  private:
+    static std::atomic<bool> enabled_;
+};
+
+// records the enclosing scope as an event
+class TraceScope {
+  public:
+    TraceScope(const char* name, const char* category,
+               const char* argName = nullptr, int64_t argValue = 0)
+      : name_(name),
+        category_(category),
+        argName_(argName),
+        argValue_(argValue),
+        active_(Tracer::IsEnabled())
+    {
+      if (active_) {
+        start_ = Tracer::Clock::now();
+      }
+    }
+
+    ~TraceScope() {
+      if (active_) {
+        Tracer::AddEvent(name_, category_, start_, Tracer::Clock::now(), argName_, argValue_);
+      }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+
+  private:
+    const char* name_;
+    const char* category_;
+    const char* argName_;
+    int64_t argValue_;
+    bool active_;
+    Tracer::Clock::time_point start_;
+};
+
+}
@@ -0,0 +1,147 @@
+#include "common/translation_cache.h"
+
+#include <functional>
+#include <boost/filesystem.hpp>
+#include <yaml-cpp/yaml.h>
+
+#include "common/sentence.h"
+
+namespace amunmt {
+
+namespace {
+
+void HashCombine(uint64_t& seed, uint64_t value) {
+  seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+void AddFiles(uint64_t& seed, const YAML::Node& node) {
+  if (node.IsScalar()) {
+    boost::system::error_code ec;
+    boost::filesystem::path path(node.Scalar());
+    if (boost::filesystem::is_regular_file(path, ec)) {
+      HashCombine(seed, boost::filesystem::file_size(path, ec));
+      HashCombine(seed, boost::filesystem::last_write_time(path, ec));
+    }
+  } else if (node.IsSequence()) {
+    for (const YAML::Node& child : node) {
+      AddFiles(seed, child);
+    }
+  } else if (node.IsMap()) {
+    for (const auto& child : node) {
+      AddFiles(seed, child.second);
+    }
+  }
+}
+
+}
+
+TranslationCache::TranslationCache()
+  : capacity_(0),
+    shardCapacity_(0),
+    fingerprint_(0),
+    hits_(0),
+    misses_(0),
+    duplicates_(0),
+    evictions_(0)
+{}
+
+void TranslationCache::Init(size_t capacity, uint64_t fingerprint)
+{
+  capacity_ = capacity;
+  shardCapacity_ = (capacity + NUM_SHARDS - 1) / NUM_SHARDS;
+  Reset(fingerprint);
+}
+
+void TranslationCache::Reset(uint64_t fingerprint)
+{
+  fingerprint_.store(fingerprint, std::memory_order_relaxed);
+  for (Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.lru.clear();
+    shard.entries.clear();
+  }
+}
+
+uint64_t TranslationCache::Fingerprint(const YAML::Node& config)
+{
+  uint64_t seed = std::hash<std::string>()(YAML::Dump(config));
+  AddFiles(seed, config);
+  return seed;
+}
+
+std::string TranslationCache::GetKey(const Sentence& sentence) const
+{
+  // raw bytes: fingerprint, then length and ids of every tab followed by the
+  // number and ids of the factors of each of its words
+  uint64_t fingerprint = fingerprint_.load(std::memory_order_relaxed);
+  std::string key(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+  for (unsigned tab = 0; tab < sentence.GetNumTabs(); ++tab) {
+    const Words& words = sentence.GetWords(tab);
+    uint32_t size = words.size();
+    key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    key.append(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(Word));
+
+    const FactWords& factors = sentence.GetFactors(tab);
+    size = factors.size();
+    key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    for (const FactWord& factor : factors) {
+      size = factor.size();
+      key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+      key.append(reinterpret_cast<const char*>(factor.data()), factor.size() * sizeof(Factor));
+    }
+  }
+  return key;
+}
+
+TranslationCache::Shard& TranslationCache::GetShard(const std::string& key)
+{
+  return shards_[std::hash<std::string>()(key) % NUM_SHARDS];
+}
+
+bool TranslationCache::Get(const std::string& key, Entry& entry)
+{
+  Shard& shard = GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  entry = it->second->second;
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void TranslationCache::Put(const std::string& key, const Entry& entry)
+{
+  Shard& shard = GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(key);
+  if (it != shard.entries.end()) {
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    it->second->second = entry;
+    return;
+  }
+
+  shard.lru.emplace_front(key, entry);
+  shard.entries.emplace(key, shard.lru.begin());
+  if (shard.lru.size() > shardCapacity_) {
+    shard.entries.erase(shard.lru.back().first);
+    shard.lru.pop_back();
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+size_t TranslationCache::Size() const
+{
+  size_t size = 0;
+  for (const Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.lru.size();
+  }
+  return size;
+}
+
+}
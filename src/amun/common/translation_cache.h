@@ -0,0 +1,96 @@
+#pragma once
+
+#include <list>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+namespace YAML {
+class Node;
+}
+
+namespace amunmt {
+
+class Sentence;
+
+// Exact-match cache of printed translations (--cache-size), split into
+// shards with their own LRU list and lock. Entries are keyed by the source
+// word and factor ids of all tabs together with a fingerprint of the configuration and
+// the model files, so a changed model or search option never hits old entries.
+class TranslationCache {
+  public:
+    struct Entry {
+      std::string output;
+      unsigned targetLength;
+    };
+
+    TranslationCache();
+
+    // capacity in sentences, 0 disables the cache
+    void Init(size_t capacity, uint64_t fingerprint);
+
+    // drops all entries, e.g. when the models were reloaded
+    void Reset(uint64_t fingerprint);
+
+    bool Enabled() const
+    { return capacity_ > 0; }
+
+    std::string GetKey(const Sentence& sentence) const;
+
+    // counts a hit or a miss
+    bool Get(const std::string& key, Entry& entry);
+    void Put(const std::string& key, const Entry& entry);
+
+    // a sentence answered by the translation of an identical one decoded in the same batch
+    void CountDuplicate()
+    { duplicates_.fetch_add(1, std::memory_order_relaxed); }
+
+    uint64_t Hits() const
+    { return hits_.load(std::memory_order_relaxed); }
+
+    uint64_t Misses() const
+    { return misses_.load(std::memory_order_relaxed); }
+
+    uint64_t Duplicates() const
+    { return duplicates_.load(std::memory_order_relaxed); }
+
+    uint64_t Evictions() const
+    { return evictions_.load(std::memory_order_relaxed); }
+
+    size_t Size() const;
+
+    size_t Capacity() const
+    { return capacity_; }
+
+    // hash of the options and of the size and modification time of every
+    // file the configuration refers to
+    static uint64_t Fingerprint(const YAML::Node& config);
+
+  private:
+    struct Shard {
+      typedef std::list<std::pair<std::string, Entry>> Lru;
+
+      mutable std::mutex mutex;
+      // most recently used first
+      Lru lru;
+      std::unordered_map<std::string, Lru::iterator> entries;
+    };
+    static const size_t NUM_SHARDS = 16;
+
+    Shard& GetShard(const std::string& key);
+
+    size_t capacity_;
+    size_t shardCapacity_;
+    std::atomic<uint64_t> fingerprint_;
+    std::array<Shard, NUM_SHARDS> shards_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> duplicates_;
+    std::atomic<uint64_t> evictions_;
+};
+
+}
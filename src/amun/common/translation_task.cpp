@@ -1,5 +1,7 @@
 #include "translation_task.h"
+#include "god.h"
 
+#include <chrono>
 #include <string>
 
 #ifdef CUDA
@@ -10,34 +12,28 @@
 #include "output_collector.h"
 #include "printer.h"
 #include "history.h"
+#include "profiler.h"
+#include "latency_stats.h"
+#include "sentences.h"
+#include "translation_cache.h"
 
 using namespace std;
 
 namespace amunmt {
 
-void TranslationTaskAndOutput(const God &god, std::shared_ptr<Sentences> sentences) {
-  OutputCollector &outputCollector = god.GetOutputCollector();
-
-  std::shared_ptr<Histories> histories = TranslationTask(god, sentences);
-
-  for (unsigned i = 0; i < histories->size(); ++i) {
-    const History &history = *histories->at(i);
-    unsigned lineNum = history.GetLineNum();
-    const Sentence &sentence = sentences->Get(0);
-
-    std::stringstream strm;
-    Printer(god, history, strm, sentence);
+namespace {
 
-    outputCollector.Write(lineNum, strm.str());
+void SetDecodeStart(Sentences& sentences) {
+  auto decodeStart = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < sentences.size(); ++i) {
+    sentences.at(i)->GetTimestamps().decodeStart = decodeStart;
   }
 }
 
-std::shared_ptr<Histories> TranslationTask(const God &god, std::shared_ptr<Sentences> sentences) {
+template <class Task>
+auto AbortOnError(Task task) -> decltype(task()) {
   try {
-    Search& search = god.GetSearch();
-    auto histories = search.Translate(*sentences);
-
-    return histories;
+    return task();
   }
 #ifdef CUDA
   catch(thrust::system_error &e)
@@ -61,8 +57,103 @@ std::shared_ptr<Histories> TranslationTask(const God &god, std::shared_ptr<Sente
     std::cerr << "Some other kind of error during some_function" << std::endl;
     abort();
   }
+}
+
+}
+
+void TranslationTaskAndOutput(const God &god, std::shared_ptr<Sentences> sentences,
+                              std::shared_ptr<EncodedSentences> encoded) {
+  OutputCollector &outputCollector = god.GetOutputCollector();
+
+  StablePrefixCallback onStablePrefix;
+  std::vector<std::string> partials;
+  if (god.GetOptions().stablePrefix) {
+    partials.resize(sentences->size());
+    onStablePrefix = [&](unsigned i, const Words& prefix) {
+      std::string partial = GetStablePrefixString(god, prefix);
+      if (partial != partials[i]) {
+        outputCollector.WritePartial(sentences->Get(i).GetLineNum(), partial);
+        partials[i].swap(partial);
+      }
+    };
+  }
+
+  std::shared_ptr<Histories> histories = TranslationTask(god, sentences, encoded, onStablePrefix);
+
+  for (unsigned i = 0; i < histories->size(); ++i) {
+    const History &history = *histories->at(i);
+    unsigned lineNum = history.GetLineNum();
+    const Sentence &sentence = sentences->Get(i);
+
+    std::stringstream strm;
+    {
+      ProfileScope profile(Profiler::POSTPROCESS);
+      Printer(god, history, strm, sentence);
+    }
+
+    god.GetLatencyStats().Record(sentence, history.Top().first.size());
+    outputCollector.Write(lineNum, strm.str());
+    god.GetMetrics().SentenceFinished();
+
+    TranslationCache& cache = god.GetTranslationCache();
+    if (cache.Enabled() && !sentence.GetCacheKey().empty()) {
+      cache.Put(sentence.GetCacheKey(), { strm.str(), unsigned(history.Top().first.size()) });
+
+      for (const SentencePtr& duplicate : sentences->at(i)->GetDuplicates()) {
+        duplicate->GetTimestamps().enqueued = sentence.GetTimestamps().enqueued;
+        duplicate->GetTimestamps().decodeStart = sentence.GetTimestamps().decodeStart;
+        god.GetLatencyStats().Record(*duplicate, history.Top().first.size());
+        outputCollector.Write(duplicate->GetLineNum(), strm.str());
+        god.GetMetrics().SentenceFinished();
+      }
+    }
+  }
+}
+
+std::shared_ptr<Histories> TranslationTask(const God &god, std::shared_ptr<Sentences> sentences,
+                                           std::shared_ptr<EncodedSentences> encoded,
+                                           const StablePrefixCallback& onStablePrefix) {
+  return AbortOnError([&]() {
+    return TryTranslationTask(god, sentences, encoded, onStablePrefix);
+  });
+}
+
+std::shared_ptr<Histories> TryTranslationTask(const God &god, std::shared_ptr<Sentences> sentences,
+                                              std::shared_ptr<EncodedSentences> encoded,
+                                              const StablePrefixCallback& onStablePrefix) {
+  // otherwise set by EncodeTask() on the encoder thread
+  if (!encoded) {
+    SetDecodeStart(*sentences);
+  }
+
+  Search& search = god.GetSearch();
+  return search.Translate(*sentences, encoded, onStablePrefix);
+}
 
+std::shared_ptr<Histories> PrefixTranslationTask(const God &god, PrefixSession& session,
+                                                 std::shared_ptr<Sentences> sentences,
+                                                 const Words& prefix) {
+  SetDecodeStart(*sentences);
+  return god.GetSearch().TranslateWithPrefix(session, *sentences, prefix);
 }
 
+std::vector<HypothesisPtr> RescoreTask(const God &god, std::shared_ptr<Sentences> sentences,
+                                       const std::vector<Words>& targets) {
+  return AbortOnError([&]() {
+    SetDecodeStart(*sentences);
+    return god.GetSearch().Rescore(*sentences, targets);
+  });
 }
 
+void EncodeTask(God &god, std::shared_ptr<Sentences> sentences) {
+  SetDecodeStart(*sentences);
+  EncodedSentencesPtr encoded = AbortOnError([&]() {
+    return god.GetSearch().EncodeOnly(*sentences);
+  });
+
+  god.GetThreadPool().enqueue(
+      [&god,sentences,encoded]{ return TranslationTaskAndOutput(god, sentences, encoded); }
+      );
+}
+
+}
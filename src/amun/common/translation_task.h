@@ -2,13 +2,42 @@
 
 #include <memory>
 
+#include "common/search.h"
+
 namespace amunmt {
 
 class God;
 class Histories;
 class Sentences;
 
-void TranslationTaskAndOutput(const God &god, std::shared_ptr<Sentences> sentences);
-std::shared_ptr<Histories> TranslationTask(const God &god, std::shared_ptr<Sentences> sentences);
+// encoded is the work of an encoder thread, see EncodeTask(). With
+// onStablePrefix, TranslationTask() passes on the stable prefixes of the
+// sentences, see Search::Translate(); TranslationTaskAndOutput() writes them
+// to the OutputCollector with --stable-prefix
+void TranslationTaskAndOutput(const God &god, std::shared_ptr<Sentences> sentences,
+                              std::shared_ptr<EncodedSentences> encoded = nullptr);
+std::shared_ptr<Histories> TranslationTask(const God &god, std::shared_ptr<Sentences> sentences,
+                                           std::shared_ptr<EncodedSentences> encoded = nullptr,
+                                           const StablePrefixCallback& onStablePrefix = nullptr);
+
+// TranslationTask() that throws errors to the caller instead of aborting the
+// process, for libamun
+std::shared_ptr<Histories> TryTranslationTask(const God &god, std::shared_ptr<Sentences> sentences,
+                                              std::shared_ptr<EncodedSentences> encoded = nullptr,
+                                              const StablePrefixCallback& onStablePrefix = nullptr);
+
+// Search::TranslateWithPrefix() on the calling decoder thread; errors are
+// thrown to the caller
+std::shared_ptr<Histories> PrefixTranslationTask(const God &god, PrefixSession& session,
+                                                 std::shared_ptr<Sentences> sentences,
+                                                 const Words& prefix);
+
+// Search::Rescore() of the candidates of one sentence, see Rescorer
+std::vector<HypothesisPtr> RescoreTask(const God &god, std::shared_ptr<Sentences> sentences,
+                                       const std::vector<Words>& targets);
+
+// --encoder-threads: encodes on the calling encoder thread, then queues
+// decoding and output for the decoder threads, waiting while their queue is full
+void EncodeTask(God &god, std::shared_ptr<Sentences> sentences);
 
 }  // namespace amunmt
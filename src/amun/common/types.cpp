@@ -6,7 +6,7 @@ namespace amunmt {
 
 std::ostream& operator<<(std::ostream& out, const DeviceInfo& obj)
 {
-  out << obj.deviceType << " t=" << obj.threadInd << " d=" << obj.deviceId;
+  out << obj.deviceType << " t=" << obj.threadInd << " d=" << obj.deviceId << " n=" << obj.numaNode;
   return out;
 }
 
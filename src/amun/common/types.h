@@ -34,6 +34,8 @@ struct DeviceInfo
   DeviceType deviceType;
   unsigned threadInd;
   unsigned deviceId;
+  // CPU threads: NUMA node the thread runs on, selects the replica of the weights
+  unsigned numaNode = 0;
 };
 
 /////////////////////////////////////////////////////////////////////////////////////
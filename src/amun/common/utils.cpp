@@ -1,4 +1,5 @@
 #include "utils.h"
+#include <cstdio>
 #include <iostream>
 #include <sstream>
 
@@ -10,6 +11,20 @@ void Trim(std::string& s) {
   boost::trim_if(s, boost::is_any_of(" \t\n"));
 }
 
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n';
+}
+
+boost::string_ref Trim(boost::string_ref s) {
+  while (!s.empty() && IsSpace(s.front())) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && IsSpace(s.back())) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
 void Split(const std::string& line, std::vector<std::string>& pieces, const std::string del) {
   size_t begin = 0;
   size_t pos = 0;
@@ -29,6 +44,27 @@ void Split(const std::string& line, std::vector<std::string>& pieces, const std:
     pieces.push_back(token);
 }
 
+void Split(boost::string_ref line, std::vector<boost::string_ref>& pieces, char del) {
+  size_t pos;
+  while ((pos = line.find(del)) != boost::string_ref::npos) {
+    if (pos > 0) {
+      pieces.push_back(line.substr(0, pos));
+    }
+    line.remove_prefix(pos + 1);
+  }
+  if (!line.empty()) {
+    pieces.push_back(line);
+  }
+}
+
+unsigned CountWords(const std::string& line) {
+  unsigned words = 1;
+  for (char c : line) {
+    words += (c == ' ');
+  }
+  return words;
+}
+
 std::string Join(const std::vector<std::string>& words, const std::string del) {
   std::stringstream ss;
   if (words.empty()) {
@@ -54,5 +90,26 @@ std::string Join(const std::vector<std::string>& words,
   return ss.str();
 }
 
+std::string JsonString(const std::string& str) {
+  std::string out = "\"";
+  for (char c : str) {
+    switch (c) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out + "\"";
 }
 
+}
@@ -3,17 +3,28 @@
 #include <string>
 #include <vector>
 #include <boost/algorithm/string.hpp>
+#include <boost/utility/string_ref.hpp>
 
 namespace amunmt {
 
 void Trim(std::string& s);
+boost::string_ref Trim(boost::string_ref s);
 
 void Split(const std::string& line, std::vector<std::string>& pieces, const std::string del=" ");
 
+// appends non-empty pieces of line to pieces. The pieces point into line, nothing is copied
+void Split(boost::string_ref line, std::vector<boost::string_ref>& pieces, char del);
+
+// a cheap estimate of the words of an untokenized line: the spaces plus one
+unsigned CountWords(const std::string& line);
+
 std::string Join(const std::vector<std::string>& words, const std::string del=" ");
 std::string Join(const std::vector<std::string>& words,
                  const std::vector<size_t>& align, const std::string del=" ");
 
+// str as a quoted JSON string
+std::string JsonString(const std::string& str);
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 template<typename T>
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <map>
+#include <unordered_map>
 #include <string>
 #include <vector>
 
@@ -25,7 +25,7 @@ class Vocab {
     unsigned size() const;
 
   private:
-    typedef std::map<std::string, unsigned> Str2Id;
+    typedef std::unordered_map<std::string, unsigned> Str2Id;
     Str2Id str2id_;
 
     typedef std::vector<std::string> Id2Str;
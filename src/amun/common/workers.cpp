@@ -0,0 +1,284 @@
+#include "common/workers.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "common/god.h"
+#include "common/exception.h"
+#include "common/logging.h"
+#include "common/output_collector.h"
+#include "common/utils.h"
+
+namespace amunmt {
+
+namespace {
+
+void WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    amunmt_UTIL_THROW_IF2(n < 0, "Could not write to worker: " << strerror(errno));
+    data += n;
+    size -= n;
+  }
+}
+
+// n-best lists and Nematus alignments start their lines with the line number,
+// which is the worker's own; with --wipo after "OUT: "
+std::string Renumber(const std::string& output, long workerLine, long line) {
+  const std::string wipo = "OUT: ";
+  const std::string from = std::to_string(workerLine) + " |||";
+  const std::string to = std::to_string(line) + " |||";
+  std::string renumbered;
+  size_t pos = 0;
+  while (pos < output.size()) {
+    size_t end = output.find('\n', pos);
+    end = (end == std::string::npos) ? output.size() : end + 1;
+    size_t start = pos;
+    if (output.compare(start, wipo.size(), wipo) == 0) {
+      start += wipo.size();
+    }
+    if (output.compare(start, from.size(), from) == 0) {
+      renumbered.append(output, pos, start - pos);
+      renumbered += to;
+      renumbered.append(output, start + from.size(), end - start - from.size());
+    } else {
+      renumbered.append(output, pos, end - pos);
+    }
+    pos = end;
+  }
+  return renumbered;
+}
+
+}
+
+Workers::Workers(unsigned num)
+  : workerId_(-1)
+{
+  for (unsigned id = 0; id < num; ++id) {
+    int in[2], out[2];
+    amunmt_UTIL_THROW_IF2(pipe(in) < 0 || pipe(out) < 0, "Could not create pipes: " << strerror(errno));
+
+    pid_t pid = fork();
+    amunmt_UTIL_THROW_IF2(pid < 0, "Could not fork worker: " << strerror(errno));
+
+    if (pid == 0) {
+      // without the parent's ends of the other workers' pipes, which would
+      // keep their input open
+      for (auto& worker : workers_) {
+        close(worker->in);
+        close(worker->out);
+      }
+      workers_.clear();
+
+      dup2(in[0], STDIN_FILENO);
+      dup2(out[1], STDOUT_FILENO);
+      close(in[0]);
+      close(in[1]);
+      close(out[0]);
+      close(out[1]);
+      workerId_ = id;
+      return;
+    }
+
+    close(in[0]);
+    close(out[1]);
+    workers_.emplace_back(new Worker());
+    workers_.back()->pid = pid;
+    workers_.back()->in = in[1];
+    workers_.back()->out = out[0];
+  }
+
+  // a dead worker is reported by Run(), not by SIGPIPE
+  std::signal(SIGPIPE, SIG_IGN);
+  LOG(info)->info("Forked {} workers", num);
+}
+
+Workers::~Workers()
+{
+  for (auto& worker : workers_) {
+    if (worker->in >= 0) {
+      close(worker->in);
+    }
+    if (worker->collector.joinable()) {
+      worker->collector.join();
+    }
+    if (worker->out >= 0) {
+      close(worker->out);
+    }
+  }
+}
+
+void Workers::Run(God &god)
+{
+  for (auto& worker : workers_) {
+    worker->collector = std::thread(&Workers::Collect, this, std::ref(god), std::ref(*worker));
+  }
+
+  // large enough to fill the maxi-batches of the workers
+  const unsigned chunkSize = std::max(god.GetOptions().maxiBatch, 16u);
+
+  std::string chunk;
+  std::vector<std::pair<long, unsigned>> lines;
+  size_t words = 0;
+  long lineNum = 0;
+
+  auto send = [&]() {
+    // the worker of a collector that gave up would never finish its input
+    for (unsigned id = 0; id < workers_.size(); ++id) {
+      if (workers_[id]->failed) {
+        std::lock_guard<std::mutex> lock(workers_[id]->mutex);
+        amunmt_UTIL_THROW2("Workers failed: worker " << id << ": " << workers_[id]->error);
+      }
+    }
+
+    // length-balanced: the worker with the least work outstanding
+    Worker& worker = **std::min_element(workers_.begin(), workers_.end(),
+        [](const std::unique_ptr<Worker>& a, const std::unique_ptr<Worker>& b) {
+          return a->pendingWords < b->pendingWords;
+        });
+    Send(worker, chunk, lines, words);
+    chunk.clear();
+    lines.clear();
+    words = 0;
+  };
+
+  std::string line;
+  std::istream& input = god.GetInputStream();
+  while (std::getline(input, line)) {
+    unsigned lineWords = CountWords(line);
+    chunk += line;
+    chunk += '\n';
+    lines.emplace_back(lineNum++, lineWords);
+    words += lineWords;
+    if (lines.size() == chunkSize) {
+      send();
+    }
+  }
+  if (!lines.empty()) {
+    send();
+  }
+
+  // end of input for the workers
+  for (auto& worker : workers_) {
+    close(worker->in);
+    worker->in = -1;
+  }
+
+  std::string errors;
+  for (unsigned id = 0; id < workers_.size(); ++id) {
+    Worker& worker = *workers_[id];
+    worker.collector.join();
+    if (worker.out >= 0) {
+      close(worker.out);
+      worker.out = -1;
+    }
+
+    int status = 0;
+    waitpid(worker.pid, &status, 0);
+    if (!worker.error.empty()) {
+      errors += " worker " + std::to_string(id) + ": " + worker.error + ";";
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      errors += " worker " + std::to_string(id) + " failed;";
+    }
+  }
+  amunmt_UTIL_THROW_IF2(!errors.empty(), "Workers failed:" << errors);
+}
+
+void Workers::Send(Worker& worker, const std::string& chunk,
+                   const std::vector<std::pair<long, unsigned>>& lines, size_t words)
+{
+  // registered before writing, so the collector knows every translation it reads
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.lines.insert(worker.lines.end(), lines.begin(), lines.end());
+  }
+  worker.pendingWords += words;
+  WriteAll(worker.in, chunk.data(), chunk.size());
+}
+
+void Workers::Collect(God &god, Worker& worker)
+{
+  OutputCollector& outputCollector = god.GetOutputCollector();
+  const bool renumber = god.GetOptions().nBest || god.GetOptions().returnNematusAlignment;
+  long workerLine = 0;
+  std::string buffer;
+  char data[65536];
+  size_t pos = 0;
+
+  while (true) {
+    // frames of "<size>\n<translation>"
+    size_t newline = buffer.find('\n', pos);
+    if (newline != std::string::npos) {
+      // e.g. stray bytes on the worker's stdout
+      const char* header = buffer.c_str() + pos;
+      char* end;
+      errno = 0;
+      unsigned long size = std::strtoul(header, &end, 10);
+      if (!std::isdigit(static_cast<unsigned char>(*header)) || end != buffer.c_str() + newline
+          || errno == ERANGE) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        Fail(worker, "malformed output frame");
+        return;
+      }
+      if (buffer.size() >= newline + 1 + size) {
+        std::pair<long, unsigned> line;
+        {
+          std::lock_guard<std::mutex> lock(worker.mutex);
+          if (worker.lines.empty()) {
+            Fail(worker, "more translations than sentences");
+            return;
+          }
+          line = worker.lines.front();
+          worker.lines.pop_front();
+        }
+        worker.pendingWords -= line.second;
+        std::string output = buffer.substr(newline + 1, size);
+        if (renumber) {
+          output = Renumber(output, workerLine, line.first);
+        }
+        outputCollector.Write(line.first, output);
+        ++workerLine;
+
+        pos = newline + 1 + size;
+        continue;
+      }
+    }
+
+    buffer.erase(0, pos);
+    pos = 0;
+    ssize_t n = read(worker.out, data, sizeof(data));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    buffer.append(data, n);
+  }
+
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  if (!worker.lines.empty()) {
+    worker.error = std::to_string(worker.lines.size()) + " sentences not translated";
+  }
+}
+
+void Workers::Fail(Worker& worker, const std::string& error)
+{
+  worker.error = error;
+  // nobody reads the worker's output any more, so it must not block on a
+  // full pipe instead of dying
+  close(worker.out);
+  worker.out = -1;
+  worker.failed = true;
+}
+
+}
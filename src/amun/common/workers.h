@@ -0,0 +1,68 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <sys/types.h>
+
+namespace amunmt {
+
+class God;
+
+// amun --workers N: the model is loaded once, then N worker processes are
+// forked from the loaded process and share its pages copy-on-write. Each
+// worker is an ordinary amun that translates its stdin, a pipe from the
+// parent, and writes length-prefixed translations to its stdout, a pipe to
+// the parent. The parent does not decode: it reads the input in chunks, hands
+// every chunk to the worker with the fewest source words outstanding, and
+// merges the translations in input order through its OutputCollector.
+class Workers {
+  public:
+    // forks the workers; the constructor returns in the parent and in every
+    // worker, with stdin and stdout of the workers redirected to the pipes
+    Workers(unsigned num);
+    ~Workers();
+
+    bool IsWorker() const
+    { return workerId_ >= 0; }
+
+    int GetWorkerId() const
+    { return workerId_; }
+
+    // parent: distributes the input and collects the translations until the
+    // input ends, then waits for the workers to exit
+    void Run(God &god);
+
+  private:
+    struct Worker {
+      pid_t pid;
+      int in;
+      int out;
+
+      // line number and word count of the sentences sent and not answered yet
+      std::deque<std::pair<long, unsigned>> lines;
+      std::atomic<size_t> pendingWords{0};
+      std::mutex mutex;
+
+      std::thread collector;
+      std::string error;
+      // set when the collector gave up on the worker and closed its output
+      std::atomic<bool> failed{false};
+    };
+
+    void Send(Worker& worker, const std::string& chunk,
+              const std::vector<std::pair<long, unsigned>>& lines, size_t words);
+    void Collect(God &god, Worker& worker);
+    // callers hold the worker's mutex
+    void Fail(Worker& worker, const std::string& error);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    int workerId_;
+};
+
+}
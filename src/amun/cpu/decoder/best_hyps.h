@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <boost/iterator/permutation_iterator.hpp>
 
 #include "common/scorer.h"
@@ -102,18 +103,8 @@ class BestHyps : public BestHypsBase
 
         HypothesisPtr hyp;
         if (returnAttentionWeights_) {
-          std::vector<SoftAlignmentPtr> alignments;
-          for (auto& scorer : scorers) {
-            if (CPU::CPUEncoderDecoderBase* encdec = dynamic_cast<CPU::CPUEncoderDecoderBase*>(scorer.get())) {
-              auto& attention = encdec->GetAttention();
-              alignments.emplace_back(new SoftAlignment(attention.begin(hypIndex),
-                                                        attention.end(hypIndex)));
-            } else {
-              amunmt_UTIL_THROW2("Return Alignment is allowed only with Nematus scorer.");
-            }
-          }
-
-          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost, alignments));
+          hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
+                                   GetAlignments(scorers, hypIndex)));
         } else {
           hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
         }
@@ -141,6 +132,105 @@ class BestHyps : public BestHypsBase
         beams[0].push_back(hyp);
       }
     }
+
+    void CalcForced(
+        const Beam& prevHyps,
+        const std::vector<ScorerPtr>& scorers,
+        const Words& filterIndices,
+        const Words& words,
+        Beam& beam,
+        const std::vector<unsigned>& rows = std::vector<unsigned>())
+    {
+      for (size_t i = 0; i < prevHyps.size(); ++i) {
+        size_t column = words[i];
+        if (isInputFiltered_) {
+          column = std::lower_bound(filterIndices.begin(), filterIndices.end(), words[i])
+                 - filterIndices.begin();
+          amunmt_UTIL_THROW_IF2(column == filterIndices.size() || filterIndices[column] != words[i],
+                                "Forced word " << words[i] << " is not in the shortlist");
+        }
+
+        const size_t row = rows.empty() ? i : rows[i];
+        float cost = prevHyps[i]->GetCost();
+        std::vector<float> modelCosts(scorers.size());
+        for (size_t j = 0; j < scorers.size(); ++j) {
+          mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[j]->GetProbs());
+          modelCosts[j] = currProb(row, column);
+          cost += weights_.at(scorers[j]->GetName()) * modelCosts[j];
+        }
+
+        HypothesisPtr hyp;
+        if (returnAttentionWeights_) {
+          hyp.reset(new Hypothesis(prevHyps[i], words[i], row, cost, GetAlignments(scorers, row)));
+        } else {
+          hyp.reset(new Hypothesis(prevHyps[i], words[i], row, cost));
+        }
+
+        std::vector<float>& prevBreakdown = prevHyps[i]->GetCostBreakdown();
+        for (size_t j = 0; j < prevBreakdown.size() && j < scorers.size(); ++j) {
+          modelCosts[j] += prevBreakdown[j];
+        }
+        hyp->GetCostBreakdown() = modelCosts;
+        beam.push_back(hyp);
+      }
+    }
+
+    void CalcSample(
+        const std::vector<ScorerPtr>& scorers,
+        const Words& filterIndices,
+        std::vector<SampleRandom>& randoms,
+        Words& words,
+        std::vector<float>& costs)
+    {
+      mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
+      const size_t columns = Probs.columns();
+      words.resize(Probs.rows());
+      costs.resize(Probs.rows());
+
+      scores_.resize(columns);
+      for (size_t i = 0; i < Probs.rows(); ++i) {
+        // the weighted sum of the scorers, as in CalcBeam()
+        for (size_t j = 0; j < scorers.size(); ++j) {
+          const float weight = weights_.at(scorers[j]->GetName());
+          const float* probs = &static_cast<mblas::ArrayMatrix&>(scorers[j]->GetProbs())(i, 0);
+          if (j == 0) {
+            for (size_t k = 0; k < columns; ++k) {
+              scores_[k] = weight * probs[k];
+            }
+          } else {
+            for (size_t k = 0; k < columns; ++k) {
+              scores_[k] += weight * probs[k];
+            }
+          }
+        }
+        if (forbidUNK_) {
+          scores_[UNK_ID] = std::numeric_limits<float>::lowest();
+        }
+
+        unsigned column = sampler_.Sample(scores_.data(), columns, randoms[i]);
+        words[i] = isInputFiltered_ ? filterIndices[column] : column;
+        costs[i] = scores_[column];
+      }
+    }
+
+  private:
+    // scratch space of CalcSample()
+    std::vector<float> scores_;
+
+    std::vector<SoftAlignmentPtr> GetAlignments(const std::vector<ScorerPtr>& scorers, size_t hypIndex)
+    {
+      std::vector<SoftAlignmentPtr> alignments;
+      for (auto& scorer : scorers) {
+        if (CPU::CPUEncoderDecoderBase* encdec = dynamic_cast<CPU::CPUEncoderDecoderBase*>(scorer.get())) {
+          auto& attention = encdec->GetAttention();
+          alignments.emplace_back(new SoftAlignment(attention.begin(hypIndex),
+                                                    attention.end(hypIndex)));
+        } else {
+          amunmt_UTIL_THROW2("Return Alignment is allowed only with Nematus scorer.");
+        }
+      }
+      return alignments;
+    }
 };
 
 }  // namespace CPU
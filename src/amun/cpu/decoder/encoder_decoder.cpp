@@ -19,10 +19,46 @@ CPUEncoderDecoderBase::CPUEncoderDecoderBase(
   : Scorer(god, name, config, tab)
 {}
 
+namespace {
+
+class CPUEncodedSource : public EncodedSource {
+  public:
+    mblas::Matrix SourceContext;
+    mblas::Matrix SCU;
+};
+
+}
+
 State* CPUEncoderDecoderBase::NewState() const {
   return new EDState();
 }
 
+EncodedSourcePtr CPUEncoderDecoderBase::TakeEncodedSource() {
+  std::shared_ptr<CPUEncodedSource> encoded(new CPUEncodedSource());
+  encoded->SourceContext.swap(SourceContext_);
+  encoded->SCU.swap(GetSCU());
+  return encoded;
+}
+
+void CPUEncoderDecoderBase::SetEncodedSource(EncodedSource& encoded) {
+  CPUEncodedSource& cpuEncoded = static_cast<CPUEncodedSource&>(encoded);
+  SourceContext_.swap(cpuEncoded.SourceContext);
+  GetSCU().swap(cpuEncoded.SCU);
+}
+
+void CPUEncoderDecoderBase::GatherState(const std::vector<const State*>& in,
+                                        const std::vector<unsigned>& rows, State& out) {
+  EDState& edOut = out.get<EDState>();
+  const EDState& first = in.front()->get<EDState>();
+  edOut.GetStates().resize(rows.size(), first.GetStates().columns());
+  edOut.GetEmbeddings().resize(rows.size(), first.GetEmbeddings().columns());
+  for (unsigned i = 0; i < rows.size(); ++i) {
+    const EDState& edIn = in[i]->get<EDState>();
+    blaze::row(edOut.GetStates(), i) = blaze::row(edIn.GetStates(), rows[i]);
+    blaze::row(edOut.GetEmbeddings(), i) = blaze::row(edIn.GetEmbeddings(), rows[i]);
+  }
+}
+
 
 }
 }
@@ -22,9 +22,18 @@ class CPUEncoderDecoderBase : public Scorer {
 
     virtual State* NewState() const;
 
+    virtual EncodedSourcePtr TakeEncodedSource();
+    virtual void SetEncodedSource(EncodedSource& encoded);
+
+    virtual void GatherState(const std::vector<const State*>& in,
+                             const std::vector<unsigned>& rows, State& out);
+
     virtual void GetAttention(mblas::Matrix& Attention) = 0;
     virtual mblas::Matrix& GetAttention() = 0;
 
+    // attention projection of SourceContext_, computed by BeginSentenceState()
+    virtual mblas::Matrix& GetSCU() = 0;
+
     virtual void *GetNBest()
     {
       assert(false);
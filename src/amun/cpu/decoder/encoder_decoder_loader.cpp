@@ -1,9 +1,12 @@
 #include "cpu/decoder/encoder_decoder_loader.h"
 
+#include <thread>
 #include <vector>
+#include <exception>
 #include <yaml-cpp/yaml.h>
 
 #include "common/god.h"
+#include "common/numa.h"
 #include "cpu/decoder/best_hyps.h"
 #include "cpu/dl4mt/encoder_decoder.h"
 #include "cpu/nematus/encoder_decoder.h"
@@ -19,28 +22,70 @@ EncoderDecoderLoader::EncoderDecoderLoader(
   : Loader(name, config)
 {}
 
-void EncoderDecoderLoader::Load(const God&) {
+void EncoderDecoderLoader::Load(const God& god) {
   std::string path = Get<std::string>("path");
   std::string type = Get<std::string>("type");
 
   LOG(info)->info("Loading model {}", path);
   LOG(info)->info("Model type: {}", type);
-  if (type == "nematus2") {
-    nematusModels_.emplace_back(new Nematus::Weights(path, 0));
-  } else {
-    dl4mtModels_.emplace_back(new dl4mt::Weights(path, 0));
+
+  const NumaTopology& topology = NumaTopology::Get();
+  std::string placement = (topology.GetNumNodes() > 1) ? god.Get<std::string>("numa-weights") : "shared";
+  unsigned replicas = (placement == "replicate") ? topology.GetNumNodes() : 1;
+  nematusModels_.resize((type == "nematus2") ? replicas : 0);
+  dl4mtModels_.resize((type == "nematus2") ? 0 : replicas);
+
+  // pages of the weights come from the node of the thread that first writes them
+  auto load = [&](unsigned replica) {
+    if (type == "nematus2") {
+      nematusModels_[replica].reset(new Nematus::Weights(path, 0));
+    } else {
+      dl4mtModels_[replica].reset(new dl4mt::Weights(path, 0));
+    }
+  };
+
+  if (placement == "replicate") {
+    LOG(info)->info("Loading a replica of the weights on each of {} NUMA nodes", replicas);
+    std::vector<std::thread> loaders;
+    std::vector<std::exception_ptr> errors(replicas);
+    for (unsigned node = 0; node < replicas; ++node) {
+      loaders.emplace_back([&, node] {
+        try {
+          PinThread(topology.GetCpus(node));
+          load(node);
+        } catch (...) {
+          errors[node] = std::current_exception();
+        }
+      });
+    }
+    for (unsigned node = 0; node < replicas; ++node) {
+      loaders[node].join();
+    }
+    for (auto& error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+  else if (placement == "interleave") {
+    LOG(info)->info("Interleaving the weights over {} NUMA nodes", topology.GetNumNodes());
+    InterleavedMemoryScope interleaved;
+    load(0);
+  }
+  else {
+    load(0);
   }
 }
 
-ScorerPtr EncoderDecoderLoader::NewScorer(const God &god, const DeviceInfo&) const {
+ScorerPtr EncoderDecoderLoader::NewScorer(const God &god, const DeviceInfo& deviceInfo) const {
   size_t tab = Has("tab") ? Get<size_t>("tab") : 0;
   std::string type = Get<std::string>("type");
   if (type == "nematus2") {
-    return ScorerPtr(new Nematus::EncoderDecoder(god, name_, config_,
-                                              tab, *nematusModels_[0]));
+    return ScorerPtr(new Nematus::EncoderDecoder(god, name_, config_, tab,
+                         *nematusModels_[deviceInfo.numaNode % nematusModels_.size()]));
   }
-  return ScorerPtr(new dl4mt::EncoderDecoder(god, name_, config_,
-                                             tab, *dl4mtModels_[0]));
+  return ScorerPtr(new dl4mt::EncoderDecoder(god, name_, config_, tab,
+                       *dl4mtModels_[deviceInfo.numaNode % dl4mtModels_.size()]));
 }
 
 BestHypsBasePtr EncoderDecoderLoader::GetBestHyps(const God &god, const DeviceInfo &deviceInfo) const {
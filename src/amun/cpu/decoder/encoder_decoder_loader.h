@@ -31,6 +31,7 @@ class EncoderDecoderLoader : public Loader {
     BestHypsBasePtr GetBestHyps(const God &god, const DeviceInfo &deviceInfo) const;
 
   private:
+    // one per NUMA node with --numa-weights replicate, otherwise one
     std::vector<std::unique_ptr<dl4mt::Weights>> dl4mtModels_;
     std::vector<std::unique_ptr<Nematus::Weights>> nematusModels_;
 };
@@ -58,6 +58,7 @@ class Decoder {
           Temp2_ = 0.0f;
           AddBiasVector<byRow>(Temp2_, Temp1_);
 
+          mblas::CountGemm(Temp2_, w_.Wi_);
           State = Temp2_ * w_.Wi_;
 
           if (w_.Gamma_.rows()) {
@@ -112,6 +113,7 @@ class Decoder {
 
         void Init(const mblas::Matrix& SourceContext) {
           using namespace mblas;
+          mblas::CountGemm(SourceContext, w_.U_);
           SCU_ = SourceContext * w_.U_;
           if (w_.Gamma_1_.rows()) {
             LayerNormalization(SCU_, w_.Gamma_1_);
@@ -124,6 +126,7 @@ class Decoder {
                                      const mblas::Matrix& SourceContext) {
           using namespace mblas;
 
+          mblas::CountGemm(HiddenState, w_.W_);
           Temp2_ = HiddenState * w_.W_;
           if (w_.Gamma_2_.rows()) {
             LayerNormalization(Temp2_, w_.Gamma_2_);
@@ -132,6 +135,7 @@ class Decoder {
           Temp1_ = Broadcast<Matrix>(Tanh(), SCU_, Temp2_);
 
           A_.resize(Temp1_.rows(), 1);
+          mblas::CountGemm(Temp1_, V_);
           blaze::column(A_, 0) = Temp1_ * V_;
           size_t words = SourceContext.rows();
           // batch size, for batching, divide by numer of sentences
@@ -142,6 +146,7 @@ class Decoder {
           blaze::forEach(A_, [=](float x) { return x + bias; });
 
           mblas::SafeSoftmax(A_);
+          mblas::CountGemm(A_, SourceContext);
           AlignedSourceContext = A_ * SourceContext;
         }
 
@@ -153,6 +158,10 @@ class Decoder {
           return A_;
         }
 
+        mblas::Matrix& GetSCU() {
+          return SCU_;
+        }
+
       private:
         const Weights& w_;
 
@@ -179,18 +188,21 @@ class Decoder {
           using namespace mblas;
 
 
+          mblas::CountGemm(State, w_.W1_);
           T1_ = State * w_.W1_;
           if (w_.Gamma_1_.rows()) {
             LayerNormalization(T1_, w_.Gamma_1_);
           }
           AddBiasVector<byRow>(T1_, w_.B1_);
 
+          mblas::CountGemm(Embedding, w_.W2_);
           T2_ = Embedding * w_.W2_;
           if (w_.Gamma_0_.rows()) {
             LayerNormalization(T2_, w_.Gamma_0_);
           }
           AddBiasVector<byRow>(T2_, w_.B2_);
 
+          mblas::CountGemm(AlignedSourceContext, w_.W3_);
           T3_ = AlignedSourceContext * w_.W3_;
           if (w_.Gamma_2_.rows()) {
             LayerNormalization(T3_, w_.Gamma_2_);
@@ -200,9 +212,11 @@ class Decoder {
           auto t = blaze::forEach(T1_ + T2_ + T3_, Tanh());
 
           if(!filtered_) {
+            mblas::CountGemm(t, w_.W4_);
             Probs = t * w_.W4_;
             AddBiasVector<byRow>(Probs, w_.B4_);
           } else {
+            mblas::CountGemm(t, FilteredW4_);
             Probs = t * FilteredW4_;
             AddBiasVector<byRow>(Probs, FilteredB4_);
           }
@@ -281,27 +295,33 @@ class Decoder {
       return attention_.GetAttention();
     }
 
+    mblas::Matrix& GetSCU() {
+      return attention_.GetSCU();
+    }
+
     size_t GetVocabSize() const {
       return embeddings_.GetRows();
     }
 
-  private:
-
+    // the steps of Decode(), amun_bench times them one by one
     void GetHiddenState(mblas::Matrix& HiddenState,
                         const mblas::Matrix& PrevState,
                         const mblas::Matrix& Embedding) {
+      ProfileScope profile(Profiler::GRU1);
       rnn1_.GetNextState(HiddenState, PrevState, Embedding);
     }
 
     void GetAlignedSourceContext(mblas::Matrix& AlignedSourceContext,
                                  const mblas::Matrix& HiddenState,
                                  const mblas::Matrix& SourceContext) {
+      ProfileScope profile(Profiler::ATTENTION);
     	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext);
     }
 
     void GetNextState(mblas::Matrix& State,
                       const mblas::Matrix& HiddenState,
                       const mblas::Matrix& AlignedSourceContext) {
+      ProfileScope profile(Profiler::GRU2);
       rnn2_.GetNextState(State, HiddenState, AlignedSourceContext);
     }
 
@@ -309,6 +329,7 @@ class Decoder {
     void GetProbs(const mblas::Matrix& State,
                   const mblas::Matrix& Embedding,
                   const mblas::Matrix& AlignedSourceContext) {
+      ProfileScope profile(Profiler::SOFTMAX);
       softmax_.GetProbs(Probs_, State, Embedding, AlignedSourceContext);
     }
 
@@ -43,8 +43,14 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
                                    const Beam& beam,
                                    State& out);
 
+    virtual void AssembleState(const State& in,
+                               const Words& words,
+                               const std::vector<unsigned>& stateIds,
+                               State& out);
+
     void GetAttention(mblas::Matrix& Attention);
     mblas::Matrix& GetAttention();
+    mblas::Matrix& GetSCU();
 
     unsigned GetVocabSize() const;
 
@@ -18,11 +18,13 @@ class GRU {
     void GetNextState(mblas::Matrix& NextState,
                       const mblas::Matrix& State,
                       const mblas::Matrix& Context) const {
+      mblas::CountGemm(Context, WWx_);
       RUH_ = Context * WWx_;
       if (w_.Gamma_1_.rows()) {
         LayerNormalization(RUH_, w_.Gamma_1_);
       }
 
+      mblas::CountGemm(State, UUx_);
       Temp_ = State * UUx_;
       if (w_.Gamma_2_.rows()) {
         LayerNormalization(Temp_, w_.Gamma_2_);
@@ -21,7 +21,9 @@ class Transition {
     {
       if (layerNormalization_) {
         for (int i = 0; i < w_.size(); ++i) {
+          mblas::CountGemm(state, w_.U_[i]);
           Temp_1_ = state * w_.U_[i];
+          mblas::CountGemm(state, w_.Ux_[i]);
           Temp_2_ = state * w_.Ux_[i];
 
           switch(w_.type()) {
@@ -44,7 +46,9 @@ class Transition {
         }
       } else {
         for (int i = 0; i < w_.size(); ++i) {
+          mblas::CountGemm(state, w_.U_[i]);
           Temp_1_ = state * w_.U_[i];
+          mblas::CountGemm(state, w_.Ux_[i]);
           Temp_2_ = state * w_.Ux_[i];
           mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.B_[i]);
           mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx1_[i]);
@@ -9,6 +9,7 @@
 #include "phoenix_functions.h"
 #include "common/base_matrix.h"
 #include "common/exception.h"
+#include "common/profiler.h"
 
 namespace amunmt {
 namespace CPU {
@@ -193,6 +194,21 @@ std::string Debug(const M& m)
   return strm.str();
 }
 
+// records the product A * B with the profiler
+template <class MT1, class MT2>
+inline void CountGemm(const MT1& A, const MT2& B) {
+  if (Profiler::IsEnabled()) {
+    Profiler::AddGemm(A.rows(), B.columns(), A.columns());
+  }
+}
+
+template <class MT>
+inline void CountGemm(const MT& A, const ColumnVector& v) {
+  if (Profiler::IsEnabled()) {
+    Profiler::AddGemm(A.rows(), 1, A.columns());
+  }
+}
+
 template <bool byRow, class MT, class VT>
 MT& AddBiasVector(MT& m, const VT& b) {
   if(byRow) {
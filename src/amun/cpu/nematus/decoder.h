@@ -66,6 +66,7 @@ class Decoder {
           Temp2_ = 0.0f;
           AddBiasVector<byRow>(Temp2_, Temp1_);
 
+          mblas::CountGemm(Temp2_, w_.Wi_);
           State = Temp2_ * w_.Wi_;
           AddBiasVector<byRow>(State, w_.Bi_);
 
@@ -130,6 +131,7 @@ class Decoder {
 
         void Init(const mblas::Matrix& SourceContext) {
           using namespace mblas;
+          mblas::CountGemm(SourceContext, w_.U_);
           SCU_ = SourceContext * w_.U_;
           mblas::AddBiasVector<mblas::byRow>(SCU_, w_.B_);
 
@@ -145,6 +147,7 @@ class Decoder {
         {
           using namespace mblas;
 
+          mblas::CountGemm(HiddenState, w_.W_);
           Temp2_ = HiddenState * w_.W_;
           if (w_.W_comb_lns_.rows()) {
             LayerNormalization(Temp2_, w_.W_comb_lns_, w_.W_comb_lnb_);
@@ -153,6 +156,7 @@ class Decoder {
           Temp1_ = Broadcast<Matrix>(Tanh(), SCU_, Temp2_);
 
           A_.resize(Temp1_.rows(), 1);
+          mblas::CountGemm(Temp1_, V_);
           blaze::column(A_, 0) = Temp1_ * V_;
           size_t words = SourceContext.rows();
           // batch size, for batching, divide by numer of sentences
@@ -163,6 +167,7 @@ class Decoder {
           blaze::forEach(A_, [=](float x) { return x + bias; });
 
           mblas::SafeSoftmax(A_);
+          mblas::CountGemm(A_, SourceContext);
           AlignedSourceContext = A_ * SourceContext;
         }
 
@@ -174,6 +179,10 @@ class Decoder {
           return A_;
         }
 
+        mblas::Matrix& GetSCU() {
+          return SCU_;
+        }
+
       private:
         const Weights& w_;
 
@@ -199,6 +208,7 @@ class Decoder {
                   const mblas::Matrix& AlignedSourceContext) {
           using namespace mblas;
 
+          mblas::CountGemm(State, w_.W1_);
           T1_ = State * w_.W1_;
           AddBiasVector<byRow>(T1_, w_.B1_);
           if (w_.lns_1_.rows()) {
@@ -208,6 +218,7 @@ class Decoder {
           // for(int i = 0; i < 5; ++i) std::cerr << T1_(0, i) << " ";
           // std::cerr << std::endl;
 
+          mblas::CountGemm(Embedding, w_.W2_);
           T2_ = Embedding * w_.W2_;
           AddBiasVector<byRow>(T2_, w_.B2_);
           if (w_.lns_2_.rows()) {
@@ -217,6 +228,7 @@ class Decoder {
           // for(int i = 0; i < 5; ++i) std::cerr << T2_(0, i) << " ";
           // std::cerr << std::endl;
 
+          mblas::CountGemm(AlignedSourceContext, w_.W3_);
           T3_ = AlignedSourceContext * w_.W3_;
           AddBiasVector<byRow>(T3_, w_.B3_);
           if (w_.lns_3_.rows()) {
@@ -229,9 +241,11 @@ class Decoder {
           auto t = blaze::forEach(T1_ + T2_ + T3_, Tanh());
 
           if(!filtered_) {
+            mblas::CountGemm(t, w_.W4_);
             Probs = t * w_.W4_;
             AddBiasVector<byRow>(Probs, w_.B4_);
           } else {
+            mblas::CountGemm(t, FilteredW4_);
             Probs = t * FilteredW4_;
             AddBiasVector<byRow>(Probs, FilteredB4_);
           }
@@ -327,6 +341,10 @@ class Decoder {
       return attention_.GetAttention();
     }
 
+    mblas::Matrix& GetSCU() {
+      return attention_.GetSCU();
+    }
+
     size_t GetVocabSize() const {
       return embeddings_.GetRows();
     }
@@ -336,18 +354,21 @@ class Decoder {
     void GetHiddenState(mblas::Matrix& HiddenState,
                         const mblas::Matrix& PrevState,
                         const mblas::Matrix& Embedding) {
+      ProfileScope profile(Profiler::GRU1);
       rnn1_.GetNextState(HiddenState, PrevState, Embedding);
     }
 
     void GetAlignedSourceContext(mblas::Matrix& AlignedSourceContext,
                                  const mblas::Matrix& HiddenState,
                                  const mblas::Matrix& SourceContext) {
+      ProfileScope profile(Profiler::ATTENTION);
     	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext);
     }
 
     void GetNextState(mblas::Matrix& State,
                       const mblas::Matrix& HiddenState,
                       const mblas::Matrix& AlignedSourceContext) {
+      ProfileScope profile(Profiler::GRU2);
       rnn2_.GetNextState(State, HiddenState, AlignedSourceContext);
     }
 
@@ -355,6 +376,7 @@ class Decoder {
     void GetProbs(const mblas::Matrix& State,
                   const mblas::Matrix& Embedding,
                   const mblas::Matrix& AlignedSourceContext) {
+      ProfileScope profile(Profiler::SOFTMAX);
       softmax_.GetProbs(Probs_, State, Embedding, AlignedSourceContext);
     }
 
@@ -61,11 +61,18 @@ void EncoderDecoder::AssembleBeamState(const State& in,
       beamStateIds.push_back(h->GetPrevStateIndex());
   }
 
+  AssembleState(in, beamWords, beamStateIds, out);
+}
+
+void EncoderDecoder::AssembleState(const State& in,
+                                   const Words& words,
+                                   const std::vector<unsigned>& stateIds,
+                                   State& out) {
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
-  edOut.GetStates() = mblas::Assemble<mblas::byRow, mblas::Matrix>(edIn.GetStates(), beamStateIds);
-  decoder_->Lookup(edOut.GetEmbeddings(), beamWords);
+  edOut.GetStates() = mblas::Assemble<mblas::byRow, mblas::Matrix>(edIn.GetStates(), stateIds);
+  decoder_->Lookup(edOut.GetEmbeddings(), words);
 }
 
 
@@ -79,6 +86,11 @@ mblas::Matrix& EncoderDecoder::GetAttention() {
 }
 
 
+mblas::Matrix& EncoderDecoder::GetSCU() {
+  return decoder_->GetSCU();
+}
+
+
 unsigned EncoderDecoder::GetVocabSize() const {
   return decoder_->GetVocabSize();
 }
@@ -25,20 +25,24 @@ class GRU {
     {
       // std::cerr << "Get next state" << std::endl;
       if (layerNormalization_) {
+        mblas::CountGemm(context, w_.W_);
         RUH_1_ = context * w_.W_;
         mblas::AddBiasVector<mblas::byRow>(RUH_1_, w_.B_);
         LayerNormalization(RUH_1_, w_.W_lns_, w_.W_lnb_);
 
+        mblas::CountGemm(context, w_.Wx_);
         RUH_2_ = context * w_.Wx_;
         mblas::AddBiasVector<mblas::byRow>(RUH_2_, w_.Bx1_);
         LayerNormalization(RUH_2_, w_.Wx_lns_, w_.Wx_lnb_);
 
         RUH_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(RUH_1_, RUH_2_);
 
+        mblas::CountGemm(state, w_.U_);
         Temp_1_ = state * w_.U_;
         mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.Bx3_);
         LayerNormalization(Temp_1_, w_.U_lns_, w_.U_lnb_);
 
+        mblas::CountGemm(state, w_.Ux_);
         Temp_2_ = state * w_.Ux_;
         mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx2_);
         LayerNormalization(Temp_2_, w_.Ux_lns_, w_.Ux_lnb_);
@@ -48,7 +52,9 @@ class GRU {
         ElementwiseOpsLayerNorm(nextState, state);
 
       } else {
+        mblas::CountGemm(context, WWx_);
         RUH_ = context * WWx_;
+        mblas::CountGemm(state, UUx_);
         Temp_ = state * UUx_;
         ElementwiseOps(nextState, state);
       }
@@ -18,7 +18,9 @@ void Transition::GetNextState(mblas::Matrix& state) const
 {
   if (layerNormalization_) {
     for (int i = 0; i < w_.size(); ++i) {
+      mblas::CountGemm(state, w_.U_[i]);
       Temp_1_ = state * w_.U_[i];
+      mblas::CountGemm(state, w_.Ux_[i]);
       Temp_2_ = state * w_.Ux_[i];
 
       switch(w_.type()) {
@@ -41,7 +43,9 @@ void Transition::GetNextState(mblas::Matrix& state) const
     }
   } else {
     for (int i = 0; i < w_.size(); ++i) {
+      mblas::CountGemm(state, w_.U_[i]);
       Temp_1_ = state * w_.U_[i];
+      mblas::CountGemm(state, w_.Ux_[i]);
       Temp_2_ = state * w_.Ux_[i];
       mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.B_[i]);
       mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx1_[i]);
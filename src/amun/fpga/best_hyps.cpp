@@ -10,15 +10,10 @@ namespace amunmt {
 namespace FPGA {
 
 BestHyps::BestHyps(const God &god, const OpenCLInfo &openCLInfo)
-: BestHypsBase(
-    !god.Get<bool>("allow-unk"),
-    god.Get<bool>("n-best"),
-    god.Get<std::vector<std::string>>("softmax-filter").size(),
-    god.Get<bool>("return-alignment") || god.Get<bool>("return-soft-alignment") || god.Get<bool>("return-nematus-alignment"),
-    god.GetScorerWeights()),
-  nthElement_(openCLInfo, god.Get<size_t>("beam-size"), god.Get<size_t>("mini-batch")),
-  keys(openCLInfo, god.Get<size_t>("beam-size") * god.Get<size_t>("mini-batch")),
-  Costs(openCLInfo, god.Get<size_t>("beam-size") * god.Get<size_t>("mini-batch"))
+: BestHypsBase(god),
+  nthElement_(openCLInfo, god.GetOptions().beamSize, god.GetOptions().miniBatch),
+  keys(openCLInfo, god.GetOptions().beamSize * god.GetOptions().miniBatch),
+  Costs(openCLInfo, god.GetOptions().beamSize * god.GetOptions().miniBatch)
 {
   //std::cerr << "BestHyps::BestHyps" << std::endl;
 }
@@ -73,7 +68,7 @@ void BestHyps::CalcBeam(
   }
   //std::cerr << "2Probs=" << Probs.Debug(1) << std::endl;
 
-  if (!god.Get<bool>("allow-unk")) {
+  if (forbidUNK_) {
     DisAllowUNK(Probs);
   }
 
@@ -90,12 +85,12 @@ void BestHyps::CalcBeam(
   //std::cerr << "bestKeys=" << amunmt::Debug(bestKeys, 2) << std::endl;
 
   std::vector<std::vector<float>> breakDowns;
-  bool doBreakdown = god.Get<bool>("n-best");
+  bool doBreakdown = god_.GetOptions().nBest;
   if (doBreakdown) {
     // TODO
   }
 
-  bool filter = god.Get<std::vector<std::string>>("softmax-filter").size();
+  bool filter = isInputFiltered_;
 
   std::map<size_t, size_t> batchMap;
   size_t tmp = 0;
@@ -115,7 +110,7 @@ void BestHyps::CalcBeam(
     float cost = bestCosts[i];
 
     HypothesisPtr hyp;
-    if (returnAlignment) {
+    if (returnAttentionWeights_) {
       //hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost,
       //                         GetAlignments(scorers, hypIndex)));
     } else {
@@ -7,12 +7,12 @@ namespace GPU {
 
 BestHyps::BestHyps(const God &god)
       : BestHypsBase(god),
-        keys_(god.Get<unsigned>("beam-size") * god.Get<unsigned>("mini-batch")),
-        costs_(god.Get<unsigned>("beam-size") * god.Get<unsigned>("mini-batch")),
-        maxBeamSize_(god.Get<unsigned>("beam-size"))
+        keys_(god.GetOptions().beamSize * god.GetOptions().miniBatch),
+        costs_(god.GetOptions().beamSize * god.GetOptions().miniBatch),
+        maxBeamSize_(god.GetOptions().beamSize)
 {
   if (!god_.UseFusedSoftmax()) {
-    NthElement *obj = new NthElement(god.Get<unsigned>("beam-size"), god.Get<unsigned>("mini-batch"));
+    NthElement *obj = new NthElement(god.GetOptions().beamSize, god.GetOptions().miniBatch);
     nthElement_.reset(obj);
   }
 }
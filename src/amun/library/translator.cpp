@@ -0,0 +1,369 @@
+#include "library/translator.h"
+
+#include <algorithm>
+
+#include "common/god.h"
+#include "common/dynamic_batcher.h"
+#include "common/exception.h"
+#include "common/history.h"
+#include "common/histories.h"
+#include "common/printer.h"
+#include "common/search.h"
+#include "common/sentences.h"
+#include "common/translation_task.h"
+
+namespace amunmt {
+
+namespace {
+
+TranslationHypothesis GetHypothesis(const God &god, const Result& result) {
+  const Options& options = god.GetOptions();
+  const Words& words = result.first;
+  const HypothesisPtr& hypo = result.second;
+
+  TranslationHypothesis hypothesis;
+  for (Word word : words) {
+    if (word != EOS_ID) {
+      hypothesis.wordIds.push_back(word);
+    }
+  }
+  hypothesis.tokens = god.Postprocess(god.GetTargetVocab()(words));
+  hypothesis.text = Join(hypothesis.tokens);
+
+  hypothesis.score = hypo->GetCost();
+  if (options.normalize && !words.empty()) {
+    hypothesis.score /= words.size();
+  }
+  hypothesis.scoreBreakdown = hypo->GetCostBreakdown();
+
+  if (options.ReturnAttentionWeights()) {
+    hypothesis.alignment = GetAlignment(hypo);
+    hypothesis.softAlignment = GetSoftAlignment(hypo);
+  }
+  return hypothesis;
+}
+
+}
+
+struct Translator::Request {
+  SentencePtr sentence;
+  Clock::time_point arrived;
+
+  // either the promise is used, or the callback is set
+  std::promise<TranslationResult> promise;
+  Callback callback;
+  ErrorCallback onError;
+
+  PartialCallback partial;
+  std::string lastPartial;
+};
+
+Translator::Translator(const std::string& options)
+  : god_(new God())
+{
+  god_->Init(options);
+  Start();
+}
+
+Translator::Translator(int argc, char** argv)
+  : god_(new God())
+{
+  god_->Init(argc, argv);
+  Start();
+}
+
+void Translator::Start()
+{
+  nextLineNum_ = 0;
+  inFlight_ = 0;
+
+  batcher_.reset(new DynamicBatcher<RequestPtr>(*god_, [this](std::vector<RequestPtr> batch) {
+    Dispatch(batch);
+  }));
+}
+
+Translator::~Translator()
+{
+  batcher_->Stop();
+
+  {
+    std::unique_lock<std::mutex> lock(inFlightMutex_);
+    inFlightDone_.wait(lock, [this] { return inFlight_ == 0; });
+  }
+  god_->Cleanup();
+}
+
+std::future<TranslationResult> Translator::Translate(const std::string& sentence)
+{
+  RequestPtr request = CreateRequest(sentence);
+  std::future<TranslationResult> result = request->promise.get_future();
+  Submit({request});
+  return result;
+}
+
+std::vector<std::future<TranslationResult>> Translator::Translate(const std::vector<std::string>& sentences)
+{
+  std::vector<RequestPtr> requests;
+  std::vector<std::future<TranslationResult>> results;
+  for (const std::string& sentence : sentences) {
+    requests.push_back(CreateRequest(sentence));
+    results.push_back(requests.back()->promise.get_future());
+  }
+  Submit(requests);
+  return results;
+}
+
+void Translator::Translate(const std::string& sentence, Callback callback, ErrorCallback onError)
+{
+  RequestPtr request = CreateRequest(sentence);
+  request->callback = callback;
+  request->onError = onError;
+  Submit({request});
+}
+
+void Translator::Translate(const std::string& sentence, Callback callback, PartialCallback partial,
+                           ErrorCallback onError)
+{
+  RequestPtr request = CreateRequest(sentence);
+  request->callback = callback;
+  request->partial = partial;
+  request->onError = onError;
+  Submit({request});
+}
+
+void Translator::Translate(const std::vector<std::string>& sentences, BatchCallback callback,
+                           BatchErrorCallback onError)
+{
+  std::vector<RequestPtr> requests;
+  for (size_t i = 0; i < sentences.size(); ++i) {
+    requests.push_back(CreateRequest(sentences[i]));
+    requests.back()->callback = [callback, i](const TranslationResult& result) {
+      callback(i, result);
+    };
+    if (onError) {
+      requests.back()->onError = [onError, i](std::exception_ptr error) {
+        onError(i, error);
+      };
+    }
+  }
+  Submit(requests);
+}
+
+std::future<TranslationResult> Translator::TranslateIds(const std::vector<unsigned>& ids)
+{
+  RequestPtr request = CreateRequest(ids);
+  std::future<TranslationResult> result = request->promise.get_future();
+  Submit({request});
+  return result;
+}
+
+void Translator::TranslateIds(const std::vector<unsigned>& ids, Callback callback, ErrorCallback onError)
+{
+  RequestPtr request = CreateRequest(ids);
+  request->callback = callback;
+  request->onError = onError;
+  Submit({request});
+}
+
+std::shared_ptr<PrefixSession> Translator::NewSession()
+{
+  return std::make_shared<PrefixSession>();
+}
+
+std::future<TranslationResult> Translator::TranslateWithPrefix(const std::shared_ptr<PrefixSession>& session,
+                                                               const std::string& sentence,
+                                                               const std::string& prefix)
+{
+  RequestPtr request = CreateRequest(sentence);
+  Words words = god_->GetTargetVocab()(prefix, false);
+  request->sentence->GetTimestamps().enqueued = Clock::now();
+
+  {
+    std::lock_guard<std::mutex> lock(inFlightMutex_);
+    ++inFlight_;
+  }
+  god_->GetMetrics().SentenceStarted();
+  std::future<TranslationResult> result;
+  try {
+    result = god_->GetThreadPool().enqueue([this, session, request, words] {
+      SentencesPtr sentences(new Sentences());
+      sentences->push_back(request->sentence);
+
+      TranslationResult result;
+      try {
+        std::shared_ptr<Histories> histories = PrefixTranslationTask(*god_, *session, sentences, words);
+        result = GetResult(*request, *histories, 0);
+      } catch (...) {
+        god_->GetMetrics().SentenceFinished();
+        Finished();
+        throw;
+      }
+      Finished();
+      return result;
+    });
+  } catch (...) {
+    god_->GetMetrics().SentenceFinished();
+    Finished();
+    throw;
+  }
+  return result;
+}
+
+void Translator::Reload()
+{
+  god_->Reload();
+}
+
+std::vector<std::string> Translator::GetScorerNames() const
+{
+  return god_->GetScorerNames();
+}
+
+Translator::RequestPtr Translator::CreateRequest(const std::string& sentence)
+{
+  // preprocessed on the calling thread, so concurrent callers share the work
+  return CreateRequest(new Sentence(*god_, nextLineNum_++, sentence));
+}
+
+Translator::RequestPtr Translator::CreateRequest(const std::vector<unsigned>& ids)
+{
+  Words words(ids);
+  words.push_back(EOS_ID);
+  return CreateRequest(new Sentence(*god_, nextLineNum_++, words));
+}
+
+Translator::RequestPtr Translator::CreateRequest(Sentence* sentence)
+{
+  RequestPtr request(new Request());
+  request->arrived = Clock::now();
+  request->sentence.reset(sentence);
+  request->sentence->GetTimestamps().read = request->arrived;
+  return request;
+}
+
+void Translator::Submit(std::vector<RequestPtr> requests)
+{
+  // longest first, so that the mini-batches cut from a large submission have
+  // sentences of similar length
+  std::stable_sort(requests.begin(), requests.end(), [](const RequestPtr& a, const RequestPtr& b) {
+    return a->sentence->size() > b->sentence->size();
+  });
+
+  // counted before submitting, as the first ones may be done before Submit() returns
+  Metrics& metrics = god_->GetMetrics();
+  for (size_t i = 0; i < requests.size(); ++i) {
+    metrics.SentenceStarted();
+  }
+  if (!batcher_->Submit(requests)) {
+    for (size_t i = 0; i < requests.size(); ++i) {
+      metrics.SentenceFinished();
+    }
+    amunmt_UTIL_THROW2("Translator is shutting down");
+  }
+}
+
+void Translator::Dispatch(std::vector<RequestPtr> batch)
+{
+  {
+    std::lock_guard<std::mutex> lock(inFlightMutex_);
+    ++inFlight_;
+  }
+  god_->GetThreadPool().enqueue([this, batch] { Decode(batch); });
+}
+
+void Translator::Decode(std::vector<RequestPtr> batch)
+{
+  // whatever throws below, the batch is no longer in flight afterwards
+  struct FinishedGuard {
+    Translator& translator;
+    ~FinishedGuard() { translator.Finished(); }
+  } finished{*this};
+
+  // longest first, as in the mini-batches of the input pipeline
+  std::stable_sort(batch.begin(), batch.end(), [](const RequestPtr& a, const RequestPtr& b) {
+    return a->sentence->size() > b->sentence->size();
+  });
+
+  SentencesPtr sentences(new Sentences());
+  for (auto& request : batch) {
+    sentences->push_back(request->sentence);
+  }
+
+  StablePrefixCallback onStablePrefix;
+  if (std::any_of(batch.begin(), batch.end(), [](const RequestPtr& request) { return bool(request->partial); })) {
+    onStablePrefix = [this, &batch](unsigned i, const Words& prefix) {
+      Request& request = *batch[i];
+      if (request.partial) {
+        std::string partial = GetStablePrefixString(*god_, prefix);
+        if (partial != request.lastPartial) {
+          request.partial(partial);
+          request.lastPartial.swap(partial);
+        }
+      }
+    };
+  }
+
+  // an error fails the sentences of this batch that were not answered yet,
+  // not the host process; that includes an error in postprocessing or in a
+  // callback
+  unsigned answered = 0;
+  try {
+    std::shared_ptr<Histories> histories = TryTranslationTask(*god_, sentences, nullptr, onStablePrefix);
+    while (answered < histories->size()) {
+      Request& request = *batch[answered];
+      TranslationResult result = GetResult(request, *histories, answered);
+      ++answered;
+      if (request.callback) {
+        request.callback(result);
+      } else {
+        request.promise.set_value(std::move(result));
+      }
+    }
+  } catch (...) {
+    Failed(std::vector<RequestPtr>(batch.begin() + answered, batch.end()), std::current_exception());
+  }
+}
+
+TranslationResult Translator::GetResult(const Request& request, const Histories& histories, unsigned i)
+{
+  const History& history = *histories.at(i);
+  unsigned nbest = god_->ReturnNBestList() ? god_->GetOptions().beamSize : 1;
+
+  TranslationResult result;
+  for (const Result& hypothesis : history.NBest(nbest)) {
+    result.nbest.push_back(GetHypothesis(*god_, hypothesis));
+  }
+
+  god_->GetLatencyStats().Record(*request.sentence, history.Top().first.size());
+  god_->GetMetrics().SentenceFinished();
+  return result;
+}
+
+void Translator::Failed(const std::vector<RequestPtr>& batch, std::exception_ptr error)
+{
+  for (auto& request : batch) {
+    god_->GetMetrics().SentenceFinished();
+    if (!request->callback) {
+      request->promise.set_exception(error);
+    } else if (request->onError) {
+      request->onError(error);
+    } else {
+      try {
+        std::rethrow_exception(error);
+      } catch (std::exception& e) {
+        LOG(info)->error("Translation of line {} failed: {}", request->sentence->GetLineNum(), e.what());
+      } catch (...) {
+        LOG(info)->error("Translation of line {} failed", request->sentence->GetLineNum());
+      }
+    }
+  }
+}
+
+void Translator::Finished()
+{
+  std::lock_guard<std::mutex> lock(inFlightMutex_);
+  --inFlight_;
+  inFlightDone_.notify_all();
+}
+
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace amunmt {
+
+class God;
+class Sentence;
+class PrefixSession;
+class Histories;
+template <class RequestPtr> class DynamicBatcher;
+
+// One translation of a sentence.
+struct TranslationHypothesis {
+  // target vocabulary ids without </s>, and the postprocessed target words
+  std::vector<unsigned> wordIds;
+  std::vector<std::string> tokens;
+  std::string text;
+
+  // model score, divided by the number of target words with --normalize
+  float score = 0;
+
+  // score of every scorer in the order of Translator::GetScorerNames(), with --n-best
+  std::vector<float> scoreBreakdown;
+
+  // for every target word the source position it attends to most and its
+  // attention weights, with --return-alignment or --return-soft-alignment
+  std::vector<unsigned> alignment;
+  std::vector<std::vector<float>> softAlignment;
+};
+
+struct TranslationResult {
+  // best first, the whole beam with --n-best
+  std::vector<TranslationHypothesis> nbest;
+
+  const TranslationHypothesis& Best() const
+  { return nbest.front(); }
+};
+
+// Thread-safe entry point for embedding the decoder in a C++ program, built
+// as libamun. Sentences may be submitted from any number of threads; they are
+// merged into mini-batches like the requests of `amun --server` and each one
+// is answered through a future or a callback:
+//
+//   Translator translator("-c config.yml --cpu-threads 8");
+//   std::future<TranslationResult> result = translator.Translate("hello world");
+//   std::cout << result.get().Best().text << std::endl;
+//
+// The model holds process-wide state (loggers, per-thread search objects), so
+// there can only be one Translator per process.
+class Translator {
+  public:
+    typedef std::function<void(const TranslationResult&)> Callback;
+    typedef std::function<void(size_t, const TranslationResult&)> BatchCallback;
+    // postprocessed words all hypotheses of the beam agree on, see
+    // History::UpdateStablePrefix(); called whenever they grew
+    typedef std::function<void(const std::string&)> PartialCallback;
+    typedef std::function<void(std::exception_ptr)> ErrorCallback;
+    typedef std::function<void(size_t, std::exception_ptr)> BatchErrorCallback;
+
+    // options as on the amun command line, e.g. "-c config.yml --n-best"
+    Translator(const std::string& options);
+    Translator(int argc, char** argv);
+
+    // finishes the sentences submitted so far
+    ~Translator();
+
+    std::future<TranslationResult> Translate(const std::string& sentence);
+    std::vector<std::future<TranslationResult>> Translate(const std::vector<std::string>& sentences);
+
+    // callbacks run on a decoder thread as soon as their sentence is
+    // translated and must not throw; the batch callback gets the index of the
+    // sentence in sentences. If the batch of a sentence fails, its error
+    // callback gets the exception instead, or the error is logged if there is
+    // none; futures throw the exception from get().
+    void Translate(const std::string& sentence, Callback callback,
+                   ErrorCallback onError = nullptr);
+    void Translate(const std::vector<std::string>& sentences, BatchCallback callback,
+                   BatchErrorCallback onError = nullptr);
+
+    // streams partial translations before the result, on the same thread
+    void Translate(const std::string& sentence, Callback callback, PartialCallback partial,
+                   ErrorCallback onError = nullptr);
+
+    // source vocabulary ids of an already preprocessed sentence, without </s>
+    std::future<TranslationResult> TranslateIds(const std::vector<unsigned>& ids);
+    void TranslateIds(const std::vector<unsigned>& ids, Callback callback,
+                      ErrorCallback onError = nullptr);
+
+    // interactive translation: the translation of sentence that starts with
+    // prefix, target vocabulary tokens separated by spaces as the model writes
+    // them before postprocessing. Not batched; the session keeps the encoding
+    // of the sentence and the decoder states along the prefix, so that the
+    // next call for the same sentence only decodes what the prefix added.
+    // One call per session at a time.
+    std::shared_ptr<PrefixSession> NewSession();
+    std::future<TranslationResult> TranslateWithPrefix(const std::shared_ptr<PrefixSession>& session,
+                                                       const std::string& sentence,
+                                                       const std::string& prefix);
+
+    // loads the model files again and swaps them in once warmed up, see
+    // God::Reload(); blocks the calling thread while loading, translations
+    // go on with the current models meanwhile. Throws if the new models
+    // can't be loaded, the current ones stay. Not to be called from a
+    // callback, which runs on a decoder thread.
+    void Reload();
+
+    std::vector<std::string> GetScorerNames() const;
+
+    God& GetGod()
+    { return *god_; }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Request;
+    typedef std::shared_ptr<Request> RequestPtr;
+
+    void Start();
+    RequestPtr CreateRequest(const std::string& sentence);
+    RequestPtr CreateRequest(const std::vector<unsigned>& ids);
+    RequestPtr CreateRequest(Sentence* sentence);
+    void Submit(std::vector<RequestPtr> requests);
+
+    void Dispatch(std::vector<RequestPtr> batch);
+    void Decode(std::vector<RequestPtr> batch);
+    TranslationResult GetResult(const Request& request, const Histories& histories, unsigned i);
+    void Failed(const std::vector<RequestPtr>& batch, std::exception_ptr error);
+    void Finished();
+
+    std::unique_ptr<God> god_;
+
+    std::atomic<unsigned> nextLineNum_;
+
+    std::unique_ptr<DynamicBatcher<RequestPtr>> batcher_;
+
+    // batches handed to the thread pool and not finished yet
+    unsigned inFlight_;
+    std::mutex inFlightMutex_;
+    std::condition_variable inFlightDone_;
+};
+
+}
@@ -0,0 +1,122 @@
+// Exercises MosesPlugin the way a phrase-based decoder calls it, without
+// Moses: every input line "<source> ||| <target>" is segmented into phrases
+// of up to --max-phrase-length words in every possible way, and the
+// hypotheses of each round are extended by all phrases that follow them in
+// a single Score() call. Hypotheses that end at the same target position are
+// recombined. All segmentations must give the score of the whole target,
+// which is printed for every line:
+//
+//   mosesplugin_driver -c config.yml [--max-phrase-length 3] < pairs.txt
+//
+// The target gets </s>, so the score is the one of amun --rescore.
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+#include "common/god.h"
+#include "common/vocab.h"
+#include "plugin/nmt.h"
+
+namespace po = boost::program_options;
+
+using namespace amunmt;
+
+int main(int argc, char* argv[])
+{
+  std::string config;
+  unsigned maxPhraseLength;
+
+  po::options_description options("Moses plugin driver options");
+  options.add_options()
+    ("config,c", po::value(&config)->required(),
+     "amun configuration file")
+    ("max-phrase-length", po::value(&maxPhraseLength)->default_value(3),
+     "Longest phrase of a segmentation")
+    ("help,h", po::value<bool>()->zero_tokens()->default_value(false),
+     "Print this help message and exit")
+  ;
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(options).run(), vm);
+    if (vm["help"].as<bool>()) {
+      std::cerr << "Usage: " << argv[0] << " -c <config> [options] < <source ||| target lines>"
+                << std::endl << std::endl << options << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl << std::endl << options << std::endl;
+    return 1;
+  }
+
+  MosesPlugin plugin;
+  plugin.initGod(config);
+  const God& god = plugin.GetGod();
+
+  const auto start = std::chrono::steady_clock::now();
+  size_t lines = 0, calls = 0, extensions = 0;
+  bool consistent = true;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    size_t separator = line.find(" ||| ");
+    if (separator == std::string::npos) {
+      std::cerr << "Error: not a source ||| target line: " << line << std::endl;
+      return 1;
+    }
+    Words sourceWords = god.GetSourceVocab()(line.substr(0, separator));
+    Words target = god.GetTargetVocab()(line.substr(separator + 5));
+
+    HypoState root = plugin.SetSource(std::vector<size_t>(sourceWords.begin(), sourceWords.end()));
+
+    // the hypotheses of the last round and the target position they end at
+    std::vector<std::pair<size_t, HypoState>> frontier(1, std::make_pair(size_t(0), root));
+    std::vector<float> scores;
+    while (!frontier.empty()) {
+      AmunInputs inputs;
+      std::vector<size_t> ends;
+      for (const auto& hypo : frontier) {
+        for (size_t length = 1; length <= maxPhraseLength && hypo.first + length <= target.size(); ++length) {
+          inputs.emplace_back(hypo.second);
+          inputs.back().phrase.assign(target.begin() + hypo.first, target.begin() + hypo.first + length);
+          ends.push_back(hypo.first + length);
+        }
+      }
+
+      HypoStates outputs = plugin.Score(inputs);
+      ++calls;
+      extensions += inputs.size();
+
+      std::vector<bool> recombined(target.size(), false);
+      frontier.clear();
+      for (size_t i = 0; i < outputs.size(); ++i) {
+        if (ends[i] == target.size()) {
+          scores.push_back(outputs[i].score);
+        } else if (!recombined[ends[i]]) {
+          recombined[ends[i]] = true;
+          frontier.emplace_back(ends[i], outputs[i]);
+        }
+      }
+    }
+
+    for (float score : scores) {
+      if (std::abs(score - scores.front()) > 1e-3f * std::max(1.0f, std::abs(scores.front()))) {
+        std::cerr << "Error: line " << lines << " scores " << score << " and " << scores.front()
+                  << " for different segmentations" << std::endl;
+        consistent = false;
+      }
+    }
+    std::cout << std::setprecision(3) << std::fixed << scores.front() << std::endl;
+    ++lines;
+  }
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << lines << " lines, " << calls << " Score() calls of " << extensions
+            << " phrases in " << std::setprecision(3) << seconds << "s" << std::endl;
+  return consistent ? 0 : 1;
+}
@@ -6,6 +6,7 @@ using namespace std;
 namespace amunmt {
 
 HypoState::HypoState()
+  : score(0)
 {}
 
 HypoState::~HypoState()
@@ -15,13 +16,9 @@ HypoState::~HypoState()
 std::string HypoState::Debug() const
 {
   stringstream strm;
- /*
-  strm << " words=" << words.size()
-      << " lastWord=" << lastWord
-      << " prevStates=" << prevStates.size()
-      << " nextStates=" << nextStates.size()
-      << " score=" << score;
- */
+  strm << " row=" << state.row
+       << " lastWord=" << (state.hyp ? state.hyp->GetWord() : 0)
+       << " score=" << score;
   return strm.str();
 }
 
@@ -5,19 +5,36 @@
  *      Author: hieu
  */
 #pragma once
+#include <mutex>
 #include <string>
+#include "common/god.h"
 #include "common/scorer.h"
+#include "common/search.h"
 
 namespace amunmt {
 
+// a source sentence of MosesPlugin::SetSource() and its encoding, shared by
+// the HypoStates of its search; Score() calls for it take turns
+struct SourceInfo
+{
+  std::mutex mutex;
+  std::shared_ptr<Sentences> sentences;
+  // the models of the encoding, kept until the search of the sentence is
+  // done even if God::Reload() swaps in new ones
+  ModelSetPtr models;
+  EncodedSentencesPtr encoded;
+  StateRow begin;
+};
+
 struct HypoState
 {
-  States states;
-  Beam prevHyps;
+  // the decoder states after the words so far, a row of a batch shared with
+  // the other HypoStates of a Score() call
+  StateRow state;
 
   float score;
 
-  std::shared_ptr<Sentences> sentences;
+  std::shared_ptr<SourceInfo> source;
 
   HypoState();
   ~HypoState();
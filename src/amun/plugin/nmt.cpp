@@ -0,0 +1,128 @@
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "nmt.h"
+#include "common/exception.h"
+#include "common/vocab.h"
+#include "common/god.h"
+#include "common/history.h"
+#include "common/sentence.h"
+#include "common/sentences.h"
+#include "common/search.h"
+
+namespace amunmt {
+
+void MosesPlugin::initGod(const std::string& configPath) {
+  std::string configs = "-c " + configPath;
+  god_.Init(configs);
+}
+
+MosesPlugin::MosesPlugin()
+{}
+
+MosesPlugin::~MosesPlugin()
+{
+}
+
+HypoState MosesPlugin::SetSource(const std::vector<size_t>& words) {
+  Words sourceWords(words.begin(), words.end());
+
+  std::shared_ptr<SourceInfo> source;
+  unsigned lineNum;
+  {
+    std::lock_guard<std::mutex> lock(sourcesMutex_);
+    for (auto it = sources_.begin(); it != sources_.end();) {
+      if (it->second.expired()) {
+        it = sources_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    auto found = sources_.find(sourceWords);
+    if (found != sources_.end()) {
+      source = found->second.lock();
+    }
+    // encoded by the models before the last God::Reload()
+    if (source && source->encoded->version != god_.GetModelsVersion()) {
+      source.reset();
+    }
+    lineNum = lineNum_++;
+  }
+
+  if (!source) {
+    source.reset(new SourceInfo());
+    source->sentences.reset(new Sentences());
+    source->sentences->push_back(SentencePtr(new Sentence(god_, lineNum, sourceWords)));
+
+    // Encode
+    Search &search = god_.GetSearch();
+    source->encoded = search.EncodeOnly(*source->sentences);
+    amunmt_UTIL_THROW_IF2(!source->encoded, "The scorers can't keep the encoding of a sentence");
+    source->models = search.GetModels();
+
+    source->begin.states = source->encoded->states;
+    source->begin.row = 0;
+    source->begin.hyp.reset(new Hypothesis(source->sentences->Get(0)));
+
+    std::lock_guard<std::mutex> lock(sourcesMutex_);
+    sources_[sourceWords] = source;
+  }
+
+  // fill return info
+  HypoState ret;
+  ret.state = source->begin;
+  ret.score = 0;
+  ret.source = source;
+  return ret;
+}
+
+HypoStates MosesPlugin::Score(const AmunInputs &inputs)
+{
+  HypoStates outputs(inputs.size());
+
+  // inputs by source, in order of appearance
+  std::vector<SourceInfo*> sources;
+  std::map<SourceInfo*, std::vector<unsigned>> inputsOf;
+  for (unsigned i = 0; i < inputs.size(); ++i) {
+    SourceInfo* source = inputs[i].source.get();
+    amunmt_UTIL_THROW_IF2(!source, "Input " << i << " does not come from SetSource()");
+    std::vector<unsigned>& ids = inputsOf[source];
+    if (ids.empty()) {
+      sources.push_back(source);
+    }
+    ids.push_back(i);
+  }
+
+  Search &search = god_.GetSearch();
+  for (SourceInfo* source : sources) {
+    const std::vector<unsigned>& ids = inputsOf[source];
+    std::vector<const StateRow*> parents;
+    std::vector<Words> phrases;
+    for (unsigned i : ids) {
+      parents.push_back(&inputs[i].state);
+      phrases.push_back(inputs[i].phrase);
+    }
+
+    std::vector<StateRow> states;
+    {
+      std::lock_guard<std::mutex> lock(source->mutex);
+      states = search.ExtendStates(*source->sentences, source->models, *source->encoded,
+                                   parents, phrases);
+    }
+
+    for (unsigned j = 0; j < ids.size(); ++j) {
+      HypoState& output = outputs[ids[j]];
+      output.state = states[j];
+      output.score = states[j].hyp->GetCost();
+      output.source = inputs[ids[j]].source;
+    }
+  }
+
+  return outputs;
+}
+
+}
@@ -4,13 +4,13 @@
 #include <algorithm>
 #include <vector>
 #include <set>
+#include <map>
 #include <memory>
+#include <mutex>
 
 #include "common/god.h"
 #include "common/scorer.h"
 #include "common/sentence.h"
-#include "gpu/mblas/matrix.h"
-#include "gpu/decoder/encoder_decoder.h"
 #include "neural_phrase.h"
 #include "hypo_info.h"
 
@@ -32,12 +32,22 @@ class MosesPlugin {
 
     void initGod(const std::string& configPath);
 
+    // encodes a source sentence, ending with </s>; the encoding is reused by
+    // the Score() calls of its HypoStates and by SetSource() of the same
+    // words while any of them is alive
     HypoState SetSource(const std::vector<size_t>& words);
 
+    // extends every input with its phrase: the inputs of a source are scored
+    // as one batch, inputs with the same state and phrases with a common
+    // prefix share their rows
     HypoStates Score(const AmunInputs &inputs);
 
   private:
     amunmt::God god_;
+
+    std::mutex sourcesMutex_;
+    std::map<Words, std::weak_ptr<SourceInfo>> sources_;
+    unsigned lineNum_ = 0;
     
 };
 
@@ -1,4 +1,9 @@
+#include <deque>
+#include <mutex>
+#include <cctype>
 #include <cstdlib>
+#include <exception>
+#include <condition_variable>
 #include <iostream>
 #include <string>
 #include <boost/timer/timer.hpp>
@@ -14,90 +19,339 @@
 #include "common/sentences.h"
 #include "common/exception.h"
 #include "common/translation_task.h"
+#include "common/input_pipeline.h"
+#include "library/translator.h"
 
 using namespace amunmt;
 using namespace std;
 
-God god_;
+std::unique_ptr<Translator> translator_;
 
-void init(const std::string& options) {
-  god_.Init(options);
+namespace {
+
+// releases the GIL for its scope, so other Python threads run while decoding
+class ReleaseGIL {
+  public:
+    ReleaseGIL()
+      : state_(PyEval_SaveThread())
+    {}
+
+    ~ReleaseGIL() {
+      PyEval_RestoreThread(state_);
+    }
+
+  private:
+    PyThreadState* state_;
+};
+
+God& GetGod() {
+  amunmt_UTIL_THROW_IF2(!translator_, "Call init() first");
+  return translator_->GetGod();
 }
 
+// memoryview of a copy of values, which numpy.asarray() wraps without copying
+template <typename T>
+boost::python::object ToArray(const T* values, size_t size, const char* format,
+                              boost::python::object shape = boost::python::object()) {
+  boost::python::object bytes(boost::python::handle<>(
+      PyBytes_FromStringAndSize(reinterpret_cast<const char*>(values), size * sizeof(T))));
+  boost::python::object view(boost::python::handle<>(PyMemoryView_FromObject(bytes.ptr())));
+  return shape.is_none() ? view.attr("cast")(format) : view.attr("cast")(format, shape);
+}
 
-boost::python::list translate(boost::python::list& in)
-{
-  size_t miniSize = god_.Get<size_t>("mini-batch");
-  size_t maxiSize = god_.Get<size_t>("maxi-batch");
-  int miniWords = god_.Get<int>("mini-batch-words");
+template <typename T>
+boost::python::object ToArray(const std::vector<T>& values, const char* format) {
+  return ToArray(values.data(), values.size(), format);
+}
+
+boost::python::dict ToDict(const TranslationHypothesis& hypothesis) {
+  boost::python::dict result;
+  result["text"] = hypothesis.text;
+  boost::python::list tokens;
+  for (const std::string& token : hypothesis.tokens) {
+    tokens.append(token);
+  }
+  result["tokens"] = tokens;
+  result["ids"] = ToArray(hypothesis.wordIds, "I");
+  result["score"] = hypothesis.score;
+  result["scores"] = ToArray(hypothesis.scoreBreakdown, "f");
+  result["alignment"] = ToArray(hypothesis.alignment, "I");
+
+  // one row of attention weights per target word
+  const std::vector<std::vector<float>>& soft = hypothesis.softAlignment;
+  if (soft.empty()) {
+    result["soft_alignment"] = ToArray(soft, "f");
+  } else {
+    size_t cols = soft[0].size();
+    std::vector<float> values;
+    values.reserve(soft.size() * cols);
+    for (const std::vector<float>& row : soft) {
+      values.insert(values.end(), row.begin(), row.end());
+    }
+    result["soft_alignment"] = ToArray(values.data(), values.size(), "f",
+                                       boost::python::make_tuple(soft.size(), cols));
+  }
+  return result;
+}
+
+boost::python::dict ToDict(const TranslationResult& translation) {
+  boost::python::list nbest;
+  for (const TranslationHypothesis& hypothesis : translation.nbest) {
+    nbest.append(ToDict(hypothesis));
+  }
+  boost::python::dict result;
+  result["translation"] = translation.Best().text;
+  result["nbest"] = nbest;
+  return result;
+}
+
+// source ids from any object with a one-dimensional integer buffer, e.g. a
+// numpy array or array.array, read in place without creating Python ints
+std::vector<unsigned> ToIds(PyObject* object) {
+  Py_buffer view;
+  if (PyObject_GetBuffer(object, &view, PyBUF_FORMAT | PyBUF_ANY_CONTIGUOUS) < 0) {
+    boost::python::throw_error_already_set();
+  }
+  std::unique_ptr<Py_buffer, void(*)(Py_buffer*)> release(&view, PyBuffer_Release);
+
+  std::string format = view.format ? view.format : "B";
+  char type = format.empty() ? 'B' : format.back();
+  bool isSigned = std::islower(type);
+  if (view.ndim != 1 || std::string("bBhHiIlLqQ").find(type) == std::string::npos) {
+    PyErr_SetString(PyExc_ValueError, "Source ids must be a one-dimensional integer array");
+    boost::python::throw_error_already_set();
+  }
 
-  std::vector<std::future< std::shared_ptr<Histories> >> results;
-  SentencesPtr maxiBatch(new Sentences());
-  SentencesPtr maxiBatchCopy(new Sentences());
+  std::vector<unsigned> ids(view.len / view.itemsize);
+  const char* data = static_cast<const char*>(view.buf);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    const char* item = data + i * view.itemsize;
+    int64_t id;
+    switch (view.itemsize) {
+      case 1: id = isSigned ? *(const int8_t*)item : *(const uint8_t*)item; break;
+      case 2: id = isSigned ? *(const int16_t*)item : *(const uint16_t*)item; break;
+      case 4: id = isSigned ? *(const int32_t*)item : *(const uint32_t*)item; break;
+      default: id = *(const int64_t*)item; break;
+    }
+    if (id < 0) {
+      PyErr_SetString(PyExc_ValueError, "Source ids must not be negative");
+      boost::python::throw_error_already_set();
+    }
+    ids[i] = id;
+  }
+  return ids;
+}
 
-  for(int lineNum = 0; lineNum < boost::python::len(in); ++lineNum) {
-    std::string line = boost::python::extract<std::string>(boost::python::object(in[lineNum]));
-    //cerr << "line=" << line << endl;
+}
 
-    maxiBatch->push_back(SentencePtr(new Sentence(god_, lineNum, line)));
+// Results of translate_iter() in the order they finish. Decoder threads add
+// to it without the GIL; next() waits for them with the GIL released, and
+// raises RuntimeError for a sentence whose translation failed.
+class ResultIterator {
+  public:
+    ResultIterator(size_t size)
+      : remaining_(size)
+    {}
 
-    if (maxiBatch->size() >= maxiSize) {
+    void Add(size_t index, const TranslationResult& result) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back({index, result, nullptr});
+      }
+      added_.notify_one();
+    }
 
-      maxiBatch->SortByLength();
-      while (maxiBatch->size()) {
-        SentencesPtr miniBatch = maxiBatch->NextMiniBatch(miniSize, miniWords);
-        maxiBatchCopy->push_back(miniBatch->at(0));
+    void Fail(size_t index, std::exception_ptr error) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back({index, TranslationResult(), error});
+      }
+      added_.notify_one();
+    }
 
-        results.emplace_back(
-          god_.GetThreadPool().enqueue(
-              [miniBatch]{ return TranslationTask(::god_, miniBatch); }
-              )
-        );
+    boost::python::tuple Next() {
+      Item next;
+      bool done;
+      {
+        // the lock goes before the GIL is taken back
+        ReleaseGIL release;
+        std::unique_lock<std::mutex> lock(mutex_);
+        done = (remaining_ == 0);
+        if (!done) {
+          added_.wait(lock, [this] { return !results_.empty(); });
+          next = std::move(results_.front());
+          results_.pop_front();
+          --remaining_;
+        }
       }
 
-      maxiBatch.reset(new Sentences());
+      if (done) {
+        PyErr_SetNone(PyExc_StopIteration);
+        boost::python::throw_error_already_set();
+      }
+      if (next.error) {
+        std::rethrow_exception(next.error);
+      }
+      return boost::python::make_tuple(next.index, ToDict(next.result));
     }
+
+  private:
+    struct Item {
+      size_t index;
+      TranslationResult result;
+      std::exception_ptr error;
+    };
+
+    std::deque<Item> results_;
+    size_t remaining_;
+    std::mutex mutex_;
+    std::condition_variable added_;
+};
+
+void init(const std::string& options) {
+  translator_.reset(new Translator(options));
+}
+
+
+boost::python::list translate(boost::python::list& in)
+{
+  God& god = GetGod();
+  std::vector<std::string> lines(boost::python::len(in));
+  for(size_t lineNum = 0; lineNum < lines.size(); ++lineNum) {
+    lines[lineNum] = boost::python::extract<std::string>(boost::python::object(in[lineNum]));
   }
 
-  // last batch
-  if (maxiBatch->size()) {
-    maxiBatch->SortByLength();
-    while (maxiBatch->size()) {
-      SentencesPtr miniBatch = maxiBatch->NextMiniBatch(miniSize, miniWords);
-      maxiBatchCopy->push_back(miniBatch->at(0));
+  std::vector<std::string> output(lines.size());
+  {
+    ReleaseGIL release;
+
+    size_t nextLine = 0;
+    InputPipeline pipeline(god, [&lines, &nextLine](std::string& line) {
+      if (nextLine == lines.size()) {
+        return false;
+      }
+      line = lines[nextLine++];
+      return true;
+    });
+
+    std::vector<std::future< std::shared_ptr<Histories> >> results;
+    std::vector<SentencePtr> sentences(lines.size());
+
+    while (SentencesPtr miniBatch = pipeline.NextMiniBatch()) {
+      for (size_t i = 0; i < miniBatch->size(); ++i) {
+        sentences[miniBatch->Get(i).GetLineNum()] = miniBatch->at(i);
+      }
+
       results.emplace_back(
-        god_.GetThreadPool().enqueue(
-            [miniBatch]{ return TranslationTask(::god_, miniBatch); }
+        god.GetThreadPool().enqueue(
+            [&god, miniBatch]{ return TranslationTask(god, miniBatch); }
             )
       );
     }
+
+    for (auto&& result : results) {
+      std::shared_ptr<Histories> histories = result.get();
+      for (size_t i = 0; i < histories->size(); ++i) {
+        const History& history = *histories->at(i).get();
+        const Sentence& sentence = *sentences[history.GetLineNum()];
+        std::stringstream ss;
+        Printer(god, history, ss, sentence);
+        god.GetLatencyStats().Record(sentence, history.Top().first.size());
+        god.GetMetrics().SentenceFinished();
+        output[history.GetLineNum()] = ss.str();
+      }
+    }
   }
 
-  // resort batch into line number order
-  Histories allHistories;
-  for (auto&& result : results) {
-    std::shared_ptr<Histories> histories = result.get();
-    allHistories.Append(*histories);
+  boost::python::list out;
+  for (const std::string& str : output) {
+    out.append(str);
   }
-  allHistories.SortByLineNum();
-
-  // output
-  boost::python::list output;
-  for (size_t i = 0; i < allHistories.size(); ++i) {
-    const History& history = *allHistories.at(i).get();
-    const Sentence& sentence = *maxiBatchCopy->at(i).get();
-    std::stringstream ss;
-    Printer(god_, history, ss, sentence);
-    string str = ss.str();
-
-    output.append(str);
+  return out;
+}
+
+// Translates strings or integer arrays of source ids (without </s>) and
+// yields (index, result) pairs in the order the sentences finish.
+std::shared_ptr<ResultIterator> translate_iter(boost::python::object in)
+{
+  GetGod();
+  size_t size = boost::python::len(in);
+  std::vector<std::string> lines(size);
+  std::vector<std::vector<unsigned>> ids(size);
+  std::vector<bool> isText(size);
+  for (size_t i = 0; i < size; ++i) {
+    boost::python::object item = in[i];
+    boost::python::extract<std::string> text(item);
+    isText[i] = text.check();
+    if (isText[i]) {
+      lines[i] = text();
+    } else {
+      ids[i] = ToIds(item.ptr());
+    }
   }
 
-  return output;
+  std::shared_ptr<ResultIterator> results(new ResultIterator(size));
+  ReleaseGIL release;
+  for (size_t i = 0; i < size; ++i) {
+    auto callback = [results, i](const TranslationResult& result) { results->Add(i, result); };
+    auto onError = [results, i](std::exception_ptr error) { results->Fail(i, error); };
+    if (isText[i]) {
+      translator_->Translate(lines[i], callback, onError);
+    } else {
+      translator_->TranslateIds(ids[i], callback, onError);
+    }
+  }
+  return results;
+}
+
+std::shared_ptr<ResultIterator> iter(std::shared_ptr<ResultIterator> self)
+{
+  return self;
+}
+
+// latency percentiles in milliseconds per stage, and throughput counters
+boost::python::dict latency_stats()
+{
+  const LatencyStats& stats = GetGod().GetLatencyStats();
+
+  boost::python::dict result;
+  result["sentences"] = stats.Sentences();
+  result["source_tokens"] = stats.SourceTokens();
+  result["target_tokens"] = stats.TargetTokens();
+  result["elapsed"] = stats.Elapsed();
+
+  for (unsigned i = 0; i < LatencyStats::NUM_STAGES; ++i) {
+    const LatencyHistogram& histogram = stats.Get(LatencyStats::Stage(i));
+    boost::python::dict stage;
+    stage["count"] = histogram.Count();
+    stage["mean"] = histogram.Mean() / 1000.0;
+    stage["p50"] = histogram.Percentile(50) / 1000.0;
+    stage["p95"] = histogram.Percentile(95) / 1000.0;
+    stage["p99"] = histogram.Percentile(99) / 1000.0;
+    stage["max"] = histogram.Max() / 1000.0;
+    result[LatencyStats::GetStageName(LatencyStats::Stage(i))] = stage;
+  }
+  return result;
+}
+
+// metrics in Prometheus text format
+std::string metrics()
+{
+  God& god = GetGod();
+  return god.GetMetrics().Render(god);
 }
 
 BOOST_PYTHON_MODULE(libamunmt)
 {
+  boost::python::class_<ResultIterator, std::shared_ptr<ResultIterator>, boost::noncopyable>
+    ("ResultIterator", boost::python::no_init)
+    .def("__iter__", iter)
+    .def("__next__", &ResultIterator::Next)
+    .def("next", &ResultIterator::Next);
+
   boost::python::def("init", init);
   boost::python::def("translate", translate);
+  boost::python::def("translate_iter", translate_iter);
+  boost::python::def("latency_stats", latency_stats);
+  boost::python::def("metrics", metrics);
 }
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Sentences with the same words but different factors must not share an
+# entry of the translation cache (--cache-size).
+
+. "$(dirname "$0")/common.sh"
+
+printf '"</s>": 0\n"<unk>": 1\n"x": 2\n"y": 3\n' > "$WORK/vocab.factor.yml"
+sed -i "s|^source-vocab: .*|source-vocab: [[$WORK/vocab.src.yml, $WORK/vocab.factor.yml]]|" "$WORK/config.yml"
+
+printf 'w2|x w3|x\nw2|y w3|y\nw2|x w3|x\n' > "$WORK/input.txt"
+
+# one sentence per maxi-batch: the third line is answered by the cache
+"$BUILD/amun" -c "$WORK/config.yml" --cache-size 10 --mini-batch 1 --maxi-batch 1 \
+  < "$WORK/input.txt" > "$WORK/output.txt" 2> "$WORK/log.txt" || fail "amun failed"
+grep -q "Translation cache: 1 hits, 2 misses, 0 duplicates" "$WORK/log.txt" \
+  || fail "expected 1 hit and 2 misses: $(grep 'Translation cache:' "$WORK/log.txt")"
+
+# larger maxi-batches: the third line is a duplicate of the first, or a hit
+# if the first maxi-batch was cut before it arrived
+"$BUILD/amun" -c "$WORK/config.yml" --cache-size 10 --mini-batch 4 --maxi-batch 4 \
+  < "$WORK/input.txt" > "$WORK/output.txt" 2> "$WORK/log.txt" || fail "amun failed"
+grep -Eq "Translation cache: (1 hits, 2 misses, 0|0 hits, 2 misses, 1) duplicates" "$WORK/log.txt" \
+  || fail "expected 2 misses: $(grep 'Translation cache:' "$WORK/log.txt")"
+
+echo "PASS $(basename "$0")"
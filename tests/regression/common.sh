@@ -0,0 +1,17 @@
+# Shared setup of the regression tests: a small random model from amun_synth
+# in a temporary directory, removed when the test exits.
+#
+# BUILD is the directory of the amun executables, ../../build by default.
+
+set -e
+
+BUILD=${BUILD:-$(cd "$(dirname "$0")/../../build" && pwd)}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+"$BUILD/amun_synth" -o "$WORK" --src-vocab 20 --trg-vocab 20 --dim-emb 8 --dim-rnn 8 2> /dev/null
+
+fail() {
+  echo "FAIL $(basename "$0"): $*" >&2
+  exit 1
+}
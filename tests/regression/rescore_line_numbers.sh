@@ -0,0 +1,20 @@
+#!/bin/bash
+# --rescore rejects n-best lines numbered outside the input instead of crashing.
+
+. "$(dirname "$0")/common.sh"
+
+printf 'w2 w3\nw4 w5\n' > "$WORK/input.txt"
+
+for num in -1 4294967296 99999999999999999999; do
+  printf '%s ||| w4 ||| F0= -1 ||| -1\n' "$num" > "$WORK/nbest.txt"
+  status=0
+  # in a subshell, which reports the abort to /dev/null
+  ("$BUILD/amun" -c "$WORK/config.yml" --rescore "$WORK/nbest.txt" \
+    < "$WORK/input.txt" > /dev/null 2> "$WORK/log.txt"; exit $?) 2> /dev/null || status=$?
+  # amun aborts with the error, instead of dereferencing a null pointer
+  [ $status -ne 0 ] || fail "line number $num was accepted"
+  grep -q "Line number out of range" "$WORK/log.txt" \
+    || fail "line number $num: exit status $status, $(tail -n 1 "$WORK/log.txt")"
+done
+
+echo "PASS $(basename "$0")"
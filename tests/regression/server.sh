@@ -0,0 +1,101 @@
+#!/bin/bash
+# amun --server on a Unix-domain socket: plain lines are answered in order,
+# also after the client half-closed, JSON requests by id, and a line that
+# can't be read fails that request only.
+
+. "$(dirname "$0")/common.sh"
+
+# merges of every word, so that the server preprocesses with BPE
+for i in $(seq 2 19); do echo "w $i</w>"; done > "$WORK/bpe.codes"
+printf 'w2 w3\nw4 w5 w6\nw7\nw8 w9 w10 w11\nw12 w13\n' > "$WORK/input.txt"
+
+# the translations the server must give
+"$BUILD/amun" -c "$WORK/config.yml" --bpe "$WORK/bpe.codes" \
+  < "$WORK/input.txt" > "$WORK/expected.txt" 2> "$WORK/log.txt" || fail "amun failed"
+
+"$BUILD/amun" -c "$WORK/config.yml" --bpe "$WORK/bpe.codes" --server --socket "$WORK/amun.sock" \
+  --mini-batch 4 --maxi-batch 4 --cpu-threads 2 2> "$WORK/server.log" &
+SERVER=$!
+trap 'kill $SERVER 2> /dev/null || true; rm -rf "$WORK"' EXIT
+for i in $(seq 50); do
+  [ -S "$WORK/amun.sock" ] && break
+  sleep 0.1
+done
+
+python3 - "$WORK/amun.sock" "$WORK/input.txt" "$WORK/expected.txt" <<'PYTHON' || fail "$(tail -n 3 "$WORK/server.log")"
+import json
+import socket
+import sys
+
+path, inputs, outputs = sys.argv[1:]
+lines = open(inputs).read().splitlines()
+expected = open(outputs).read().splitlines()
+
+
+def connect():
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.settimeout(30)
+    sock.connect(path)
+    return sock, sock.makefile("rb")
+
+
+def check(what, got, want):
+    if got != want:
+        sys.exit("%s: got %r, expected %r" % (what, got, want))
+
+
+# plain lines, sent at once, come back in order
+sock, replies = connect()
+sock.sendall("".join(line + "\n" for line in lines).encode("utf-8"))
+for i in range(len(lines)):
+    check("plain line %d" % i, replies.readline().decode("utf-8").rstrip("\n"), expected[i])
+sock.close()
+
+# a client that half-closes after its requests still gets every answer, the
+# last request needs no newline
+sock, replies = connect()
+sock.sendall(("\n".join(lines[:2])).encode("utf-8"))
+sock.shutdown(socket.SHUT_WR)
+for i in range(2):
+    check("half-closed line %d" % i, replies.readline().decode("utf-8"), expected[i] + "\n")
+sock.close()
+
+# JSON requests, answered by id
+sock, replies = connect()
+for i in reversed(range(len(lines))):
+    sock.sendall((json.dumps({"id": "s%d" % i, "text": lines[i]}) + "\n").encode("utf-8"))
+translations = {}
+for _ in lines:
+    reply = json.loads(replies.readline())
+    translations[reply["id"]] = reply["translation"]
+for i in range(len(lines)):
+    check("JSON request s%d" % i, translations.get("s%d" % i), expected[i])
+
+sock.sendall(b'{"cancel": "none"}\n')
+reply = json.loads(replies.readline())
+check("cancel of an unknown id", (reply.get("id"), "error" in reply), ("none", True))
+for bad in [b'{"id": "x"}', b'{"id": "x", "text": ["w2"]}', b'{"text": "w2"']:
+    sock.sendall(bad + b"\n")
+    reply = json.loads(replies.readline())
+    check("reply to %r" % bad, "error" in reply, True)
+sock.close()
+
+# invalid UTF-8 fails its request, the next one on the connection is answered
+sock, replies = connect()
+sock.sendall(b"\xff\xfe bad\n" + lines[0].encode("utf-8") + b"\n")
+check("plain invalid UTF-8", replies.readline(), b"\n")
+check("plain line after invalid UTF-8", replies.readline().decode("utf-8").rstrip("\n"), expected[0])
+sock.sendall(b'{"id": "u", "text": "\xff\xfe bad"}\n')
+reply = json.loads(replies.readline().decode("utf-8", "replace"))
+check("JSON invalid UTF-8", "error" in reply, True)
+sock.sendall((json.dumps({"id": "v", "text": lines[1]}) + "\n").encode("utf-8"))
+reply = json.loads(replies.readline())
+check("JSON request after invalid UTF-8", (reply.get("id"), reply.get("translation")), ("v", expected[1]))
+sock.close()
+PYTHON
+
+kill -0 $SERVER 2> /dev/null || fail "the server exited"
+kill $SERVER
+wait $SERVER || true
+
+echo "PASS $(basename "$0")"
@@ -0,0 +1,20 @@
+#!/bin/bash
+# --workers gives n-best lists with the line numbers of the input, also with
+# --wipo, where they follow "OUT: ".
+
+. "$(dirname "$0")/common.sh"
+
+for i in $(seq 0 199); do
+  echo "w$((i % 18 + 2)) w$((i * 7 % 18 + 2)) w$((i * 5 % 18 + 2))"
+done > "$WORK/input.txt"
+
+for wipo in "" --wipo; do
+  "$BUILD/amun" -c "$WORK/config.yml" --n-best --beam-size 3 $wipo \
+    < "$WORK/input.txt" > "$WORK/expected.txt" 2> "$WORK/log.txt" || fail "amun failed"
+  "$BUILD/amun" -c "$WORK/config.yml" --n-best --beam-size 3 $wipo --workers 2 \
+    < "$WORK/input.txt" > "$WORK/output.txt" 2> "$WORK/log.txt" || fail "amun --workers 2 failed"
+  cmp -s "$WORK/expected.txt" "$WORK/output.txt" \
+    || fail "n-best lists of --workers 2 $wipo differ: $(diff "$WORK/expected.txt" "$WORK/output.txt" | head -n 4)"
+done
+
+echo "PASS $(basename "$0")"